@@ -0,0 +1,257 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <graph.h>
+#include <loader.h>
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Benchmarks for the layout step, graph generation, the loader and the editing operations behind the selector.
+ * Every graph is generated from a fixed seed so numbers from different runs (and commits) are comparable.
+ */
+
+constexpr blt::u64 SEED = 0x5EED;
+
+enum bench_equation_t
+{
+    EADES,
+    FRUCHTERMAN_REINGOLD
+};
+
+/**
+ * Fills graph with count nodes spread out evenly over an area which grows with the node count. Every node is connected to a random
+ * earlier node (so the graph is connected) and gets extra_degree more edges to random nodes on average.
+ */
+void fill_graph(graph_t& graph, blt::size_t count, double extra_degree, blt::u64 seed)
+{
+    std::mt19937_64 engine{seed};
+    const auto side = static_cast<float>(std::sqrt(static_cast<double>(count))) * conf::DEFAULT_SPRING_LENGTH;
+    std::uniform_real_distribution pos_dist(0.0f, side);
+    
+    graph.clear();
+    for (blt::size_t i = 0; i < count; i++)
+        graph.add_node({pos_dist(engine), pos_dist(engine)}, node_t{conf::POINT_SIZE, "node" + std::to_string(i)});
+    for (blt::size_t i = 1; i < count; i++)
+        graph.connect(i, std::uniform_int_distribution<blt::u64>(0, i - 1)(engine));
+    
+    std::uniform_int_distribution<blt::u64> node_dist(0, count - 1);
+    const auto extra_edges = static_cast<blt::size_t>(static_cast<double>(count) * extra_degree / 2);
+    for (blt::size_t i = 0; i < extra_edges; i++)
+    {
+        const auto n1 = node_dist(engine);
+        const auto n2 = node_dist(engine);
+        if (n1 != n2)
+            graph.connect(n1, n2);
+    }
+}
+
+/**
+ * Every pair of nodes is connected with the given probability.
+ */
+void fill_dense_graph(graph_t& graph, blt::size_t count, double probability, blt::u64 seed)
+{
+    std::mt19937_64 engine{seed};
+    std::uniform_real_distribution pos_dist(0.0f, static_cast<float>(std::sqrt(static_cast<double>(count))) * conf::DEFAULT_SPRING_LENGTH);
+    std::uniform_real_distribution chance(0.0, 1.0);
+    
+    graph.clear();
+    for (blt::size_t i = 0; i < count; i++)
+        graph.add_node({pos_dist(engine), pos_dist(engine)}, node_t{conf::POINT_SIZE, "node" + std::to_string(i)});
+    for (blt::size_t i = 0; i < count; i++)
+    {
+        for (blt::size_t j = i + 1; j < count; j++)
+        {
+            if (chance(engine) < probability)
+                graph.connect(i, j);
+        }
+    }
+}
+
+std::string bench_file(blt::size_t count)
+{
+    return (std::filesystem::temp_directory_path() / ("graphs_bench_" + std::to_string(count) + ".json")).string();
+}
+
+/**
+ * --------------------------------------------------------
+ *                       simulation
+ * --------------------------------------------------------
+ */
+
+// args: node count, equation, repulsion mode
+void BM_step(benchmark::State& state)
+{
+    graph_t graph;
+    fill_graph(graph, static_cast<blt::size_t>(state.range(0)), 2, SEED);
+    if (state.range(1) == EADES)
+        graph.use_Eades();
+    else
+        graph.use_Fruchterman_Reingold();
+    graph.setRepulsionMode(static_cast<repulsion_mode_t>(state.range(2)));
+    // a single thread keeps the numbers comparable between machines
+    graph.getThreadCount() = 1;
+    const float sim_factor = conf::FIXED_TIMESTEP * graph.getSimSpeed() * 0.05f;
+    // builds the adjacency outside of the timed loop
+    graph.step(sim_factor);
+    
+    for (auto _ : state)
+        graph.step(sim_factor);
+    
+    state.SetItemsProcessed(static_cast<blt::i64>(state.iterations()) * state.range(0));
+    state.SetLabel(graph.getSimulatorName());
+}
+
+BENCHMARK(BM_step)->ArgNames({"nodes", "equation", "mode"})
+                  ->ArgsProduct({{1000, 10000, 100000}, {EADES, FRUCHTERMAN_REINGOLD},
+                                 {static_cast<blt::i64>(repulsion_mode_t::BARNES_HUT), static_cast<blt::i64>(repulsion_mode_t::CUTOFF)}})
+                  ->ArgsProduct({{1000, 10000}, {EADES, FRUCHTERMAN_REINGOLD}, {static_cast<blt::i64>(repulsion_mode_t::EXACT)}})
+                  ->Unit(benchmark::kMillisecond);
+
+/**
+ * --------------------------------------------------------
+ *                        generation
+ * --------------------------------------------------------
+ */
+
+// args: node count, graph model, average degree
+void BM_generate(benchmark::State& state)
+{
+    const auto count = static_cast<blt::size_t>(state.range(0));
+    const auto side = static_cast<int>(std::sqrt(static_cast<double>(count)) * conf::DEFAULT_SPRING_LENGTH);
+    graph_t graph;
+    auto& settings = graph.getGeneratorSettings();
+    settings.model = static_cast<graph_model_t>(state.range(1));
+    settings.node_count = static_cast<int>(count);
+    settings.average_degree = static_cast<float>(state.range(2));
+    settings.seed = SEED;
+    
+    generator_result_t result;
+    for (auto _ : state)
+    {
+        result = graph.generate({0, 0, side, side});
+        benchmark::DoNotOptimize(graph.numberOfNodes());
+    }
+    
+    state.SetItemsProcessed(static_cast<blt::i64>(state.iterations()) * state.range(0));
+    state.SetLabel(std::to_string(result.edges) + " edges");
+}
+
+BENCHMARK(BM_generate)->ArgNames({"nodes", "model", "degree"})
+                      ->ArgsProduct({{1000, 100000, 1000000},
+                                     {static_cast<blt::i64>(graph_model_t::RANDOM), static_cast<blt::i64>(graph_model_t::PREFERENTIAL_ATTACHMENT),
+                                      static_cast<blt::i64>(graph_model_t::GEOMETRIC)}, {4, 16}})
+                      ->Unit(benchmark::kMillisecond);
+
+/**
+ * --------------------------------------------------------
+ *                          loader
+ * --------------------------------------------------------
+ */
+
+// args: node count
+void BM_save_for(benchmark::State& state)
+{
+    const auto count = static_cast<blt::size_t>(state.range(0));
+    const auto path = bench_file(count);
+    graph_t graph;
+    fill_graph(graph, count, 2, SEED);
+    const loader_t loader;
+    
+    for (auto _ : state)
+        loader_t::save_for(graph, loader, path);
+    
+    state.SetItemsProcessed(static_cast<blt::i64>(state.iterations()) * state.range(0));
+    state.SetBytesProcessed(static_cast<blt::i64>(state.iterations() * std::filesystem::file_size(path)));
+}
+
+// args: node count
+void BM_load_for(benchmark::State& state)
+{
+    const auto count = static_cast<blt::size_t>(state.range(0));
+    const auto path = bench_file(count);
+    graph_t graph;
+    // written here as well so the load benchmark doesn't depend on the save benchmark having run first
+    fill_graph(graph, count, 2, SEED);
+    loader_t::save_for(graph, loader_t{}, path);
+    
+    for (auto _ : state)
+    {
+        auto loader = loader_t::load_for(graph, 1440, 720, path);
+        benchmark::DoNotOptimize(loader);
+    }
+    
+    state.SetItemsProcessed(static_cast<blt::i64>(state.iterations()) * state.range(0));
+    state.SetBytesProcessed(static_cast<blt::i64>(state.iterations() * std::filesystem::file_size(path)));
+    std::filesystem::remove(path);
+}
+
+BENCHMARK(BM_save_for)->ArgNames({"nodes"})->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_load_for)->ArgNames({"nodes"})->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+/**
+ * --------------------------------------------------------
+ *                         selector
+ * --------------------------------------------------------
+ */
+
+// args: node count, edge probability in percent. removes the node in the middle of the list, what selector_t::destroy_node does
+void BM_remove_node(benchmark::State& state)
+{
+    const auto count = static_cast<blt::size_t>(state.range(0));
+    const auto probability = static_cast<double>(state.range(1)) / 100.0;
+    graph_t graph;
+    
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        fill_dense_graph(graph, count, probability, SEED);
+        state.ResumeTiming();
+        graph.remove_node(count / 2);
+    }
+}
+
+// args: node count. the hit test selector_t::process_mouse does every time the mouse is pressed
+void BM_node_at(benchmark::State& state)
+{
+    const auto count = static_cast<blt::size_t>(state.range(0));
+    graph_t graph;
+    fill_graph(graph, count, 2, SEED);
+    
+    std::mt19937_64 engine{SEED + 1};
+    const auto side = static_cast<float>(std::sqrt(static_cast<double>(count))) * conf::DEFAULT_SPRING_LENGTH;
+    std::uniform_real_distribution pos_dist(0.0f, side);
+    std::vector<blt::vec2> queries;
+    for (int i = 0; i < 256; i++)
+        queries.emplace_back(pos_dist(engine), pos_dist(engine));
+    
+    for (auto _ : state)
+    {
+        for (const auto& query : queries)
+            benchmark::DoNotOptimize(graph.node_at(query));
+    }
+    
+    state.SetItemsProcessed(static_cast<blt::i64>(state.iterations() * queries.size()));
+}
+
+BENCHMARK(BM_remove_node)->ArgNames({"nodes", "probability"})->ArgsProduct({{250, 1000}, {10, 50}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_node_at)->ArgNames({"nodes"})->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,248 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <graph.h>
+#include <loader.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Lays out a graph file without opening a window. Everything runs on the calling thread (plus the simulation's worker threads) as
+ * fast as it can, there is no frame rate to keep up with.
+ */
+
+void print_usage(const char* program)
+{
+    BLT_INFO("Usage: %s <input.json> <equation> <max iterations> <threshold> [output.json] [options]", program);
+    BLT_INFO("    equation            Eades or Fruchterman-Reingold");
+    BLT_INFO("    max iterations      stop after this many steps");
+    BLT_INFO("    threshold           stop once the largest force acting on a node falls to this");
+    BLT_INFO("    output.json         where the laid out graph is written, defaults to the input file");
+    BLT_INFO("Options:");
+    BLT_INFO("    --threads <n>       threads used by the simulation, defaults to all of them");
+    BLT_INFO("    --mode <mode>       repulsion mode, one of exact, barnes-hut or cutoff. defaults to barnes-hut");
+    BLT_INFO("    --multilevel        start from a multilevel layout instead of the positions in the file");
+    BLT_INFO("    --generate <model>  lay out a random graph instead of reading input.json, which is still where it is written to unless");
+    BLT_INFO("                        output.json is given. one of random, preferential or geometric");
+    BLT_INFO("    --nodes <n>         nodes in the generated graph, defaults to 1000");
+    BLT_INFO("    --degree <d>        average number of edges per node of the generated graph, defaults to 4");
+    BLT_INFO("    --seed <n>          seed of the generated graph, defaults to a random one");
+}
+
+std::optional<repulsion_mode_t> parse_mode(std::string_view mode)
+{
+    if (mode == "exact")
+        return repulsion_mode_t::EXACT;
+    if (mode == "barnes-hut")
+        return repulsion_mode_t::BARNES_HUT;
+    if (mode == "cutoff")
+        return repulsion_mode_t::CUTOFF;
+    return {};
+}
+
+std::optional<graph_model_t> parse_model(std::string_view model)
+{
+    if (model == "random")
+        return graph_model_t::RANDOM;
+    if (model == "preferential")
+        return graph_model_t::PREFERENTIAL_ATTACHMENT;
+    if (model == "geometric")
+        return graph_model_t::GEOMETRIC;
+    return {};
+}
+
+template<typename T>
+std::optional<T> parse_number(const char* str)
+{
+    char* end = nullptr;
+    T value;
+    if constexpr (std::is_integral_v<T>)
+        value = static_cast<T>(std::strtol(str, &end, 10));
+    else
+        value = static_cast<T>(std::strtod(str, &end));
+    if (end == str || *end != '\0')
+        return {};
+    return value;
+}
+
+int main(int argc, const char** argv)
+{
+    std::vector<std::string_view> positional;
+    std::optional<int> threads;
+    std::optional<repulsion_mode_t> mode;
+    bool multilevel = false;
+    std::optional<graph_model_t> model;
+    generator_settings_t generator;
+    generator.node_count = 1000;
+    
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+        {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg == "--multilevel")
+            multilevel = true;
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            threads = parse_number<int>(argv[++i]);
+            if (!threads || *threads < 1)
+            {
+                BLT_ERROR("Thread count must be a positive number!");
+                return 1;
+            }
+        } else if (arg == "--mode" && i + 1 < argc)
+        {
+            mode = parse_mode(argv[++i]);
+            if (!mode)
+            {
+                BLT_ERROR("Unknown repulsion mode '%s'!", argv[i]);
+                return 1;
+            }
+        } else if (arg == "--generate" && i + 1 < argc)
+        {
+            model = parse_model(argv[++i]);
+            if (!model)
+            {
+                BLT_ERROR("Unknown graph model '%s'!", argv[i]);
+                return 1;
+            }
+            generator.model = *model;
+        } else if (arg == "--nodes" && i + 1 < argc)
+        {
+            const auto nodes = parse_number<int>(argv[++i]);
+            if (!nodes || *nodes < 1)
+            {
+                BLT_ERROR("Node count must be a positive number!");
+                return 1;
+            }
+            generator.node_count = *nodes;
+        } else if (arg == "--degree" && i + 1 < argc)
+        {
+            const auto degree = parse_number<float>(argv[++i]);
+            if (!degree || *degree < 0)
+            {
+                BLT_ERROR("Average degree must be a number >= 0!");
+                return 1;
+            }
+            generator.average_degree = *degree;
+        } else if (arg == "--seed" && i + 1 < argc)
+        {
+            const auto seed = parse_number<long>(argv[++i]);
+            if (!seed)
+            {
+                BLT_ERROR("Seed must be a number!");
+                return 1;
+            }
+            generator.seed = static_cast<blt::u64>(*seed);
+        } else
+            positional.push_back(arg);
+    }
+    
+    if (positional.size() < 4 || positional.size() > 5)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    
+    const auto input = positional[0];
+    const auto equation = positional[1];
+    const auto max_iterations = parse_number<int>(positional[2].data());
+    const auto threshold = parse_number<float>(positional[3].data());
+    const auto output = positional.size() > 4 ? positional[4] : input;
+    
+    if (!max_iterations || *max_iterations < 0)
+    {
+        BLT_ERROR("Max iterations must be a number >= 0!");
+        return 1;
+    }
+    if (!threshold)
+    {
+        BLT_ERROR("Threshold must be a number!");
+        return 1;
+    }
+    
+    graph_t graph;
+    if (!graph.use_equation(equation))
+    {
+        BLT_ERROR("Unknown equation '%s', expected Eades or Fruchterman-Reingold!", std::string(equation).c_str());
+        return 1;
+    }
+    
+    std::optional<loader_t> loader;
+    if (model)
+    {
+        // about a spring length between neighbouring nodes, instead of cramming them into a window
+        const auto side = static_cast<int>(std::sqrt(static_cast<float>(generator.node_count)) * conf::DEFAULT_SPRING_LENGTH);
+        bounding_box bb{0, 0, side, side};
+        bb.is_screen = false;
+        graph.getGeneratorSettings() = generator;
+        const auto generated = graph.generate(bb);
+        BLT_INFO("Generated %lu nodes and %lu edges in %lf ms", static_cast<unsigned long>(generated.nodes),
+                 static_cast<unsigned long>(generated.edges), generated.milliseconds);
+        loader = loader_t{};
+    } else
+    {
+        // nodes missing a position are spread out over the same area the window would have given them
+        loader = loader_t::load_for(graph, 1440, 720, input);
+        if (!loader)
+            return 1;
+    }
+    
+    graph.getMaxIterations() = *max_iterations;
+    graph.getIterControl() = false;
+    graph.getThreshold() = *threshold;
+    if (threads)
+        graph.getThreadCount() = *threads;
+    if (mode)
+        graph.setRepulsionMode(*mode);
+    
+    const auto start = blt::system::getCurrentTimeNanoseconds();
+    if (multilevel)
+    {
+        // no simulation thread here, the whole layout runs in a single slice
+        graph.run_multilevel_layout();
+        graph.advance_layout(std::numeric_limits<double>::infinity());
+    }
+    
+    // same step size the simulation thread uses
+    const float sim_factor = conf::FIXED_TIMESTEP * graph.getSimSpeed() * 0.05f;
+    graph.start_sim();
+    // max force isn't known until the first step, so always take at least one
+    if (*max_iterations > 0)
+    {
+        do
+        {
+            graph.step(sim_factor);
+        } while (graph.should_step());
+    }
+    const auto end = blt::system::getCurrentTimeNanoseconds();
+    
+    BLT_INFO("Laid out %d nodes with %s in %d iterations, final max force %f, took %lf ms", graph.numberOfNodes(),
+             graph.getSimulatorName().c_str(), graph.getCurrentIterations(), graph.getMaxForce(), static_cast<double>(end - start) / 1e6);
+    
+    loader_t::save_for(graph, *loader, output);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAPHS_ADJACENCY_H
+#define GRAPHS_ADJACENCY_H
+
+#include <vector>
+#include <blt/std/types.h>
+#include <graph_base.h>
+#include <edge_table.h>
+
+/**
+ * Compressed sparse row snapshot of the graph's edges.
+ *
+ * The neighbours of node i are stored in neighbours[offsets[i]] to neighbours[offsets[i + 1]], with edge_indices holding the
+ * index of the matching edge inside getEdges(). The snapshot is only valid until the graph is changed, graph_t rebuilds it on demand.
+ */
+class adjacency_t
+{
+    public:
+        struct range_t
+        {
+            const blt::u32* first;
+            const blt::u32* last;
+            
+            [[nodiscard]] const blt::u32* begin() const
+            {
+                return first;
+            }
+            
+            [[nodiscard]] const blt::u32* end() const
+            {
+                return last;
+            }
+            
+            [[nodiscard]] blt::size_t size() const
+            {
+                return static_cast<blt::size_t>(last - first);
+            }
+        };
+        
+        void build(blt::size_t node_count, const edge_table_t& edge_set);
+        
+        [[nodiscard]] blt::size_t nodeCount() const
+        {
+            return offsets.empty() ? 0 : offsets.size() - 1;
+        }
+        
+        [[nodiscard]] blt::size_t degree(blt::size_t node) const
+        {
+            return offsets[node + 1] - offsets[node];
+        }
+        
+        [[nodiscard]] range_t neighbours(blt::size_t node) const
+        {
+            return {neighbour_list.data() + offsets[node], neighbour_list.data() + offsets[node + 1]};
+        }
+        
+        // indices into getEdges(), in the same order as neighbours(node)
+        [[nodiscard]] range_t edgeIndices(blt::size_t node) const
+        {
+            return {edge_indices.data() + offsets[node], edge_indices.data() + offsets[node + 1]};
+        }
+        
+        [[nodiscard]] const std::vector<edge_t>& getEdges() const
+        {
+            return edges;
+        }
+    
+    private:
+        std::vector<blt::u32> offsets;
+        std::vector<blt::u32> neighbour_list;
+        std::vector<blt::u32> edge_indices;
+        std::vector<edge_t> edges;
+};
+
+#endif //GRAPHS_ADJACENCY_H
@@ -0,0 +1,159 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAPHS_BARNES_HUT_H
+#define GRAPHS_BARNES_HUT_H
+
+#include <vector>
+#include <blt/std/types.h>
+#include <blt/math/vectors.h>
+#include <graph_base.h>
+#include <force_algorithms.h>
+
+/**
+ * Quadtree used to approximate the repulsive forces in O(n log n).
+ *
+ * The tree is stored flat: the four children of a cell are allocated next to each other and leaves reference a range of the
+ * index array, which is partitioned in place while building. Every cell stores the center of mass, average repulsiveness and total
+ * mass of the nodes below it, so a far away cell can be treated as a single particle by the force equation
+ */
+class barnes_hut_t
+{
+    public:
+        // past this depth nodes are left in the same leaf, stops nodes on top of each other from splitting forever.
+        static constexpr blt::u32 MAX_DEPTH = 32;
+        // number of particles collected before they are sent through force_equation::rep_block
+        static constexpr blt::size_t INTERACTION_BLOCK = 64;
+        
+        void build(const node_state_t& nodes);
+        
+        /**
+         * @param index index of the node inside the node list used to build the tree. The node will not repel itself
+         * @param theta opening angle. cells with size / distance < theta are approximated, 0 will always descend to the leaves
+         * @return the total repulsive force acting on node
+         */
+        template<typename EQUATION>
+        [[nodiscard]] blt::vec2 repulsion(const EQUATION& equation, blt::size_t index, const particle_t& node, float theta) const;
+        
+        void clear()
+        {
+            cells.clear();
+            indices.clear();
+            positions.clear();
+            repulsiveness.clear();
+            mass.clear();
+        }
+    
+    private:
+        struct cell_t
+        {
+            blt::vec2 min;
+            float size = 0;
+            blt::vec2 center;
+            float repulsiveness = 0;
+            float mass = 0;
+            blt::u32 count = 0;
+            // 0 if this cell is a leaf, the root can never be a child.
+            blt::u32 first_child = 0;
+            // range of indices contained by this cell
+            blt::u32 begin = 0, end = 0;
+            
+            [[nodiscard]] bool contains(const blt::vec2& pos) const
+            {
+                return pos.x() >= min.x() && pos.y() >= min.y() && pos.x() <= min.x() + size && pos.y() <= min.y() + size;
+            }
+        };
+        
+        void build_cell(blt::u32 cell, blt::u32 begin, blt::u32 end, const blt::vec2& min, float size, blt::u32 depth);
+        
+        std::vector<cell_t> cells;
+        std::vector<blt::u32> indices;
+        // copied out of the node state so the partitioning doesn't move the nodes themselves
+        std::vector<blt::vec2> positions;
+        std::vector<float> repulsiveness;
+        std::vector<float> mass;
+};
+
+// defined here so it is compiled for the concrete equation type of the step calling it, see simulation_t::step_with()
+template<typename EQUATION>
+blt::vec2 barnes_hut_t::repulsion(const EQUATION& equation, blt::size_t index, const particle_t& node, float theta) const
+{
+    blt::vec2 force;
+    if (cells.empty())
+        return force;
+    
+    const auto& pos = node.pos;
+    const float theta_sq = theta * theta;
+    
+    // every level pops one cell and pushes at most four.
+    blt::u32 stack[MAX_DEPTH * 3 + 1];
+    blt::size_t stack_size = 0;
+    stack[stack_size++] = 0;
+    
+    // the particles acting on the node are gathered up and handed to the equation a block at a time
+    float block_x[INTERACTION_BLOCK], block_y[INTERACTION_BLOCK], block_rep[INTERACTION_BLOCK], block_mass[INTERACTION_BLOCK];
+    blt::size_t count = 0;
+    const auto push = [&](const blt::vec2& p, float r, float m) {
+        block_x[count] = p.x();
+        block_y[count] = p.y();
+        block_rep[count] = r;
+        block_mass[count] = m;
+        if (++count == INTERACTION_BLOCK)
+        {
+            force += equation.rep_block(node, {block_x, block_y, block_rep, block_mass, count});
+            count = 0;
+        }
+    };
+    
+    while (stack_size > 0)
+    {
+        const auto& cell = cells[stack[--stack_size]];
+        if (cell.count == 0)
+            continue;
+        
+        if (cell.first_child == 0)
+        {
+            for (blt::u32 i = cell.begin; i < cell.end; i++)
+            {
+                const auto other = indices[i];
+                if (other == index)
+                    continue;
+                push(positions[other], repulsiveness[other], mass[other]);
+            }
+            continue;
+        }
+        
+        // a node can never be approximated by a cell containing itself, it would end up repelling itself.
+        const auto dir = cell.center - pos;
+        const auto dist_sq = dir.x() * dir.x() + dir.y() * dir.y();
+        if (!cell.contains(pos) && cell.size * cell.size < theta_sq * dist_sq)
+        {
+            push(cell.center, cell.repulsiveness, cell.mass);
+            continue;
+        }
+        
+        for (blt::u32 i = 0; i < 4; i++)
+            stack[stack_size++] = cell.first_child + i;
+    }
+    
+    if (count > 0)
+        force += equation.rep_block(node, {block_x, block_y, block_rep, block_mass, count});
+    return force;
+}
+
+#endif //GRAPHS_BARNES_HUT_H
@@ -28,6 +28,46 @@ namespace conf
     inline constexpr float DEFAULT_MIN_COOLING = 40;
     inline constexpr float DEFAULT_SPRING_LENGTH = 175.0;
     inline constexpr float DEFAULT_INITIAL_TEMPERATURE = 100;
+    inline constexpr float DEFAULT_REPULSIVENESS = 24.0f;
+    // past this nodes stop repelling each other in the cutoff repulsion mode
+    inline constexpr float DEFAULT_CUTOFF_RADIUS = DEFAULT_SPRING_LENGTH * 4;
+    // nodes handed to a worker thread at a time
+    inline constexpr blt::size_t FORCE_CHUNK_SIZE = 64;
+    // seconds simulated by every step of the background simulation thread
+    inline constexpr float FIXED_TIMESTEP = 1.0f / 60.0f;
+    // milliseconds the multilevel layout runs for before new positions are shown, per frame when there's no simulation thread
+    inline constexpr double MULTILEVEL_SLICE_MS = 12;
+    // events kept by the frame profiler, about a few thousand frames worth
+    inline constexpr blt::size_t PROFILER_CAPACITY = 1 << 16;
+    // seconds between the journal writing out what has been recorded
+    inline constexpr float JOURNAL_FLUSH_INTERVAL = 0.5f;
+    // records the journal can hold before it is compacted into a new snapshot
+    inline constexpr blt::size_t JOURNAL_COMPACT_RECORDS = 4096;
+    // seconds an edit can sit in the journal before the graph is saved again
+    inline constexpr float AUTOSAVE_INTERVAL = 60.0f;
+    // every texture is scaled to a square cell of this many pixels, ATLAS_PAGE_SIZE has to be a multiple of it. at 128 the
+    // ATLAS_MAX_PAGES pages fit 2048 textures, 256 would only fit 512
+    inline constexpr blt::size_t ATLAS_CELL_SIZE = 128;
+    inline constexpr blt::size_t ATLAS_PAGE_SIZE = 2048;
+    // every page is bound at once when drawing the nodes (with the two position textures that is the 10 of the 16 texture units gl
+    // guarantees), textures past the last page keep showing the placeholder
+    inline constexpr blt::size_t ATLAS_MAX_PAGES = 8;
+    // decoded textures copied into the atlas per frame, keeps a burst of newly visible nodes from stalling a frame
+    inline constexpr blt::size_t ATLAS_UPLOADS_PER_FRAME = 16;
+    inline constexpr blt::size_t TEXTURE_LOADER_THREADS = 2;
+    // average nodes per cell of the grid used to cull against the view, and the most cells along either side
+    inline constexpr float VIEW_GRID_NODES_PER_CELL = 4;
+    inline constexpr float VIEW_GRID_MAX_CELLS = 1024;
+    // edges covering more cells than this are checked against the view one by one instead
+    inline constexpr blt::size_t VIEW_GRID_MAX_EDGE_CELLS = 64;
+    // nodes smaller than this many pixels on screen are drawn as a flat circle, at most one per LOD_CELL_PIXELS square. their texture
+    // isn't loaded until they get bigger
+    inline constexpr float LOD_NODE_PIXELS = 6;
+    inline constexpr float LOD_CELL_PIXELS = 2;
+    // once nodes are that small only one edge is drawn between any two LOD_EDGE_CELL_PIXELS squares
+    inline constexpr float LOD_EDGE_CELL_PIXELS = 4;
+    // width of the float textures node positions are uploaded into for the graph renderer
+    inline constexpr blt::size_t POSITION_TEXTURE_WIDTH = 1024;
     
     inline constexpr float POINT_SIZE = 75;
     inline constexpr float OUTLINE_SCALE = 1.25f;
@@ -35,6 +75,8 @@ namespace conf
     inline constexpr auto POINT_OUTLINE_COLOR = blt::make_color(0, 0.6, 0.6);
     inline constexpr auto POINT_HIGHLIGHT_COLOR = blt::make_color(0, 1.0, 1.0);
     inline constexpr auto POINT_SELECT_COLOR = blt::make_color(0, 0.9, 0.7);
+    // ring drawn behind nodes picked with a box / lasso, relative to the node's outline
+    inline constexpr float SELECTION_RING_SCALE = 1.3f;
     
     inline constexpr float DEFAULT_THICKNESS = 2.0f;
     inline constexpr auto EDGE_COLOR = blt::make_color(0, 0.8, 0);
@@ -43,6 +85,9 @@ namespace conf
 
 class graph_t;
 class selector_t;
+class journal_t;
+class save_thread_t;
+struct save_result_t;
 struct loader_t;
 
 #endif //GRAPHS_CONFIG_H
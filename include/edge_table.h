@@ -0,0 +1,134 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_EDGE_TABLE_H
+#define GRAPHS_EDGE_TABLE_H
+
+#include <vector>
+#include <blt/std/types.h>
+#include <graph_base.h>
+
+/**
+ * Set of edges keyed by edge_key(), the same edge whichever way around its nodes are given.
+ *
+ * Keys live in a flat open addressing table (linear probing, kept at most half full) which only points into a dense list of the
+ * edges themselves, so probing never touches the edge attributes and walking the edges is a walk over a plain array. Removing an
+ * edge moves the last edge of the list into its place, the order of the edges is not stable.
+ *
+ * Edges returned by find() can be changed in place, anything but the nodes of an edge isn't part of its key.
+ */
+class edge_table_t
+{
+    public:
+        [[nodiscard]] edge_t* find(const blt::u64 n1, const blt::u64 n2)
+        {
+            if (slots.empty())
+                return nullptr;
+            const auto& slot = slots[find_slot(edge_key(n1, n2))];
+            return slot.key == EMPTY ? nullptr : &edge_list[slot.index];
+        }
+        
+        [[nodiscard]] const edge_t* find(const blt::u64 n1, const blt::u64 n2) const
+        {
+            return const_cast<edge_table_t*>(this)->find(n1, n2);
+        }
+        
+        [[nodiscard]] bool contains(const blt::u64 n1, const blt::u64 n2) const
+        {
+            return find(n1, n2) != nullptr;
+        }
+        
+        /**
+         * @return false if there already is an edge between the two nodes, which is kept as it is
+         */
+        bool insert(edge_t edge);
+        
+        /**
+         * @return false if there is no edge between the two nodes
+         */
+        bool erase(blt::u64 n1, blt::u64 n2);
+        
+        void reserve(blt::size_t count);
+        
+        void clear()
+        {
+            slots.clear();
+            edge_list.clear();
+        }
+        
+        [[nodiscard]] blt::size_t size() const
+        {
+            return edge_list.size();
+        }
+        
+        [[nodiscard]] bool empty() const
+        {
+            return edge_list.empty();
+        }
+        
+        [[nodiscard]] auto begin() const
+        {
+            return edge_list.begin();
+        }
+        
+        [[nodiscard]] auto end() const
+        {
+            return edge_list.end();
+        }
+    
+    private:
+        struct slot_t
+        {
+            blt::u64 key;
+            blt::u64 index;
+        };
+        
+        // never a valid key, both halves would have to be the same node
+        static constexpr blt::u64 EMPTY = ~0ull;
+        static constexpr blt::size_t MIN_SLOTS = 16;
+        
+        // murmur3's 64 bit finalizer, every bit of both nodes ends up affecting the low bits used to pick a slot
+        static blt::u64 hash(blt::u64 key)
+        {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdull;
+            key ^= key >> 33;
+            key *= 0xc4ceb9fe1a85ec53ull;
+            key ^= key >> 33;
+            return key;
+        }
+        
+        // slot holding key, or the empty slot it would go in
+        [[nodiscard]] blt::size_t find_slot(const blt::u64 key) const
+        {
+            const auto mask = slots.size() - 1;
+            auto slot = hash(key) & mask;
+            while (slots[slot].key != key && slots[slot].key != EMPTY)
+                slot = (slot + 1) & mask;
+            return slot;
+        }
+        
+        // capacity has to be a power of two
+        void rehash(blt::size_t capacity);
+        
+        std::vector<slot_t> slots;
+        std::vector<edge_t> edge_list;
+};
+
+#endif //GRAPHS_EDGE_TABLE_H
@@ -19,17 +19,30 @@
 #ifndef GRAPHS_FORCE_ALGORITHMS_H
 #define GRAPHS_FORCE_ALGORITHMS_H
 
+#include <cmath>
 #include <string>
+#include <memory>
 #include <blt/std/types.h>
 #include <blt/math/vectors.h>
-#include <imgui.h>
+#include <blt/std/utility.h>
+#ifndef GRAPHS_HEADLESS
+    #include <imgui.h>
+#endif
 #include <graph_base.h>
 #include <config.h>
 
+/**
+ * Function for mixing between two points
+ */
+BLT_ATTRIB_NO_SIDE_EFFECTS inline float mix(const float v1, const float v2)
+{
+    return (v1 + v2) / 2.0f;
+}
+
 class force_equation
 {
     public:
-        using node_pair = const std::pair<blt::size_t, node_t>&;
+        using node_pair = const particle_t&;
     protected:
         float cooling_rate = conf::DEFAULT_COOLING_FACTOR;
         float min_cooling = conf::DEFAULT_MIN_COOLING;
@@ -46,28 +59,51 @@ class force_equation
         
         inline static blt::vec2 dir_v(node_pair v1, node_pair v2)
         {
-            return v2.second.getPosition() - v1.second.getPosition();
+            return v2.pos - v1.pos;
         }
         
-        static equation_data calc_data(node_pair v1, node_pair v2);
+        static equation_data calc_data(node_pair v1, node_pair v2)
+        {
+            auto dir = dir_v(v1, v2);
+            auto mag = dir.magnitude();
+            auto unit = mag == 0 ? blt::vec2() : dir / mag;
+            return {unit, -unit, mag, mag * mag};
+        }
     
     public:
         
         [[nodiscard]] virtual blt::vec2 attr(node_pair v1, node_pair v2, const edge_t& edge) const = 0;
         
+        /**
+         * Repulsive force acting on v1 from v2. v2 can stand in for a whole group of nodes (Barnes-Hut), so the force scales with its mass.
+         */
         [[nodiscard]] virtual blt::vec2 rep(node_pair v1, node_pair v2) const = 0;
         
+        /**
+         * Total repulsive force acting on v1 from every particle in the block. Particles on top of v1 (v1 itself included) are skipped.
+         * The default calls rep() once per particle, equations with a vectorized kernel should override this.
+         */
+        [[nodiscard]] virtual blt::vec2 rep_block(node_pair v1, const particle_block_t& block) const;
+        
         [[nodiscard]] virtual std::string name() const = 0;
         
+        // used to hand a copy of the equation and its settings to the simulation thread
+        [[nodiscard]] virtual std::unique_ptr<force_equation> clone() const = 0;
+        
         [[nodiscard]] virtual float cooling_factor(int t) const
         {
             return std::max(static_cast<float>(initial_temperature * std::pow(cooling_rate, t)), min_cooling);
         }
         
-        void draw_inputs_base();
+#ifndef GRAPHS_HEADLESS
+        // both return true if anything was changed
+        bool draw_inputs_base();
         
-        virtual void draw_inputs()
-        {}
+        virtual bool draw_inputs()
+        {
+            return false;
+        }
+#endif
         
         virtual ~force_equation() = default;
 };
@@ -77,26 +113,63 @@ class Eades_equation : public force_equation
     protected:
         float spring_constant = 12.0;
     public:
-        [[nodiscard]] blt::vec2 attr(node_pair v1, node_pair v2, const edge_t& edge) const final;
+        // the per pair functions are defined here so the step, tree and grid, which are templated on the equation, can inline them
+        [[nodiscard]] blt::vec2 attr(node_pair v1, node_pair v2, const edge_t& edge) const final
+        {
+            auto data = calc_data(v1, v2);
+            return (spring_constant * std::log(data.mag / edge.ideal_spring_length) * data.unit) - rep(v1, v2);
+        }
         
-        [[nodiscard]] blt::vec2 rep(node_pair v1, node_pair v2) const final;
+        [[nodiscard]] blt::vec2 rep(node_pair v1, node_pair v2) const final
+        {
+            auto data = calc_data(v1, v2);
+            if (data.mag == 0)
+                return {};
+            // scaling factor included because of the scales this algorithm is working on (large viewport)
+            auto scale = (mix(v1.repulsiveness, v2.repulsiveness) * 10000 * v2.mass) / data.mag_sq;
+            return scale * data.unit_inv;
+        }
+        
+        [[nodiscard]] blt::vec2 rep_block(node_pair v1, const particle_block_t& block) const final;
         
         [[nodiscard]] std::string name() const final
         {
             return "Eades";
         }
         
-        void draw_inputs() override;
+        [[nodiscard]] std::unique_ptr<force_equation> clone() const final
+        {
+            return std::make_unique<Eades_equation>(*this);
+        }
+        
+#ifndef GRAPHS_HEADLESS
+        bool draw_inputs() override;
+#endif
 };
 
 class Fruchterman_Reingold_equation : public force_equation
 {
     public:
-        [[nodiscard]] blt::vec2 attr(node_pair v1, node_pair v2, const edge_t& edge) const final;
+        [[nodiscard]] blt::vec2 attr(node_pair v1, node_pair v2, const edge_t& edge) const final
+        {
+            auto data = calc_data(v1, v2);
+            float scale = data.mag_sq / edge.ideal_spring_length;
+            return (scale * data.unit);
+        }
         
-        [[nodiscard]] blt::vec2 rep(node_pair v1, node_pair v2) const final;
+        [[nodiscard]] blt::vec2 rep(node_pair v1, node_pair v2) const final
+        {
+            auto data = calc_data(v1, v2);
+            if (data.mag == 0)
+                return {};
+            const auto ideal_spring_length = conf::DEFAULT_SPRING_LENGTH;
+            float scale = (ideal_spring_length * ideal_spring_length * v2.mass) / data.mag;
+            return scale * data.unit_inv;
+        }
+        
+        [[nodiscard]] blt::vec2 rep_block(node_pair v1, const particle_block_t& block) const final;
         
-        [[nodiscard]] float cooling_factor(int t) const override
+        [[nodiscard]] float cooling_factor(int t) const final
         {
             return force_equation::cooling_factor(t) * 0.025f;
         }
@@ -105,6 +178,11 @@ class Fruchterman_Reingold_equation : public force_equation
         {
             return "Fruchterman & Reingold";
         }
+        
+        [[nodiscard]] std::unique_ptr<force_equation> clone() const final
+        {
+            return std::make_unique<Fruchterman_Reingold_equation>(*this);
+        }
 };
 
 #endif //GRAPHS_FORCE_ALGORITHMS_H
@@ -0,0 +1,56 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAPHS_FORCE_KERNELS_H
+#define GRAPHS_FORCE_KERNELS_H
+
+#include <blt/std/types.h>
+#include <blt/math/vectors.h>
+#include <graph_base.h>
+
+/**
+ * Batched repulsion kernels, one particle against a whole block of others.
+ *
+ * Each kernel is compiled for AVX-512, AVX2 and SSE next to a plain scalar version, the widest one the cpu supports is picked while
+ * the program starts up (static initialization). Particles sharing the position of v1 (including v1 itself) contribute nothing,
+ * same as force_equation::rep.
+ */
+namespace kernels
+{
+    enum class simd_level_t
+    {
+        SCALAR,
+        SSE,
+        AVX2,
+        AVX512
+    };
+    
+    // the instruction set the kernels are running with on this machine
+    simd_level_t getSimdLevel();
+    
+    const char* getSimdLevelName();
+    
+    // forces the kernels down to level, anything the cpu doesn't support falls back to the best level it does
+    void setSimdLevel(simd_level_t level);
+    
+    blt::vec2 eades_rep_block(const particle_t& v1, const particle_block_t& block);
+    
+    blt::vec2 fruchterman_reingold_rep_block(const particle_t& v1, const particle_block_t& block, float ideal_spring_length);
+}
+
+#endif //GRAPHS_FORCE_KERNELS_H
@@ -0,0 +1,159 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_GENERATORS_H
+#define GRAPHS_GENERATORS_H
+
+#include <blt/std/types.h>
+#include <graph_base.h>
+
+class graph_t;
+
+struct bounding_box
+{
+    int min_x = 0;
+    int min_y = 0;
+    int max_x = 0;
+    int max_y = 0;
+    
+    bounding_box(const int min_x, const int min_y, const int max_x, const int max_y): min_x(min_x), min_y(min_y), max_x(max_x), max_y(max_y)
+    {
+    }
+    
+    bool is_screen = true;
+};
+
+/**
+ * xoshiro256** seeded through splitmix64. Several times faster than std::mt19937_64 with a far smaller state, and works with the std
+ * distributions.
+ */
+class random_t
+{
+    public:
+        using result_type = blt::u64;
+        
+        explicit random_t(const blt::u64 seed = 0)
+        {
+            this->seed(seed);
+        }
+        
+        void seed(blt::u64 seed)
+        {
+            for (auto& s : state)
+            {
+                seed += 0x9e3779b97f4a7c15ull;
+                auto z = seed;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                s = z ^ (z >> 31);
+            }
+        }
+        
+        static constexpr result_type min()
+        {
+            return 0;
+        }
+        
+        static constexpr result_type max()
+        {
+            return ~0ull;
+        }
+        
+        result_type operator()()
+        {
+            const auto result = rotl(state[1] * 5, 7) * 9;
+            const auto t = state[1] << 17;
+            state[2] ^= state[0];
+            state[3] ^= state[1];
+            state[1] ^= state[2];
+            state[0] ^= state[3];
+            state[2] ^= t;
+            state[3] = rotl(state[3], 45);
+            return result;
+        }
+        
+        // [0, 1)
+        double uniform()
+        {
+            return static_cast<double>((*this)() >> 11) * 0x1.0p-53;
+        }
+        
+        // [0, bound), Lemire's multiply-shift with rejection. unbiased, and the division is only needed in the rare case a draw
+        // lands in the biased range
+        blt::u64 below(const blt::u64 bound)
+        {
+            auto product = static_cast<unsigned __int128>((*this)()) * bound;
+            auto low = static_cast<blt::u64>(product);
+            if (low < bound)
+            {
+                const auto threshold = (0 - bound) % bound;
+                while (low < threshold)
+                {
+                    product = static_cast<unsigned __int128>((*this)()) * bound;
+                    low = static_cast<blt::u64>(product);
+                }
+            }
+            return static_cast<blt::u64>(product >> 64);
+        }
+    
+    private:
+        static blt::u64 rotl(const blt::u64 x, const int k)
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+        
+        blt::u64 state[4]{};
+};
+
+enum class graph_model_t
+{
+    // Erdős–Rényi G(n, p), every pair of nodes is connected with the same probability
+    RANDOM,
+    // Barabási–Albert, every new node attaches to existing nodes with a chance proportional to their degree. scale free, a few hubs
+    PREFERENTIAL_ATTACHMENT,
+    // random geometric, nodes are connected to every node within a radius of them
+    GEOMETRIC
+};
+
+struct generator_settings_t
+{
+    graph_model_t model = graph_model_t::GEOMETRIC;
+    int node_count = 25;
+    // every model is tuned to give about this many edges per node
+    float average_degree = 4;
+    // 0 picks a new seed every time
+    blt::u64 seed = 0;
+};
+
+struct generator_result_t
+{
+    blt::size_t nodes = 0;
+    blt::size_t edges = 0;
+    double milliseconds = 0;
+};
+
+/**
+ * Adds a random graph to the graph, with the nodes spread out over bb.
+ *
+ * Nodes are placed one per cell of a grid with about as many cells as nodes, jittered inside their cell. Placement is O(n) and
+ * always finishes no matter how crowded bb is. Every model then adds its edges in O(n + m) and hands them to a single graph_batch_t.
+ */
+generator_result_t generate_graph(graph_t& graph, const generator_settings_t& settings, bounding_box bb);
+
+#endif //GRAPHS_GENERATORS_H
@@ -21,26 +21,99 @@
 
 #include <config.h>
 #include <graph_base.h>
-#include <selection.h>
 #include <force_algorithms.h>
-#include <blt/gfx/window.h>
+#include <adjacency.h>
+#include <edge_table.h>
+#include <simulation.h>
+#include <multilevel.h>
+#include <profiler.h>
+#include <journal.h>
+#include <view_grid.h>
+#include <generators.h>
 #include <blt/math/interpolation.h>
 #include <blt/std/utility.h>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <utility>
+#ifndef GRAPHS_HEADLESS
+    #include <selection.h>
+    #include <blt/gfx/window.h>
 
 namespace im = ImGui;
+#endif
 
-struct bounding_box
+class graph_t;
+
+/**
+ * Collects changes to a graph so they can be applied all at once, for anything adding more than a handful of nodes or edges.
+ *
+ * Nothing is applied until commit(), except added nodes which go in straight away so their index and name can be used by the rest
+ * of the batch. Edge indices (and the nodes to remove) refer to the graph as it is before any node is removed. On commit edges are
+ * removed first, then added in one pass with everything reserved up front, then nodes are removed. The graph is only
+ * invalidated once at the end, so the adjacency and everything depending on it is rebuilt once for the whole batch.
+ * Anything not committed is dropped.
+ */
+class graph_batch_t
 {
-    int min_x = 0;
-    int min_y = 0;
-    int max_x = 0;
-    int max_y = 0;
-    
-    bounding_box(const int min_x, const int min_y, const int max_x, const int max_y): min_x(min_x), min_y(min_y), max_x(max_x), max_y(max_y)
-    {
-    }
+    public:
+        explicit graph_batch_t(graph_t& graph): graph(graph)
+        {}
+        
+        graph_batch_t(const graph_batch_t&) = delete;
+        
+        graph_batch_t& operator=(const graph_batch_t&) = delete;
+        
+        // sizes the graph and the batch for this many more nodes and edges
+        void reserve(blt::size_t node_count, blt::size_t edge_count);
+        
+        /**
+         * @return index of the new node
+         */
+        blt::u64 add_node(const blt::vec2& pos, node_t node);
+        
+        void remove_node(const blt::u64 node)
+        {
+            removed_nodes.push_back(node);
+        }
+        
+        void connect(const blt::u64 n1, const blt::u64 n2)
+        {
+            added_edges.push_back({n1, n2, NO_DATA});
+        }
+        
+        // an edge which is already in the graph (or the batch) is kept as it is, the same as graph_t::connect()
+        void connect(edge_t edge)
+        {
+            added_edges.push_back({edge.getFirst(), edge.getSecond(), edge_data.size()});
+            edge_data.push_back(std::move(edge));
+        }
+        
+        void disconnect(const blt::u64 n1, const blt::u64 n2)
+        {
+            removed_edges.emplace_back(n1, n2);
+        }
+        
+        void commit();
     
-    bool is_screen = true;
+    private:
+        static constexpr blt::u64 NO_DATA = std::numeric_limits<blt::u64>::max();
+        
+        // most edges only ever get their ends, a full edge_t is only kept for the ones which don't look like the default
+        struct added_edge_t
+        {
+            blt::u64 first, second;
+            // index into edge_data, or NO_DATA for a default edge
+            blt::u64 data;
+        };
+        
+        graph_t& graph;
+        std::vector<added_edge_t> added_edges;
+        std::vector<edge_t> edge_data;
+        std::vector<std::pair<blt::u64, blt::u64>> removed_edges;
+        std::vector<blt::u64> removed_nodes;
+        bool nodes_added = false;
 };
 
 class graph_t
@@ -48,184 +121,576 @@ class graph_t
         friend struct loader_t;
         
         friend class selector_t;
+        
+        friend class journal_t;
+        
+        friend class graph_batch_t;
     
     private:
+        // render / editor data of every node
         std::vector<node_t> nodes;
+        // positions and everything else the force simulation touches, indexed the same as nodes
+        node_state_t node_state;
+        // looked up through getNames(), which adds the names of any nodes added since it was last used. a million generated nodes
+        // shouldn't have to be hashed by name before anything asks for one
         blt::hashmap_t<std::string, blt::u64> names_to_node;
-        blt::hashset_t<edge_t, edge_hash, edge_eq> edges;
-        blt::hashmap_t<blt::u64, blt::hashset_t<blt::u64>> connected_nodes;
-        bool sim = false;
-        bool run_infinitely = true;
-        float sim_speed = 1;
-        float threshold = 0;
-        float max_force_last = 1;
-        int current_iterations = 0;
-        int max_iterations = 5000;
-        std::unique_ptr<force_equation> equation;
-        
-        void create_random_graph(bounding_box bb, blt::size_t min_nodes, blt::size_t max_nodes, blt::f64 connectivity,
-                                 blt::f64 scaling_connectivity, blt::f64 distance_factor);
-    
-    public:
-        graph_t()
-        {
-            use_Eades();
-        }
+        // nodes [0, named_nodes) are in names_to_node
+        blt::size_t named_nodes = 0;
+        edge_table_t edges;
+        // neighbours of every node, indexed the same as nodes. a plain list, nodes only have a handful of neighbours
+        std::vector<std::vector<blt::u64>> connected_nodes;
+        adjacency_t adjacency;
+        bool adjacency_dirty = true;
+        // incremented every time the nodes or edges change, used to match up positions from the simulation thread
+        blt::u64 topology_version = 1;
+        // incremented by invalidate_nodes() as well, anything on a node but its position changed
+        blt::u64 nodes_version = 1;
+        // the nodes and edges handed to the last save. they stay shared with the save thread while it writes them, and are handed out
+        // again by the next save as long as the versions they were copied at are still current
+        std::shared_ptr<const std::vector<node_t>> saved_nodes;
+        blt::u64 saved_nodes_version = 0;
+        std::shared_ptr<const std::vector<edge_t>> saved_edges;
+        blt::u64 saved_edges_version = 0;
+        // finds the nodes in an area, the view for render() and the mouse / selection for the editor. caught up with the positions
+        // by update_view_grid() the first time it is needed after anything moved
+        view_grid_t view_grid;
+        bool view_grid_dirty = true;
+        // edges are binned as well, the grid can only be caught up with while the topology it was built with is current
+        blt::u64 view_grid_version = 0;
+        // largest node radius, how far from a point a node's center can be and still have its circle reach it
+        float max_node_scale = 0;
+        bool max_node_scale_dirty = true;
+        // what render() has to upload again
+        bool positions_dirty = true;
+        bool nodes_dirty = true;
+        blt::u64 uploaded_edges_version = 0;
+        blt::u64 uploaded_atlas_generation = 0;
+        // largest node with its outline, how far past the view a node can be and still show up
+        float max_node_size = 0;
+        // what was last handed to the graph renderer to draw, only worked out again once something was uploaded or the view moved
+        std::vector<blt::u32> visible_nodes;
+        std::vector<blt::u32> visible_edges;
+        view_rect_t culled_view;
+        bool visible_dirty = true;
+        lod_filter_t node_lod;
+        lod_filter_t edge_lod;
         
-        void make_new(const bounding_box& bb, const blt::size_t min_nodes, const blt::size_t max_nodes, const blt::f64 connectivity)
+        // holds the settings edited by the gui, also runs the simulation when not running in the background
+        simulation_t simulation;
+        simulation_thread_t background;
+#ifdef __EMSCRIPTEN__
+        bool run_in_background = false;
+#else
+        bool run_in_background = true;
+#endif
+        multilevel_settings_t multilevel_settings;
+        // multilevel layout run by advance_layout() when there is no simulation thread, and the topology version it was started on
+        std::optional<multilevel_layout_t> layout;
+        blt::u64 layout_version = 0;
+        float layout_progress = -1;
+        // bumped by every run_multilevel_layout(), snapshots from before the simulation thread picked the layout up don't report on it
+        blt::u64 layout_request = 0;
+        generator_settings_t generator_settings;
+        // last topology version sent to the simulation thread
+        blt::u64 synced_version = 0;
+        // bumped by invalidate_settings(), the settings and equation are only sent to the simulation thread when it changes
+        blt::u64 settings_version = 1;
+        blt::u64 synced_settings_version = 0;
+        // bumped by every move_node(), snapshots the simulation thread took before the last move would put the node back
+        blt::u64 moved_version = 0;
+        float steps_per_second = 0;
+        
+        // remove_node() without invalidating anything
+        void erase_node(blt::u64 node);
+        
+        // removes other from the neighbours of node
+        void unlink(blt::u64 node, blt::u64 other);
+        
+        // the lookup from node names to their index, caught up with the nodes added since it was last used
+        blt::hashmap_t<std::string, blt::u64>& getNames()
         {
-            create_random_graph(bb, min_nodes, max_nodes, connectivity, 0, 25);
+            if (named_nodes < nodes.size())
+            {
+                names_to_node.reserve(nodes.size());
+                for (; named_nodes < nodes.size(); named_nodes++)
+                    names_to_node.insert({nodes[named_nodes].name, named_nodes});
+            }
+            return names_to_node;
         }
         
-        void reset(const bounding_box& bb, const blt::size_t min_nodes, const blt::size_t max_nodes, const blt::f64 connectivity,
-                   const blt::f64 scaling_connectivity, const blt::f64 distance_factor)
+        // catches the view grid up with anything that moved, changed size or was added / removed since it was last used
+        void update_view_grid();
+
+#ifndef GRAPHS_HEADLESS
+        // works out which nodes and edges are visible in view and hands them to the graph renderer
+        void cull(const view_rect_t& view);
+#endif
+    
+    public:
+        graph_t() = default;
+        
+        /**
+         * Replaces the graph with a random one made from the generator settings, spread out over bb.
+         */
+        generator_result_t generate(const bounding_box& bb)
         {
             clear();
-            create_random_graph(bb, min_nodes, max_nodes, connectivity, scaling_connectivity, distance_factor);
+            return generate_graph(*this, generator_settings, bb);
         }
         
         void clear()
         {
-            sim = false;
-            current_iterations = 0;
-            max_force_last = 1.0;
+            simulation.settings.sim = false;
+            invalidate_settings();
+            simulation.current_iterations = 0;
+            simulation.max_force_last = 1.0;
             nodes.clear();
+            node_state.clear();
             edges.clear();
             connected_nodes.clear();
             names_to_node.clear();
+            named_nodes = 0;
+            invalidate_adjacency();
+        }
+        
+        /**
+         * Adds a node at pos, keeping the simulation state and the name lookup in line with the node list.
+         * @return index of the new node
+         */
+        blt::u64 add_node(const blt::vec2& pos, node_t node)
+        {
+            const auto index = nodes.size();
+            nodes.push_back(std::move(node));
+            node_state.push_back(pos);
+            connected_nodes.emplace_back();
+            invalidate_adjacency();
+            return index;
         }
         
+        /**
+         * Removes a node and every edge touching it. The last node is moved into its index, so only the edges of those two nodes
+         * are touched and every other index stays the same.
+         */
+        void remove_node(blt::u64 node)
+        {
+            erase_node(node);
+            invalidate_adjacency();
+        }
+        
+        /**
+         * Starts collecting changes which are applied together by graph_batch_t::commit().
+         */
+        graph_batch_t batch()
+        {
+            return graph_batch_t{*this};
+        }
+        
+        /**
+         * @return index of the first node whose circle contains pos, -1 if there isn't one
+         */
+        [[nodiscard]] blt::i64 node_at(const blt::vec2& pos);
+        
+        /**
+         * @return every node whose center is inside the rectangle with the two corners, in index order
+         */
+        [[nodiscard]] std::vector<blt::u64> nodes_in_rect(const blt::vec2& corner1, const blt::vec2& corner2);
+        
+        /**
+         * @return every node whose center is inside the polygon (even-odd rule, the last point connects back to the first), in
+         * index order
+         */
+        [[nodiscard]] std::vector<blt::u64> nodes_in_polygon(const std::vector<blt::vec2>& polygon);
+        
         void connect(const blt::u64 n1, const blt::u64 n2)
         {
-            connected_nodes[n1].insert(n2);
-            connected_nodes[n2].insert(n1);
-            edges.insert({n1, n2});
+            connect(edge_t{n1, n2});
         }
         
         void disconnect(const blt::u64 n1, const blt::u64 n2)
         {
-            connected_nodes[n1].erase(n2);
-            connected_nodes[n2].erase(n1);
-            edges.erase({n1, n2});
+            if (edges.erase(n1, n2))
+            {
+                unlink(n1, n2);
+                unlink(n2, n1);
+            }
+            invalidate_adjacency();
         }
         
         bool is_connected(const blt::u64 n1, const blt::u64 n2)
         {
-            return edges.contains({n1, n2});
+            return edges.contains(n1, n2);
         }
         
-        void connect(const edge_t& edge)
+        void connect(edge_t edge)
         {
-            connected_nodes[edge.getFirst()].insert(edge.getSecond());
-            connected_nodes[edge.getSecond()].insert(edge.getFirst());
-            edges.insert(edge);
+            const auto first = edge.getFirst();
+            const auto second = edge.getSecond();
+            if (edges.insert(std::move(edge)))
+            {
+                connected_nodes[first].push_back(second);
+                connected_nodes[second].push_back(first);
+            }
+            invalidate_adjacency();
         }
         
         [[nodiscard]] std::optional<blt::ref<const edge_t>> connected(blt::u64 n1, blt::u64 n2) const
         {
-            auto itr = edges.find(edge_t{n1, n2});
-            if (itr == edges.end())
+            const auto edge = edges.find(n1, n2);
+            if (!edge)
                 return {};
-            return *itr;
+            return *edge;
+        }
+        
+        /**
+         * Copies what a save needs out of the graph, so it can be written by a save_thread_t. Only the positions are copied every time,
+         * the nodes and edges are shared with the last copy unless they changed since.
+         */
+        [[nodiscard]] graph_copy_t copy_for_save()
+        {
+            if (!saved_nodes || saved_nodes_version != nodes_version)
+            {
+                saved_nodes = std::make_shared<const std::vector<node_t>>(nodes);
+                saved_nodes_version = nodes_version;
+            }
+            if (!saved_edges || saved_edges_version != topology_version)
+            {
+                // straight out of the edge table's flat list, the CSR snapshot doesn't have to be up to date for this
+                saved_edges = std::make_shared<const std::vector<edge_t>>(edges.begin(), edges.end());
+                saved_edges_version = topology_version;
+            }
+            return {saved_nodes, node_state, saved_edges};
+        }
+        
+        /**
+         * Marks the CSR snapshot as out of date, must be called after anything modifies the nodes or edges directly.
+         */
+        void invalidate_adjacency()
+        {
+            adjacency_dirty = true;
+            topology_version++;
+            nodes_version++;
+            positions_dirty = true;
+            nodes_dirty = true;
+            view_grid_dirty = true;
+            max_node_scale_dirty = true;
+        }
+        
+        /**
+         * Marks the simulation settings as changed, must be called after anything changes the settings or the equation through the
+         * getters so the simulation thread picks them up.
+         */
+        void invalidate_settings()
+        {
+            settings_version++;
+        }
+        
+        /**
+         * Marks the node positions as changed since they were last drawn, must be called after anything moves nodes directly.
+         */
+        void invalidate_positions()
+        {
+            positions_dirty = true;
+            view_grid_dirty = true;
+        }
+        
+        /**
+         * Marks the node data as changed since it was last drawn, must be called after anything changes how a node looks (size,
+         * color, texture) directly.
+         */
+        void invalidate_nodes()
+        {
+            nodes_dirty = true;
+            max_node_scale_dirty = true;
+            nodes_version++;
+        }
+        
+        const adjacency_t& getAdjacency()
+        {
+            if (adjacency_dirty || adjacency.nodeCount() != nodes.size())
+            {
+                adjacency.build(nodes.size(), edges);
+                adjacency_dirty = false;
+            }
+            return adjacency;
+        }
+        
+        /**
+         * Exchanges state with the simulation thread, has to be called every frame before anything reads or writes node positions.
+         * Picks up the newest positions published by the thread and sends it any settings or topology changes.
+         */
+        void sync();
+        
+#ifndef GRAPHS_HEADLESS
+        void render(profiler_t& profiler, const view_rect_t& view);
+#endif
+        
+        [[nodiscard]] bool should_step() const
+        {
+            return simulation.should_step();
         }
         
-        void render();
+        /**
+         * Runs a single step of the simulation on the calling thread, only valid while the simulation thread isn't running.
+         */
+        void step(float sim_factor)
+        {
+            simulation.step(node_state, getAdjacency(), sim_factor);
+            invalidate_positions();
+        }
+        
+        /**
+         * Moves a node, forwarding the move to the simulation thread if there is one.
+         */
+        void move_node(blt::u64 node, const blt::vec2& pos);
+        
+        /**
+         * Starts laying the whole graph out from scratch with the multilevel layout. Runs on the simulation thread if there is one,
+         * otherwise a slice of it is run by every advance_layout() in place of the simulation.
+         */
+        void run_multilevel_layout();
+        
+        /**
+         * Runs the multilevel layout started without a simulation thread for about max_milliseconds.
+         * @return true once there is no layout left to run
+         */
+        bool advance_layout(double max_milliseconds);
+        
+        // of the multilevel layout being run, from 0 to 1. negative when there is none
+        [[nodiscard]] float getLayoutProgress() const
+        {
+            return layout_progress;
+        }
+        
+        [[nodiscard]] multilevel_settings_t& getMultilevelSettings()
+        {
+            return multilevel_settings;
+        }
+        
+        [[nodiscard]] generator_settings_t& getGeneratorSettings()
+        {
+            return generator_settings;
+        }
         
         void use_Eades()
         {
-            equation = std::make_unique<Eades_equation>();
+            simulation.use_Eades();
+            invalidate_settings();
         }
         
         void use_Fruchterman_Reingold()
         {
-            equation = std::make_unique<Fruchterman_Reingold_equation>();
+            simulation.use_Fruchterman_Reingold();
+            invalidate_settings();
         }
         
+        /**
+         * Switches to one of the built in equations by name, matched against force_equation::name() ignoring case and anything which isn't a letter.
+         * @return false if there is no equation with that name, the current equation is kept
+         */
+        bool use_equation(std::string_view name);
+        
         void start_sim()
         {
-            sim = true;
+            simulation.settings.sim = true;
+            invalidate_settings();
         }
         
         void stop_sim()
         {
-            sim = false;
+            simulation.settings.sim = false;
+            invalidate_settings();
         }
         
         [[nodiscard]] std::string getSimulatorName() const
         {
-            return equation->name();
+            return simulation.getEquation().name();
         }
         
         [[nodiscard]] auto* getSimulator() const
         {
-            return equation.get();
+            return &simulation.getEquation();
         }
         
         [[nodiscard]] auto getCoolingFactor() const
         {
-            return equation->cooling_factor(current_iterations);
+            return simulation.getCoolingFactor();
         }
         
-        void reset_iterations()
-        {
-            current_iterations = 0;
-        }
+        void reset_iterations();
         
         [[nodiscard]] bool& getIterControl()
         {
-            return run_infinitely;
+            return simulation.settings.run_infinitely;
         }
         
         [[nodiscard]] float& getSimSpeed()
         {
-            return sim_speed;
+            return simulation.settings.sim_speed;
         }
         
         [[nodiscard]] float& getThreshold()
         {
-            return threshold;
+            return simulation.settings.threshold;
         }
         
         [[nodiscard]] int& getMaxIterations()
         {
-            return max_iterations;
+            return simulation.settings.max_iterations;
+        }
+        
+        [[nodiscard]] int& getThreadCount()
+        {
+            return simulation.settings.thread_count;
+        }
+        
+        [[nodiscard]] bool& getBackgroundControl()
+        {
+            return run_in_background;
+        }
+        
+        [[nodiscard]] float getStepsPerSecond() const
+        {
+            return steps_per_second;
+        }
+        
+        [[nodiscard]] int getCurrentIterations() const
+        {
+            return simulation.current_iterations;
+        }
+        
+        [[nodiscard]] float getMaxForce() const
+        {
+            return simulation.max_force_last;
+        }
+        
+        [[nodiscard]] const step_timings_t& getTimings() const
+        {
+            return simulation.timings;
+        }
+        
+        [[nodiscard]] float& getTheta()
+        {
+            return simulation.settings.theta;
+        }
+        
+        [[nodiscard]] float& getCutoffRadius()
+        {
+            return simulation.settings.cutoff_radius;
+        }
+        
+        [[nodiscard]] repulsion_mode_t getRepulsionMode() const
+        {
+            return simulation.settings.repulsion_mode;
+        }
+        
+        void setRepulsionMode(repulsion_mode_t mode)
+        {
+            simulation.settings.repulsion_mode = mode;
+            invalidate_settings();
+        }
+        
+        float measure_repulsion_error()
+        {
+            return simulation.measure_repulsion_error(node_state);
+        }
+        
+        [[nodiscard]] float getLastError() const
+        {
+            return simulation.last_error;
         }
         
         [[nodiscard]] int numberOfNodes() const
         {
             return static_cast<int>(nodes.size());
         }
+        
+        [[nodiscard]] blt::size_t numberOfEdges() const
+        {
+            return edges.size();
+        }
+        
+        // the node's data together with its position and velocity, which live in node_state
+        [[nodiscard]] node_ref_t getNode(blt::u64 index)
+        {
+            return {nodes[index], node_state, index};
+        }
 };
 
+#ifndef GRAPHS_HEADLESS
+
+// world space covered by a window of the given size with the current camera
+view_rect_t visible_area(blt::i32 width, blt::i32 height);
+
 class engine_t
 {
         friend struct loader_t;
     private:
         graph_t graph;
-        selector_t selector{graph};
+        journal_t journal;
+        selector_t selector{graph, journal};
+        profiler_t profiler;
+        bool save_requested = false;
         
         void draw_gui(const blt::gfx::window_data& data);
     
     public:
         void init(const blt::gfx::window_data& data)
         {
-            graph.make_new({0, 0, data.width, data.height}, 5, 25, 0.2);
+            graph.generate({0, 0, data.width, data.height});
         }
         
         void render(const blt::gfx::window_data& data)
         {
-            draw_gui(data);
+            {
+                profile_scope_t scope{profiler, "gui"};
+                draw_gui(data);
+            }
             
             auto& io = ImGui::GetIO();
             
-            if (!io.WantCaptureMouse)
-                selector.process_mouse(data.width, data.height);
-            if (!io.WantCaptureKeyboard)
-                selector.process_keyboard(data.width, data.height);
+            {
+                profile_scope_t scope{profiler, "sync"};
+                graph.sync();
+            }
+            
+            {
+                profile_scope_t scope{profiler, "selector input"};
+                if (!io.WantCaptureMouse)
+                    selector.process_mouse(data.width, data.height);
+                if (!io.WantCaptureKeyboard)
+                    selector.process_keyboard(data.width, data.height);
+            }
             
-            graph.render();
+            graph.render(profiler, visible_area(data.width, data.height));
+            
+            profile_scope_t scope{profiler, "selector render"};
             selector.render(data.width, data.height);
         }
+        
+        // queues what has to be drawn over the graph, after render() and the graph renderer
+        void render_overlay(const blt::gfx::window_data& data)
+        {
+            profile_scope_t scope{profiler, "selector overlay"};
+            selector.render_overlay(data.width, data.height);
+        }
+        
+        profiler_t& getProfiler()
+        {
+            return profiler;
+        }
+        
+        journal_t& getJournal()
+        {
+            return journal;
+        }
+        
+        // true once after the save button was pressed
+        bool consume_save_request()
+        {
+            return std::exchange(save_requested, false);
+        }
 };
 
+#endif
+
 #endif //GRAPHS_GRAPH_H
@@ -19,11 +19,20 @@
 #ifndef GRAPHS_GRAPH_BASE_H
 #define GRAPHS_GRAPH_BASE_H
 
-#include <blt/gfx/renderer/batch_2d_renderer.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <blt/math/vectors.h>
 #include <blt/std/types.h>
+#include <blt/std/hashmap.h>
 #include <blt/std/assert.h>
 #include <config.h>
 
+#ifndef GRAPHS_HEADLESS
+    #include <blt/gfx/renderer/batch_2d_renderer.h>
+#endif
+
 inline blt::size_t last_node = 0;
 
 inline std::string get_name()
@@ -31,52 +40,274 @@ inline std::string get_name()
     return "unnamed" + std::to_string(last_node++);
 }
 
+/**
+ * Cold per node data, everything the force simulation doesn't need. Indexed the same as node_state_t.
+ */
 struct node_t
 {
-    float repulsiveness = 24.0f;
     std::string name;
     std::string description;
     std::string texture = conf::DEFAULT_IMAGE;
     
-    blt::gfx::point2d_t point;
-    blt::vec2 velocity;
+    float scale = conf::POINT_SIZE;
     float outline_scale = conf::OUTLINE_SCALE;
     blt::color4 outline_color = conf::POINT_OUTLINE_COLOR;
     
-    explicit node_t(const blt::gfx::point2d_t& point): name(get_name()), point(point)
+    explicit node_t(float scale = conf::POINT_SIZE): name(get_name()), scale(scale)
     {}
     
-    explicit node_t(const blt::gfx::point2d_t& point, std::string name): name(std::move(name)), point(point)
+    explicit node_t(float scale, std::string name): name(std::move(name)), scale(scale)
     {
         BLT_ASSERT(!this->name.empty() && "Name should not be empty!");
     }
+};
+
+/**
+ * A single node as seen by the force equations.
+ */
+struct particle_t
+{
+    blt::vec2 pos;
+    float repulsiveness = conf::DEFAULT_REPULSIVENESS;
+    // a particle can stand in for a group of nodes, in which case this is the mass of the whole group
+    float mass = 1;
+};
+
+/**
+ * A run of particles stored as separate arrays, what the batched force kernels work on.
+ */
+struct particle_block_t
+{
+    const float* x;
+    const float* y;
+    const float* repulsiveness;
+    const float* mass;
+    blt::size_t count;
+};
+
+/**
+ * Simulation state of every node, one contiguous array per field so the force loops only pull in what they use.
+ */
+struct node_state_t
+{
+    std::vector<float> x, y;
+    std::vector<float> vx, vy;
+    std::vector<float> repulsiveness;
+    std::vector<float> mass;
     
-    blt::vec2& getVelocityRef()
+    [[nodiscard]] blt::size_t size() const
     {
-        return velocity;
+        return x.size();
     }
     
-    blt::vec2& getPositionRef()
+    [[nodiscard]] bool empty() const
+    {
+        return x.empty();
+    }
+    
+    void reserve(blt::size_t size)
+    {
+        for (auto* v : {&x, &y, &vx, &vy, &repulsiveness, &mass})
+            v->reserve(size);
+    }
+    
+    void clear()
+    {
+        for (auto* v : {&x, &y, &vx, &vy, &repulsiveness, &mass})
+            v->clear();
+    }
+    
+    void push_back(const blt::vec2& pos, float r = conf::DEFAULT_REPULSIVENESS, float m = 1)
+    {
+        x.push_back(pos.x());
+        y.push_back(pos.y());
+        vx.push_back(0);
+        vy.push_back(0);
+        repulsiveness.push_back(r);
+        mass.push_back(m);
+    }
+    
+    // moves the last node into index, nothing else changes index
+    void swap_erase(blt::size_t index)
+    {
+        for (auto* v : {&x, &y, &vx, &vy, &repulsiveness, &mass})
+        {
+            (*v)[index] = v->back();
+            v->pop_back();
+        }
+    }
+    
+    [[nodiscard]] blt::vec2 getPosition(blt::size_t index) const
+    {
+        return {x[index], y[index]};
+    }
+    
+    void setPosition(blt::size_t index, const blt::vec2& pos)
+    {
+        x[index] = pos.x();
+        y[index] = pos.y();
+    }
+    
+    [[nodiscard]] blt::vec2 getVelocity(blt::size_t index) const
+    {
+        return {vx[index], vy[index]};
+    }
+    
+    [[nodiscard]] particle_t getParticle(blt::size_t index) const
+    {
+        return {getPosition(index), repulsiveness[index], mass[index]};
+    }
+    
+    // nodes [begin, end) as a block
+    [[nodiscard]] particle_block_t getBlock(blt::size_t begin, blt::size_t end) const
+    {
+        return {x.data() + begin, y.data() + begin, repulsiveness.data() + begin, mass.data() + begin, end - begin};
+    }
+};
+
+/**
+ * Two floats of a node_state_t array pair (x / y, vx / vy) which read and write like a blt::vec2.
+ */
+class vec2_ref_t
+{
+    public:
+        vec2_ref_t(float& x, float& y): x_(x), y_(y)
+        {}
+        
+        operator blt::vec2() const
+        {
+            return {x_, y_};
+        }
+        
+        vec2_ref_t& operator=(const blt::vec2& v)
+        {
+            x_ = v.x();
+            y_ = v.y();
+            return *this;
+        }
+        
+        vec2_ref_t& operator+=(const blt::vec2& v)
+        {
+            x_ += v.x();
+            y_ += v.y();
+            return *this;
+        }
+        
+        vec2_ref_t& operator-=(const blt::vec2& v)
+        {
+            x_ -= v.x();
+            y_ -= v.y();
+            return *this;
+        }
+        
+        [[nodiscard]] float x() const
+        {
+            return x_;
+        }
+        
+        [[nodiscard]] float y() const
+        {
+            return y_;
+        }
+        
+        [[nodiscard]] float magnitude() const
+        {
+            return static_cast<blt::vec2>(*this).magnitude();
+        }
+    
+    private:
+        float& x_;
+        float& y_;
+};
+
+/**
+ * A node's cold data together with its simulation state, the accessors node_t had before the two were split. Only valid until a
+ * node is added or removed.
+ */
+class node_ref_t
+{
+    public:
+        node_ref_t(node_t& node, node_state_t& state, blt::size_t index): node(node), state(state), index(index)
+        {}
+        
+        node_t* operator->() const
+        {
+            return &node;
+        }
+        
+        node_t& operator*() const
+        {
+            return node;
+        }
+        
+        [[nodiscard]] blt::vec2 getPosition() const
+        {
+            return state.getPosition(index);
+        }
+        
+        vec2_ref_t getPositionRef()
+        {
+            return {state.x[index], state.y[index]};
+        }
+        
+        vec2_ref_t getVelocityRef()
+        {
+            return {state.vx[index], state.vy[index]};
+        }
+
+#ifndef GRAPHS_HEADLESS
+        [[nodiscard]] blt::gfx::point2d_t getRenderObj() const
+        {
+            return {getPosition(), node.scale};
+        }
+#endif
+    
+    private:
+        node_t& node;
+        node_state_t& state;
+        blt::size_t index;
+};
+
+// area of the world visible in the window
+struct view_rect_t
+{
+    blt::vec2 min, max;
+    // screen pixels covered by one unit of world space
+    float pixels_per_unit = 1;
+    
+    // if a point of the given size centered on pos is at least partly inside the view
+    [[nodiscard]] bool overlaps(const blt::vec2& pos, float size) const
     {
-        return point.pos;
+        const auto half = size / 2;
+        return pos.x() + half >= min.x() && pos.x() - half <= max.x() && pos.y() + half >= min.y() && pos.y() - half <= max.y();
     }
     
-    [[nodiscard]] const blt::vec2& getPosition() const
+    // if the bounding box of the line from p1 to p2 is at least partly inside the view
+    [[nodiscard]] bool overlaps(const blt::vec2& p1, const blt::vec2& p2) const
     {
-        return point.pos;
+        return std::max(p1.x(), p2.x()) >= min.x() && std::min(p1.x(), p2.x()) <= max.x() && std::max(p1.y(), p2.y()) >= min.y() &&
+               std::min(p1.y(), p2.y()) <= max.y();
     }
     
-    [[nodiscard]] auto& getRenderObj() const
+    [[nodiscard]] view_rect_t expand(float amount) const
     {
-        return point;
+        return {min - blt::vec2{amount, amount}, max + blt::vec2{amount, amount}, pixels_per_unit};
     }
 };
 
+/**
+ * Canonical key of the edge between two nodes, the smaller index in the high half so it is the same whichever way around the nodes
+ * are given. Node indices have to fit in 32 bits, the same as adjacency_t assumes.
+ */
+inline blt::u64 edge_key(blt::u64 n1, blt::u64 n2)
+{
+    return (std::min(n1, n2) << 32) | std::max(n1, n2);
+}
 
 struct edge_t
 {
     // fuck you too :3
-    friend selector_t;
+    friend graph_t;
         float ideal_spring_length = conf::DEFAULT_SPRING_LENGTH;
         float thickness = conf::DEFAULT_THICKNESS;
         blt::color4 color = conf::EDGE_COLOR;
@@ -87,9 +318,14 @@ struct edge_t
             BLT_ASSERT(i1 != i2 && "Indices cannot be equal!");
         }
         
-        inline friend bool operator==(edge_t e1, edge_t e2)
+        inline friend bool operator==(const edge_t& e1, const edge_t& e2)
         {
-            return (e1.i1 == e2.i1 || e1.i1 == e2.i2) && (e1.i2 == e2.i1 || e1.i2 == e2.i2);
+            return e1.key() == e2.key();
+        }
+        
+        [[nodiscard]] blt::u64 key() const
+        {
+            return edge_key(i1, i2);
         }
         
         [[nodiscard]] size_t getFirst() const
@@ -107,20 +343,16 @@ struct edge_t
         blt::u64 i1, i2;
 };
 
-struct edge_hash
-{
-    blt::u64 operator()(const edge_t& e) const
-    {
-        return e.getFirst() * e.getSecond();
-    }
-};
-
-struct edge_eq
+/**
+ * Everything loader_t saves out of a graph, so the save can be written on another thread while the graph keeps changing.
+ * The nodes and edges are immutable and shared with the graph (and the copies before this one) until the graph changes them,
+ * see graph_t::copy_for_save().
+ */
+struct graph_copy_t
 {
-    bool operator()(const edge_t& e1, const edge_t& e2) const
-    {
-        return e1 == e2;
-    }
+    std::shared_ptr<const std::vector<node_t>> nodes;
+    node_state_t node_state;
+    std::shared_ptr<const std::vector<edge_t>> edges;
 };
 
 
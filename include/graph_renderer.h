@@ -0,0 +1,128 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_GRAPH_RENDERER_H
+#define GRAPHS_GRAPH_RENDERER_H
+
+#include <vector>
+#include <config.h>
+#include <graph_base.h>
+#include <texture_atlas.h>
+#include <blt/math/vectors.h>
+#include <blt/gfx/gl_includes.h>
+
+/**
+ * Draws the graph with two instanced draw calls, one for the visible edges and one for the visible nodes.
+ *
+ * Node positions live in two float textures, x and y laid out the same as node_state_t, so both shaders look nodes up by index and a
+ * moving layout is a single copy of each array. What is visible is worked out by graph_t (culled against the view grid and thinned
+ * out when zoomed out), only those nodes and edges are gathered into the instance buffers. The gathering is a copy out of instances
+ * kept for every node and edge, which are only built again when the nodes or edges change.
+ *
+ * Sticks to what OpenGL 3.3 / OpenGL ES 3.0 have, the web build and software rasterizers like llvmpipe run it as is.
+ */
+class graph_renderer_t
+{
+    public:
+        graph_renderer_t() = default;
+        
+        graph_renderer_t(const graph_renderer_t&) = delete;
+        
+        graph_renderer_t& operator=(const graph_renderer_t&) = delete;
+        
+        // needs a gl context
+        void create();
+        
+        void cleanup();
+        
+        // sizes, colors and textures of every node, has to be called again after any of them or the atlas change
+        void upload_nodes(const std::vector<node_t>& nodes, const texture_atlas_t& atlas);
+        
+        void upload_edges(const std::vector<edge_t>& edges);
+        
+        void upload_positions(const node_state_t& nodes);
+        
+        /**
+         * Picks what the next render() draws, has to be called again after upload_nodes() or upload_edges().
+         * @param nodes indices of the nodes to draw, in the order they are layered
+         * @param edges indices into the edges given to upload_edges()
+         */
+        void upload_visible(const std::vector<blt::u32>& nodes, const std::vector<blt::u32>& edges);
+        
+        /**
+         * Draws the edges and then the nodes on top of them.
+         * @param width of the window, used to work out how large nodes are on screen
+         */
+        void render(const blt::mat4x4& ortho, const blt::mat4x4& view, blt::i32 width, const texture_atlas_t& atlas);
+    
+    private:
+        struct program_t
+        {
+            GLuint id = 0;
+            GLint ortho = -1;
+            GLint view = -1;
+            GLint viewport_width = -1;
+        };
+        
+        struct node_instance_t
+        {
+            float scale;
+            float outline_scale;
+            float color[4];
+            // uv_min, uv_max
+            float uv[4];
+            // -1 for no texture
+            blt::i32 page;
+            // where the position is in the position textures
+            blt::u32 index;
+        };
+        
+        struct edge_instance_t
+        {
+            blt::u32 first, second;
+            float color[4];
+            float thickness;
+        };
+        
+        program_t node_program;
+        program_t edge_program;
+        GLuint node_vao = 0;
+        GLuint edge_vao = 0;
+        GLuint node_vbo = 0;
+        GLuint edge_vbo = 0;
+        // x and y of every node, POSITION_TEXTURE_WIDTH wide
+        GLuint positions[2]{};
+        blt::size_t position_rows = 0;
+        
+        // nodes with a position uploaded, and visible nodes / edges in the instance buffers
+        blt::size_t position_count = 0;
+        blt::size_t node_count = 0;
+        blt::size_t edge_count = 0;
+        // elements the instance buffers have room for
+        blt::size_t node_capacity = 0;
+        blt::size_t edge_capacity = 0;
+        
+        // every node and edge, the visible ones are copied out of these
+        std::vector<node_instance_t> node_instances;
+        std::vector<edge_instance_t> edge_instances;
+        std::vector<node_instance_t> visible_nodes;
+        std::vector<edge_instance_t> visible_edges;
+};
+
+#endif //GRAPHS_GRAPH_RENDERER_H
@@ -0,0 +1,205 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_JOURNAL_H
+#define GRAPHS_JOURNAL_H
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <config.h>
+#include <graph_base.h>
+
+/**
+ * Append only log of the edits made to a graph since its last snapshot, so a crash only loses whatever wasn't written out yet.
+ *
+ * The file is a journal_header_t followed by records, each a journal_op_t, the u32 size of its payload and the payload itself.
+ * Nodes are referred to by index, which is only meaningful on top of the exact snapshot the journal was started for. The header
+ * holds the stamp of that snapshot, a journal with any other stamp is ignored.
+ *
+ * Records are built on the render thread and written out by a background thread every conf::JOURNAL_FLUSH_INTERVAL. Once
+ * should_compact() says so it should be compacted into a new snapshot, see loader_t::compact and loader_t::compact_async.
+ */
+
+inline constexpr char JOURNAL_MAGIC[8] = {'G', 'R', 'A', 'P', 'H', 'J', 'N', 'L'};
+// 2: removing a node moves the last node into its index instead of shifting every node after it down
+inline constexpr blt::u32 JOURNAL_VERSION = 2;
+
+struct journal_header_t
+{
+    char magic[8];
+    blt::u32 version;
+    blt::u32 byte_order;
+    // stamp of the snapshot the journal applies on top of
+    blt::u64 stamp;
+};
+
+enum class journal_op_t : blt::u8
+{
+    // x, y, then the node
+    ADD_NODE = 1,
+    // index
+    REMOVE_NODE,
+    // index, x, y
+    MOVE_NODE,
+    // first, second
+    CONNECT,
+    // first, second
+    DISCONNECT,
+    // index, then the node. nodes are written as size, outline scale, outline color then name, texture and description
+    SET_NODE,
+    // first, second, ideal length, thickness, color, description
+    SET_EDGE
+};
+
+class journal_t
+{
+    public:
+        journal_t() = default;
+        
+        journal_t(const journal_t&) = delete;
+        
+        journal_t& operator=(const journal_t&) = delete;
+        
+        ~journal_t()
+        {
+            close();
+        }
+        
+        /**
+         * Starts a new journal at path on top of the snapshot with the given stamp, replacing whatever was there before. It is empty
+         * unless a compaction is running, see begin_compaction().
+         */
+        void open(std::string path, blt::u64 stamp);
+        
+        // writes out everything recorded so far and stops the writer thread
+        void close();
+        
+        [[nodiscard]] bool is_open() const
+        {
+            return opened;
+        }
+        
+        /**
+         * Call right after the graph has been copied for a new snapshot. Everything recorded from here on is kept for the journal which
+         * will sit on top of that snapshot, while still going into the current journal in case the snapshot never makes it to disk.
+         * Works before the journal is opened as well, open() then starts with what was kept.
+         */
+        void begin_compaction();
+        
+        // the snapshot has been written, starts the journal over on top of it with everything recorded since begin_compaction
+        void finish_compaction(blt::u64 stamp);
+        
+        // the snapshot couldn't be written, the current journal carries on as if the compaction never started
+        void abandon_compaction();
+        
+        [[nodiscard]] bool compacting() const
+        {
+            return marked;
+        }
+        
+        /**
+         * The graph was changed in a way the journal can't describe, like being replaced by a new graph. Nothing more is recorded until
+         * the journal has been compacted.
+         */
+        void invalidate();
+        
+        /**
+         * True once the journal is long, has held unsaved edits for conf::AUTOSAVE_INTERVAL or can't describe the graph anymore.
+         */
+        [[nodiscard]] bool should_compact() const;
+        
+        // records which aren't part of a snapshot yet
+        [[nodiscard]] blt::size_t size() const
+        {
+            return record_count;
+        }
+        
+        void record_add_node(const blt::vec2& pos, const node_t& node);
+        
+        void record_remove_node(blt::u64 node);
+        
+        void record_move_node(blt::u64 node, const blt::vec2& pos);
+        
+        void record_connect(blt::u64 n1, blt::u64 n2);
+        
+        void record_disconnect(blt::u64 n1, blt::u64 n2);
+        
+        // every attribute of the node at index, including the name
+        void record_set_node(blt::u64 index, const node_t& node);
+        
+        void record_set_edge(const edge_t& edge);
+        
+        /**
+         * Applies the journal at path to a graph which was just loaded from the snapshot with the given stamp.
+         * Records cut off by a crash are ignored, as is everything after a record which doesn't make sense for the graph.
+         * @return number of records applied, 0 if the journal doesn't exist or belongs to another snapshot
+         */
+        static blt::size_t replay(graph_t& graph, const std::string& path, blt::u64 stamp);
+    
+    private:
+        // false if nothing should be recorded right now
+        bool begin_record(journal_op_t op);
+        
+        // fills in the size of the record and hands it to the writer thread
+        void end_record();
+        
+        void run();
+        
+        // starts a new file if there is a reset_stamp, then appends records to the file. clears both
+        void write_out(std::vector<char>& records, std::optional<blt::u64>& reset_stamp);
+        
+        // replaces the file with an empty journal for stamp
+        void start_file(blt::u64 stamp);
+        
+        std::string path;
+        // only touched by the writer thread once it is running
+        std::ofstream file;
+        std::thread writer;
+        bool opened = false;
+        
+        std::mutex mutex;
+        std::condition_variable cond;
+        // everything below is guarded by mutex
+        std::vector<char> pending;
+        std::optional<blt::u64> pending_reset;
+        bool stopping = false;
+        
+        // render thread only
+        std::vector<char> record;
+        blt::size_t record_count = 0;
+        // time the oldest record which isn't part of a snapshot was made
+        blt::u64 oldest_record = 0;
+        bool invalid = false;
+        
+        // between begin_compaction and finish / abandon_compaction
+        bool marked = false;
+        // the current journal was already invalid when the compaction started, nothing more can go into it
+        bool marked_invalid = false;
+        // records made since begin_compaction, the start of the next journal
+        std::vector<char> carried;
+        blt::size_t marked_count = 0;
+        blt::u64 marked_oldest = 0;
+};
+
+#endif //GRAPHS_JOURNAL_H
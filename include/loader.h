@@ -22,24 +22,129 @@
 #include <config.h>
 #include <graph_base.h>
 #include <graph.h>
+#include <journal.h>
 #include <optional>
+#include <string>
 #include <string_view>
-#include <blt/gfx/window.h>
+#ifndef GRAPHS_HEADLESS
+    #include <blt/gfx/window.h>
+#endif
 
 struct loader_t
 {
     std::vector<std::pair<std::string, std::string>> textures;
+    // stamp of the snapshot this was loaded from or last saved to, 0 if there isn't one. see journal.h
+    blt::u64 stamp = 0;
     
     /**
      * if save path is present and a valid file it will be read from, otherwise path will be used as the default.
+     * a snapshot next to save path (see snapshot_path) is preferred over it when it is at least as new, along with the edits
+     * from the journal next to it (see journal_path).
+     * nodes without a position are placed randomly inside of width x height.
      */
-    static std::optional<loader_t> load_for(engine_t& engine, const blt::gfx::window_data& data, std::string_view path,
+    static std::optional<loader_t> load_for(graph_t& graph, blt::i32 width, blt::i32 height, std::string_view path,
                                             std::optional<std::string_view> save_path = {});
     
     /**
-     * Saves engine to the path. Will also save any extra loader data like textures. Loader can be empty.
+     * Reads a graph written in the format described in tokenizer.h. load_for uses this for any file ending in .graph
+     * @return empty if the file can't be read or isn't valid, graph is left empty
+     */
+    static std::optional<loader_t> load_dsl(graph_t& graph, blt::i32 width, blt::i32 height, std::string_view path);
+    
+    /**
+     * Saves graph to the path. Will also save any extra loader data like textures. Loader can be empty.
+     * The file is written next to path and moved over it once complete.
+     * @return false if the file couldn't be written, whatever was at path is left alone
+     */
+    static bool save_for(graph_t& graph, const loader_t& loader, std::string_view path);
+    
+    static bool save_for(const graph_copy_t& graph, const loader_t& loader, std::string_view path);
+    
+    /**
+     * Writes graph as a binary snapshot (see snapshot.h). Much faster to write and read than json, used for saving on exit.
+     * @return false if the file couldn't be written
      */
-    static void save_for(engine_t& engine, const loader_t& loader, std::string_view path);
+    static bool save_snapshot(graph_t& graph, const loader_t& loader, std::string_view path);
+    
+    static bool save_snapshot(const graph_copy_t& graph, const loader_t& loader, std::string_view path);
+    
+    /**
+     * Maps a snapshot written by save_snapshot into graph.
+     * @return empty if the file doesn't exist or isn't a valid snapshot, graph is left empty
+     */
+    static std::optional<loader_t> load_snapshot(graph_t& graph, std::string_view path);
+    
+    // the snapshot saved alongside a json file, path with the extension replaced by .snapshot
+    static std::string snapshot_path(std::string_view path);
+    
+    // the journal kept alongside a json file, path with the extension replaced by .journal
+    static std::string journal_path(std::string_view path);
+    
+    /**
+     * Folds everything recorded in the journal into a new snapshot next to path and starts the journal over on top of it, opening
+     * the journal if it isn't already. The new snapshot's stamp is stored in loader.
+     * @return false if the snapshot couldn't be written, the journal is left as it was
+     */
+    static bool compact(graph_t& graph, loader_t& loader, journal_t& journal, std::string_view path);
+    
+    /**
+     * Same as compact, except only the copy of the graph happens on the calling thread. The snapshot (and the json at path, if
+     * write_json is set) is written by saver, whose result has to be handed to finish_compaction. Only one compaction can be running
+     * at a time, see journal_t::compacting.
+     */
+    static void compact_async(graph_t& graph, const loader_t& loader, journal_t& journal, save_thread_t& saver, std::string_view path,
+                              bool write_json = false);
+    
+    // starts the journal over on top of the snapshot written by compact_async, or carries on with the old one if it failed
+    static void finish_compaction(loader_t& loader, journal_t& journal, const save_result_t& result);
+
+#ifndef GRAPHS_HEADLESS
+    static std::optional<loader_t> load_for(engine_t& engine, const blt::gfx::window_data& data, std::string_view path,
+                                            std::optional<std::string_view> save_path = {})
+    {
+        return load_for(engine.graph, data.width, data.height, path, save_path);
+    }
+    
+    static bool save_for(engine_t& engine, const loader_t& loader, std::string_view path)
+    {
+        return save_for(engine.graph, loader, path);
+    }
+    
+    static bool save_snapshot(engine_t& engine, const loader_t& loader, std::string_view path)
+    {
+        return save_snapshot(engine.graph, loader, path);
+    }
+    
+    static bool compact(engine_t& engine, loader_t& loader, std::string_view path)
+    {
+        return compact(engine.graph, loader, engine.journal, path);
+    }
+    
+    static void compact_async(engine_t& engine, const loader_t& loader, save_thread_t& saver, std::string_view path, bool write_json = false)
+    {
+        compact_async(engine.graph, loader, engine.journal, saver, path, write_json);
+    }
+#endif
+    
+    // streams the file into the graph, defined in loader.cpp
+    struct sax_handler_t;
+    // feeds a .graph file into the sax handler, defined in loader.cpp
+    struct dsl_handler_t;
+    
+    // what the graph_copy_t overloads hand to write_json / write_snapshot, the same members a graph_t has
+    struct copy_view_t
+    {
+        const std::vector<node_t>& nodes;
+        const node_state_t& node_state;
+        const std::vector<edge_t>& edges;
+    };
+    
+    // used by both overloads of save_for / save_snapshot. GRAPH is either a graph_t or a copy_view_t, both have the nodes, node_state and edges a save needs
+    template<typename GRAPH>
+    static bool write_json(const GRAPH& graph, const loader_t& loader, std::string_view path);
+    
+    template<typename GRAPH>
+    static bool write_snapshot(const GRAPH& graph, const loader_t& loader, std::string_view path);
 };
 
 #endif //GRAPHS_LOADER_H
@@ -0,0 +1,71 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_MAPPED_FILE_H
+#define GRAPHS_MAPPED_FILE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <blt/std/types.h>
+
+/**
+ * Read only view of a whole file, mapped into memory where possible and read into a buffer otherwise.
+ */
+class mapped_file_t
+{
+    public:
+        // data() is null if the file couldn't be opened or is empty, is_open() tells the two apart
+        explicit mapped_file_t(const std::string& path);
+        
+        mapped_file_t(const mapped_file_t&) = delete;
+        
+        mapped_file_t& operator=(const mapped_file_t&) = delete;
+        
+        ~mapped_file_t();
+        
+        [[nodiscard]] bool is_open() const
+        {
+            return opened;
+        }
+        
+        [[nodiscard]] const char* data() const
+        {
+            return bytes;
+        }
+        
+        [[nodiscard]] blt::size_t size() const
+        {
+            return length;
+        }
+        
+        [[nodiscard]] std::string_view view() const
+        {
+            return {bytes, length};
+        }
+    
+    private:
+        const char* bytes = nullptr;
+        blt::size_t length = 0;
+        bool opened = false;
+        // only used when the file can't be mapped
+        std::vector<char> buffer;
+};
+
+#endif //GRAPHS_MAPPED_FILE_H
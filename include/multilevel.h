@@ -0,0 +1,140 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAPHS_MULTILEVEL_H
+#define GRAPHS_MULTILEVEL_H
+
+#include <random>
+#include <vector>
+#include <blt/std/types.h>
+#include <graph_base.h>
+#include <adjacency.h>
+#include <simulation.h>
+
+struct multilevel_settings_t
+{
+    // coarsening stops once a level has this many nodes or less
+    int coarsest_size = 32;
+    // or once a level is less than this much smaller than the one before it
+    float min_reduction = 0.1f;
+    int coarsest_iterations = 500;
+    // most refinement iterations on every level after the coarsest one
+    int level_iterations = 60;
+    // big levels get fewer, refining a level is capped at about this many node steps. they start out close to done and only need
+    // to fix what changed locally, and they are where nearly all of the time goes
+    int level_work = 300000;
+    // but never less than this
+    int min_level_iterations = 3;
+    // levels bigger than this always use Barnes-Hut with fine_theta, whatever the repulsion mode of the simulation
+    int fine_level_size = 2000;
+    float fine_theta = 1.2f;
+    // the layout is scaled up by expansion * sqrt(fine nodes / coarse nodes) going from one level to the next
+    float expansion = 0.85f;
+    // sim factor handed to simulation_t::step, much larger than what the interactive simulation uses
+    float step_size = 0.01f;
+    // matching is randomized, the seed keeps the result the same between runs
+    blt::u64 seed = 0x5EED;
+};
+
+struct multilevel_result_t
+{
+    blt::size_t levels = 0;
+    blt::size_t iterations = 0;
+    double milliseconds = 0;
+};
+
+/**
+ * Multilevel layout.
+ *
+ * The graph is coarsened by repeatedly collapsing a matching of its edges, every node of a coarse level stands in for one or more
+ * nodes of the level below it. The coarsest graph is laid out by the simulation, and every level below starts from the scaled up
+ * positions of its parents and only needs a handful of refinement steps. Runs the same equation and thread count as the simulation
+ * it is given.
+ *
+ * The layout is run a slice at a time by advance(), so the thread running it can keep publishing positions and handling commands
+ * in between.
+ */
+class multilevel_layout_t
+{
+    public:
+        explicit multilevel_layout_t(const multilevel_settings_t& settings);
+        
+        /**
+         * Runs the layout for about max_milliseconds, at least a single step. The graph is coarsened by the first call.
+         * nodes and adjacency have to be the same graph on every call, nodes only gets its new positions once the last level is reached.
+         * @return true once the layout is done
+         */
+        bool advance(simulation_t& simulation, node_state_t& nodes, const adjacency_t& adjacency, double max_milliseconds);
+        
+        [[nodiscard]] bool done() const
+        {
+            return finished;
+        }
+        
+        // 0 to 1, by node steps run out of the node steps planned over every level
+        [[nodiscard]] float getProgress() const
+        {
+            return total_work == 0 ? 0 : static_cast<float>(static_cast<double>(finished_work) / static_cast<double>(total_work));
+        }
+        
+        [[nodiscard]] const multilevel_result_t& getResult() const
+        {
+            return result;
+        }
+    
+    private:
+        struct level_t
+        {
+            node_state_t nodes;
+            adjacency_t adjacency;
+        };
+        
+        void coarsen(const node_state_t& nodes, const adjacency_t& adjacency);
+        
+        // moves the layout of the current level down onto the one below it
+        void prolong(node_state_t& nodes);
+        
+        [[nodiscard]] int iterations_for(blt::size_t level, blt::size_t node_count) const;
+        
+        [[nodiscard]] float temperature_for(blt::size_t level, blt::size_t node_count) const;
+        
+        multilevel_settings_t settings;
+        std::mt19937_64 rng;
+        // level 0 is the graph itself and isn't stored, coarse[i] is level i + 1 and parents[i] maps the nodes of level i onto it
+        std::vector<level_t> coarse;
+        std::vector<std::vector<blt::u32>> parents;
+        bool coarsened = false;
+        bool finished = false;
+        
+        blt::size_t level = 0;
+        int level_iteration = 0;
+        int level_iterations = 0;
+        float temperature = 0;
+        blt::u64 total_work = 0;
+        blt::u64 finished_work = 0;
+        blt::u64 start = 0;
+        multilevel_result_t result;
+};
+
+/**
+ * Runs a multilevel layout to the end on the calling thread.
+ */
+multilevel_result_t multilevel_layout(simulation_t& simulation, node_state_t& nodes, const adjacency_t& adjacency,
+                                      const multilevel_settings_t& settings);
+
+#endif //GRAPHS_MULTILEVEL_H
@@ -0,0 +1,151 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_PARSER_H
+#define GRAPHS_PARSER_H
+
+#include <tokenizer.h>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <blt/math/vectors.h>
+
+namespace proc
+{
+    /*
+     * Every declaration only holds views into the text being parsed, they are valid until the text is freed.
+     */
+    
+    // path on its own, or name: path
+    struct texture_decl_t
+    {
+        std::string_view name;
+        std::string_view path;
+    };
+    
+    // name: texture=t, location=[x, y], size=s, scale=s, color=[r, g, b(, a)], description=d
+    struct node_decl_t
+    {
+        std::string_view name;
+        std::optional<std::string_view> texture;
+        std::optional<blt::vec2> location;
+        std::optional<float> size;
+        std::optional<float> scale;
+        std::optional<blt::vec4> color;
+        std::optional<std::string_view> description;
+    };
+    
+    // first, second: length=l, thickness=t, description=d
+    struct edge_decl_t
+    {
+        std::string_view first;
+        std::string_view second;
+        std::optional<float> length;
+        std::optional<float> thickness;
+        std::optional<std::string_view> description;
+    };
+    
+    // name: anything up until the end of the line
+    struct description_decl_t
+    {
+        std::string_view name;
+        std::string_view text;
+    };
+    
+    /**
+     * Receives the declarations of a file in the order they appear in. Names can refer to nodes which are declared further down.
+     */
+    class parse_handler_t
+    {
+        public:
+            virtual void texture(const texture_decl_t& decl) = 0;
+            
+            virtual void node(const node_decl_t& decl) = 0;
+            
+            virtual void edge(const edge_decl_t& decl) = 0;
+            
+            virtual void description(const description_decl_t& decl) = 0;
+            
+            virtual ~parse_handler_t() = default;
+    };
+    
+    /**
+     * Parses the format described in tokenizer.h straight off of the tokenizer, one entry at a time. Nothing is copied or allocated
+     * per token, the only memory used is a buffer for the tokens of the current entry which is reused.
+     */
+    class parser_t
+    {
+        public:
+            // str has to outlive the parser and every declaration it hands out
+            explicit parser_t(std::string_view str): data(str), tokens(str)
+            {}
+            
+            /**
+             * Hands every declaration to the handler.
+             * @return false if the text isn't valid, the handler may have been given part of the file already
+             */
+            bool parse(parse_handler_t& handler);
+        
+        private:
+            enum class section_t
+            {
+                NONE, TEXTURES, NODES, EDGES, DESCRIPTIONS, UNKNOWN
+            };
+            
+            /**
+             * Reads the tokens up to the end of the current entry (newline or ; outside of brackets) into entry.
+             * @return false if the tokenizer hit something it couldn't read
+             */
+            bool read_entry();
+            
+            bool parse_section();
+            
+            bool parse_texture(parse_handler_t& handler);
+            
+            bool parse_node(parse_handler_t& handler);
+            
+            bool parse_edge(parse_handler_t& handler);
+            
+            bool parse_description(parse_handler_t& handler);
+            
+            /**
+             * Calls func(key, first, last) for every key=value in entry from index onward, [first, last) are the tokens of the value.
+             * Values in brackets (a list) don't include the brackets.
+             */
+            template<typename FUNC>
+            bool parse_properties(blt::size_t index, FUNC&& func);
+            
+            // the text of the file from the start of first to the end of last, including any quotes
+            [[nodiscard]] std::string_view slice(const token_t& first, const token_t& last) const;
+            
+            bool error(const token_t& token, const char* what);
+            
+            static bool is_name(const token_t& token);
+            
+            static bool to_float(const token_t& token, float& value);
+            
+            std::string_view data;
+            tokenizer tokens;
+            section_t section = section_t::NONE;
+            bool at_end = false;
+            std::vector<token_t> entry;
+    };
+}
+
+#endif //GRAPHS_PARSER_H
@@ -0,0 +1,160 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_PROFILER_H
+#define GRAPHS_PROFILER_H
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+#include <blt/std/types.h>
+#include <blt/std/time.h>
+#include <config.h>
+
+struct profile_event_t
+{
+    // has to outlive the profiler, scopes are only ever named with string literals
+    const char* name = "";
+    blt::i64 start = 0;
+    blt::i64 end = 0;
+    blt::u64 frame = 0;
+    // 0 is the whole frame, scopes opened inside of another scope are one deeper
+    blt::u32 depth = 0;
+};
+
+/**
+ * Records how long each phase of a frame takes into a fixed size ring buffer, the oldest events are overwritten once it is full.
+ *
+ * Only meant to be used from the render thread, nothing here is synchronized. Recording an event is two clock reads and a store
+ * into the buffer, cheap enough to leave on all the time.
+ */
+class profiler_t
+{
+    public:
+        explicit profiler_t(blt::size_t capacity = conf::PROFILER_CAPACITY): events(capacity)
+        {}
+        
+        void begin_frame();
+        
+        // records the frame itself, every scope of the frame has to be closed by now
+        void end_frame();
+        
+        /**
+         * Records an event which was timed somewhere else, as a child of whatever scope is currently open.
+         */
+        void record(const char* name, blt::i64 start, blt::i64 end)
+        {
+            if (enabled)
+                push({name, start, end, frame, depth});
+        }
+        
+        /**
+         * Calls func on every event in the buffer, oldest first.
+         */
+        template<typename FUNC>
+        void for_each(FUNC&& func) const
+        {
+            const auto capacity = events.size();
+            for (blt::size_t i = 0; i < count; i++)
+                func(events[(head + capacity - count + i) % capacity]);
+        }
+        
+        [[nodiscard]] blt::size_t size() const
+        {
+            return count;
+        }
+        
+        void clear()
+        {
+            head = 0;
+            count = 0;
+        }
+        
+        /**
+         * Writes every event in the buffer in the chrome trace event format, can be opened in chrome://tracing or perfetto.
+         * @return false if the file couldn't be opened
+         */
+        bool write_chrome_trace(std::string_view path) const;
+        
+        /**
+         * Writes every event in the buffer as frame,name,depth,start_ms,duration_ms. start is relative to the oldest event.
+         * @return false if the file couldn't be opened
+         */
+        bool write_csv(std::string_view path) const;
+
+#ifndef GRAPHS_HEADLESS
+        /**
+         * Draws a graph of the frame times and a timeline of the newest (or selected) frame.
+         */
+        void draw_gui();
+#endif
+        
+        // turns recording off, nothing new is added to the buffer while disabled
+        bool enabled = true;
+    
+    private:
+        friend class profile_scope_t;
+        
+        void push(const profile_event_t& event)
+        {
+            events[head] = event;
+            head = (head + 1) % events.size();
+            count = std::min(count + 1, events.size());
+        }
+        
+        std::vector<profile_event_t> events;
+        // where the next event goes
+        blt::size_t head = 0;
+        blt::size_t count = 0;
+        
+        blt::u64 frame = 0;
+        blt::i64 frame_start = 0;
+        blt::u32 depth = 0;
+        // frames back from the newest one shown in the timeline, 0 follows the newest frame
+        int frame_offset = 0;
+};
+
+/**
+ * Times the enclosing scope, recorded into the profiler when it goes out of scope.
+ */
+class profile_scope_t
+{
+    public:
+        profile_scope_t(profiler_t& profiler, const char* name): profiler(profiler), name(name), start(blt::system::getCurrentTimeNanoseconds())
+        {
+            profiler.depth++;
+        }
+        
+        profile_scope_t(const profile_scope_t&) = delete;
+        
+        profile_scope_t& operator=(const profile_scope_t&) = delete;
+        
+        ~profile_scope_t()
+        {
+            profiler.depth--;
+            profiler.record(name, start, blt::system::getCurrentTimeNanoseconds());
+        }
+    
+    private:
+        profiler_t& profiler;
+        const char* name;
+        blt::i64 start;
+};
+
+#endif //GRAPHS_PROFILER_H
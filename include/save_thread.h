@@ -0,0 +1,102 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_SAVE_THREAD_H
+#define GRAPHS_SAVE_THREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <loader.h>
+
+struct save_job_t
+{
+    graph_copy_t graph;
+    // the snapshot is written with the stamp stored in here
+    loader_t loader;
+    // json file the save belongs to, the snapshot goes next to it (see loader_t::snapshot_path)
+    std::string path;
+    // also write the json, before the snapshot so the snapshot is still the newer of the two
+    bool write_json = false;
+};
+
+struct save_result_t
+{
+    std::string path;
+    blt::u64 stamp = 0;
+    bool success = false;
+    // time spent writing
+    double seconds = 0;
+};
+
+/**
+ * Writes saves on a thread of its own so serializing a large graph never holds up a frame. Only copying the graph out (see
+ * graph_t::copy_for_save) happens on the thread making the save. Jobs are written one at a time in the order they were submitted.
+ */
+class save_thread_t
+{
+    public:
+        save_thread_t() = default;
+        
+        save_thread_t(const save_thread_t&) = delete;
+        
+        save_thread_t& operator=(const save_thread_t&) = delete;
+        
+        ~save_thread_t()
+        {
+            stop();
+        }
+        
+        // the thread is started with the first job
+        void submit(save_job_t job);
+        
+        /**
+         * @return a job which finished since the last call, empty if there isn't one
+         */
+        std::optional<save_result_t> poll();
+        
+        // jobs submitted which haven't been written yet
+        [[nodiscard]] blt::size_t pending() const
+        {
+            return unfinished.load(std::memory_order_relaxed);
+        }
+        
+        // writes every job still queued and stops the thread
+        void stop();
+    
+    private:
+        void run();
+        
+        std::thread thread;
+        std::atomic<blt::size_t> unfinished = 0;
+        
+        std::mutex mutex;
+        std::condition_variable cond;
+        // guarded by mutex
+        std::deque<save_job_t> jobs;
+        std::deque<save_result_t> results;
+        bool stopping = false;
+};
+
+#endif //GRAPHS_SAVE_THREAD_H
@@ -19,24 +19,32 @@
 #ifndef GRAPHS_SELECTION_H
 #define GRAPHS_SELECTION_H
 
+#include <vector>
 #include <config.h>
 
 class selector_t
 {
     public:
-        explicit selector_t(graph_t& graph): graph(graph)
+        // every edit made through the selector is recorded in the journal
+        selector_t(graph_t& graph, journal_t& journal): graph(graph), journal(journal)
         {}
         
         // called inside the info panel block, used for adding more information
         void draw_gui(blt::i32 width, blt::i32 height);
         
-        // called once per frame, for rendering animations
+        // called once per frame, for rendering animations. drawn before the graph, so the rings end up behind the nodes they belong to
         void render(blt::i32 width, blt::i32 height);
         
+        // called once per frame after the graph is drawn, the box / lasso being dragged goes on top of the nodes
+        void render_overlay(blt::i32 width, blt::i32 height);
+        
         // called once per frame assuming imgui doesn't want the mouse
         void process_mouse(blt::i32 width, blt::i32 height);
         
         void process_keyboard(blt::i32 width, blt::i32 height);
+        
+        // forgets every selected node, has to be called when the graph is replaced as the indices would point at different nodes
+        void clear();
     
     private:
         void set_primary_selection(blt::i64 n);
@@ -45,15 +53,34 @@ class selector_t
         
         void set_secondary_selection(blt::i64 n);
         
+        // checks the name typed into the name field, once it is left
+        void finish_rename(blt::u64 node);
+        
         void create_placement_node(const blt::vec2& pos);
         void destroy_node(blt::i64 node);
+        
+        // queries the graph with the box / lasso being dragged, adding to the selection instead of replacing it if add is set
+        void finish_area_selection(bool add);
+        
+        void destroy_selection();
     
     private:
+        enum class area_selection_t
+        {
+            NONE, BOX, LASSO
+        };
+        
         blt::i64 drag_selection = -1;
         blt::i64 primary_selection = -1;
         blt::i64 secondary_selection = -1;
         bool placement = false;
+        area_selection_t area_selection = area_selection_t::NONE;
+        // in world space, the two corners of a box or every point of a lasso so far
+        std::vector<blt::vec2> area_points;
+        // nodes picked by dragging a box (or a lasso while holding control) over empty space, in index order
+        std::vector<blt::u64> selection;
         graph_t& graph;
+        journal_t& journal;
 };
 
 #endif //GRAPHS_SELECTION_H
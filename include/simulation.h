@@ -0,0 +1,256 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAPHS_SIMULATION_H
+#define GRAPHS_SIMULATION_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <config.h>
+#include <graph_base.h>
+#include <force_algorithms.h>
+#include <barnes_hut.h>
+#include <uniform_grid.h>
+#include <adjacency.h>
+#include <thread_pool.h>
+#include <triple_buffer.h>
+#include <profiler.h>
+
+enum class repulsion_mode_t
+{
+    // every node against every other node, O(n^2)
+    EXACT,
+    // Barnes-Hut quadtree, O(n log n)
+    BARNES_HUT,
+    // only nodes within the cutoff radius, binned with a uniform grid. close to O(n) for evenly spread out graphs
+    CUTOFF
+};
+
+struct step_timings_t
+{
+    double tree = 0;
+    double repulsion = 0;
+    double attraction = 0;
+    double integration = 0;
+};
+
+struct simulation_settings_t
+{
+    bool sim = false;
+    bool run_infinitely = true;
+    float sim_speed = 1;
+    float threshold = 0;
+    int max_iterations = 5000;
+    int thread_count = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    repulsion_mode_t repulsion_mode = repulsion_mode_t::BARNES_HUT;
+    float theta = 0.5;
+    float cutoff_radius = conf::DEFAULT_CUTOFF_RADIUS;
+    // largest distance a node can move in a single step, 0 for no limit
+    float max_displacement = 0;
+};
+
+/**
+ * Everything needed to step the force simulation over a list of nodes. Used directly by graph_t when simulating on the render
+ * thread and owned by the simulation_thread_t otherwise.
+ */
+class simulation_t
+{
+    public:
+        simulation_t()
+        {
+            use_Eades();
+        }
+        
+        simulation_t(const simulation_t&) = delete;
+        
+        simulation_t& operator=(const simulation_t&) = delete;
+        
+        [[nodiscard]] bool should_step() const
+        {
+            return settings.sim && (current_iterations < settings.max_iterations || settings.run_infinitely) && max_force_last > settings.threshold;
+        }
+        
+        // runs a single iteration of the simulation
+        void step(node_state_t& nodes, const adjacency_t& adjacency, float sim_factor);
+        
+        /**
+         * Compares the repulsion of the current repulsion mode against the exact repulsion for the current layout.
+         * @return relative RMS error of the approximated forces, stored in last_error
+         */
+        float measure_repulsion_error(const node_state_t& nodes);
+        
+        void use_Eades()
+        {
+            set_equation(std::make_unique<Eades_equation>());
+        }
+        
+        void use_Fruchterman_Reingold()
+        {
+            set_equation(std::make_unique<Fruchterman_Reingold_equation>());
+        }
+        
+        void set_equation(std::unique_ptr<force_equation> eq)
+        {
+            equation = std::move(eq);
+            select_step();
+        }
+        
+        [[nodiscard]] force_equation& getEquation() const
+        {
+            return *equation;
+        }
+        
+        [[nodiscard]] float getCoolingFactor() const
+        {
+            return equation->cooling_factor(current_iterations);
+        }
+        
+        simulation_settings_t settings;
+        int current_iterations = 0;
+        float max_force_last = 1;
+        float last_error = -1;
+        // summed over the steps since this was last cleared
+        step_timings_t timings;
+        // when set every phase of a step is recorded into it, has to belong to the thread calling step()
+        profiler_t* profiler = nullptr;
+    
+    private:
+        using step_function_t = void (simulation_t::*)(node_state_t&, const adjacency_t&, float);
+        
+        /**
+         * Picks the step instantiated for the type of the current equation. The built in equations get a step where every call into
+         * the equation is resolved at compile time, anything else goes through the virtual force_equation interface.
+         */
+        void select_step();
+        
+        template<typename EQUATION>
+        void step_with(node_state_t& nodes, const adjacency_t& adjacency, float sim_factor);
+        
+        // builds whatever the repulsion mode needs (tree / grid) and sizes the force buffer
+        void prepare_repulsion(const node_state_t& nodes);
+        
+        template<typename EQUATION>
+        void apply_repulsion(const EQUATION& eq, const node_state_t& nodes, blt::size_t begin, blt::size_t end);
+        
+        // adds the attractive forces of nodes [begin, end) by walking their rows of the CSR adjacency
+        template<typename EQUATION>
+        void apply_attraction(const EQUATION& eq, const node_state_t& nodes, const adjacency_t& adjacency, blt::size_t begin, blt::size_t end);
+        
+        std::unique_ptr<force_equation> equation;
+        step_function_t step_function = nullptr;
+        barnes_hut_t tree;
+        uniform_grid_t grid;
+        thread_pool_t pool;
+        // forces of the current step, written per node by whichever thread owns the node's chunk
+        std::vector<blt::vec2> forces;
+        std::vector<float> chunk_max_force;
+};
+
+/**
+ * State owned by the background simulation thread. Commands are the only way to touch it from outside the thread.
+ */
+struct simulation_state_t
+{
+    simulation_t simulation;
+    node_state_t nodes;
+    adjacency_t adjacency;
+    // topology version of the graph the nodes were copied from
+    blt::u64 version = 0;
+    // the last graph_t::move_node() applied to the nodes
+    blt::u64 moved_version = 0;
+    // long running work (the multilevel layout) run in place of the simulation a slice at a time, until it returns true
+    std::function<bool(simulation_state_t&)> task;
+    // how far along the task is from 0 to 1, negative when there is none
+    float task_progress = -1;
+    // set along with the task, tells the progress of a task apart from that of the one before it
+    blt::u64 task_id = 0;
+};
+
+struct simulation_snapshot_t
+{
+    std::vector<float> x, y;
+    blt::u64 version = 0;
+    blt::u64 moved_version = 0;
+    int current_iterations = 0;
+    float max_force_last = 1;
+    // of the last step
+    step_timings_t timings;
+    float steps_per_second = 0;
+    float task_progress = -1;
+    blt::u64 task_id = 0;
+};
+
+/**
+ * Runs the simulation on its own thread at a fixed timestep, as fast as it can.
+ *
+ * Positions are published after every step through a triple buffer, the render thread picks up the newest one each frame without
+ * ever blocking the simulation. Changes from the render thread are queued as commands and applied in between steps.
+ */
+class simulation_thread_t
+{
+    public:
+        using command_t = std::function<void(simulation_state_t&)>;
+        
+        simulation_thread_t() = default;
+        
+        simulation_thread_t(const simulation_thread_t&) = delete;
+        
+        simulation_thread_t& operator=(const simulation_thread_t&) = delete;
+        
+        ~simulation_thread_t()
+        {
+            stop();
+        }
+        
+        void start();
+        
+        void stop();
+        
+        [[nodiscard]] bool running() const
+        {
+            return thread.joinable();
+        }
+        
+        void submit(command_t command);
+        
+        /**
+         * @return the newest snapshot published by the thread, nullptr if there hasn't been a new one since the last call
+         */
+        const simulation_snapshot_t* poll();
+    
+    private:
+        void run();
+        
+        void publish(simulation_state_t& state, float steps_per_second);
+        
+        std::thread thread;
+        std::atomic_bool stopping = false;
+        
+        std::mutex command_mutex;
+        std::condition_variable command_cond;
+        std::vector<command_t> commands;
+        
+        triple_buffer_t<simulation_snapshot_t> snapshots;
+};
+
+#endif //GRAPHS_SIMULATION_H
@@ -0,0 +1,65 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_SNAPSHOT_H
+#define GRAPHS_SNAPSHOT_H
+
+#include <blt/std/types.h>
+
+/**
+ * Binary snapshot of a graph, written by loader_t::save_snapshot and mapped straight back in by loader_t::load_snapshot.
+ *
+ * The file is the header followed by sections, each starting on a SNAPSHOT_ALIGNMENT boundary:
+ *  - nodes:    x, y, size, outline scale as float[node_count] each, outline color as float[node_count * 4], then name, texture
+ *              and description as u32[node_count] string indices each
+ *  - edges:    CSR, u64[node_count + 1] row offsets then u32[edge_count] targets. every edge is stored once, in the row of its
+ *              smaller node. followed by ideal length and thickness as float[edge_count], color as float[edge_count * 4] and
+ *              description as u32[edge_count] string indices
+ *  - textures: u32[texture_count * 2] string indices of each (name, path) pair
+ *  - strings:  u64[string_count + 1] offsets into the character data which follows. string 0 is always empty
+ *
+ * Everything is stored in native byte order, the header's byte_order tells a file from a machine with the other one apart.
+ */
+
+inline constexpr char SNAPSHOT_MAGIC[8] = {'G', 'R', 'A', 'P', 'H', 'S', 'N', 'P'};
+inline constexpr blt::u32 SNAPSHOT_VERSION = 2;
+inline constexpr blt::u32 SNAPSHOT_BYTE_ORDER = 0x01020304;
+inline constexpr blt::u64 SNAPSHOT_ALIGNMENT = 64;
+
+struct snapshot_header_t
+{
+    char magic[8];
+    blt::u32 version;
+    blt::u32 byte_order;
+    blt::u64 node_count;
+    blt::u64 edge_count;
+    blt::u64 texture_count;
+    blt::u64 string_count;
+    // from the start of the file
+    blt::u64 nodes_offset;
+    blt::u64 edges_offset;
+    blt::u64 textures_offset;
+    blt::u64 strings_offset;
+    // total size of the file, anything shorter has been cut off
+    blt::u64 file_size;
+    // identifies the snapshot to the journal written on top of it, see journal.h. 0 if there is no journal
+    blt::u64 stamp;
+};
+
+#endif //GRAPHS_SNAPSHOT_H
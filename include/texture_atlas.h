@@ -0,0 +1,125 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_TEXTURE_ATLAS_H
+#define GRAPHS_TEXTURE_ATLAS_H
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <config.h>
+#include <texture_loader.h>
+#include <blt/std/hashmap.h>
+#include <blt/math/vectors.h>
+#include <blt/gfx/gl_includes.h>
+
+struct atlas_region_t
+{
+    blt::u32 page = 0;
+    blt::vec2 uv_min, uv_max;
+};
+
+/**
+ * Node textures packed into a few large pages, which are all bound at once so every node can be drawn with a single draw call
+ * (see graph_renderer_t). Textures are only read once they are requested, and are decoded on the texture loader's threads in the
+ * meantime.
+ *
+ * Every texture takes up one conf::ATLAS_CELL_SIZE square cell. Nodes are drawn as circles so textures are stretched to a square
+ * anyway, which keeps packing down to handing out the next free cell.
+ */
+class texture_atlas_t
+{
+    public:
+        texture_atlas_t() = default;
+        
+        texture_atlas_t(const texture_atlas_t&) = delete;
+        
+        texture_atlas_t& operator=(const texture_atlas_t&) = delete;
+        
+        void setPrefixDirectory(std::string directory)
+        {
+            prefix = std::move(directory);
+        }
+        
+        // where the texture called name is read from, nothing is loaded until it is requested
+        void add_source(std::string name, std::string path)
+        {
+            sources[std::move(name)] = std::move(path);
+        }
+        
+        // needs a gl context
+        void create()
+        {
+            // everything falls back to the placeholder, so it is the one texture worth having before anything else
+            request(conf::DEFAULT_IMAGE);
+        }
+        
+        void cleanup();
+        
+        /**
+         * Queues the texture to be decoded if it hasn't been already.
+         * @return region of the texture, or of conf::DEFAULT_IMAGE while it is still loading. nullptr if neither is ready yet
+         */
+        const atlas_region_t* request(const std::string& name);
+        
+        // same as request() without ever loading anything
+        [[nodiscard]] const atlas_region_t* find(const std::string& name) const;
+        
+        /**
+         * Copies textures which finished decoding into their pages, at most conf::ATLAS_UPLOADS_PER_FRAME. Has to be called on the
+         * render thread.
+         */
+        void update();
+        
+        [[nodiscard]] const std::vector<GLuint>& getPages() const
+        {
+            return pages;
+        }
+        
+        // changes every time a texture is added, regions found before then may have been replacing a texture which is now loaded
+        [[nodiscard]] blt::u64 getGeneration() const
+        {
+            return generation;
+        }
+    
+    private:
+        static constexpr blt::size_t CELLS_PER_ROW = conf::ATLAS_PAGE_SIZE / conf::ATLAS_CELL_SIZE;
+        static constexpr blt::size_t CELLS_PER_PAGE = CELLS_PER_ROW * CELLS_PER_ROW;
+        
+        // claims the next free cell, adding a page if the last one is full. empty once every page is full
+        std::optional<atlas_region_t> allocate();
+        
+        std::string prefix;
+        blt::hashmap_t<std::string, std::string> sources;
+        // textures in the atlas
+        blt::hashmap_t<std::string, atlas_region_t> regions;
+        // textures which have been requested, whether they are loaded yet or not
+        blt::hashset_t<std::string> requested;
+        blt::size_t used_cells = 0;
+        
+        blt::u64 generation = 0;
+        
+        std::vector<GLuint> pages;
+        // pages whose mipmaps are out of date
+        std::vector<bool> dirty;
+        
+        texture_loader_t loader;
+};
+
+#endif //GRAPHS_TEXTURE_ATLAS_H
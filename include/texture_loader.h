@@ -0,0 +1,92 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_TEXTURE_LOADER_H
+#define GRAPHS_TEXTURE_LOADER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <config.h>
+
+struct decoded_texture_t
+{
+    std::string name;
+    // conf::ATLAS_CELL_SIZE squared RGBA pixels, empty if the image couldn't be read
+    std::vector<blt::u8> pixels;
+};
+
+/**
+ * Decodes images on worker threads so nothing is read from disk until a texture is actually needed. Every image is scaled to a
+ * single atlas cell while still on the worker, the render thread only has to copy the finished pixels into the atlas.
+ */
+class texture_loader_t
+{
+    public:
+        explicit texture_loader_t(blt::size_t thread_count = conf::TEXTURE_LOADER_THREADS): thread_count(thread_count)
+        {}
+        
+        texture_loader_t(const texture_loader_t&) = delete;
+        
+        texture_loader_t& operator=(const texture_loader_t&) = delete;
+        
+        ~texture_loader_t()
+        {
+            stop();
+        }
+        
+        // the threads are started with the first load
+        void load(std::string name, std::string path);
+        
+        /**
+         * @return an image which finished decoding since the last call, empty if there isn't one
+         */
+        std::optional<decoded_texture_t> poll();
+        
+        // drops everything still queued and stops the threads
+        void stop();
+        
+        // reads the image at path and scales it to an atlas cell, safe to call from any thread
+        static decoded_texture_t decode(std::string name, const std::string& path);
+    
+    private:
+        struct job_t
+        {
+            std::string name;
+            std::string path;
+        };
+        
+        void run();
+        
+        blt::size_t thread_count;
+        std::vector<std::thread> workers;
+        
+        std::mutex mutex;
+        std::condition_variable cond;
+        // guarded by mutex
+        std::deque<job_t> jobs;
+        std::deque<decoded_texture_t> results;
+        bool stopping = false;
+};
+
+#endif //GRAPHS_TEXTURE_LOADER_H
@@ -0,0 +1,112 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAPHS_THREAD_POOL_H
+#define GRAPHS_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <blt/std/types.h>
+
+/**
+ * Persistent pool of worker threads for data parallel loops.
+ *
+ * parallel_for() splits [0, count) into chunks and hands every thread a contiguous run of them. Threads which run out of work
+ * steal chunks from the back of another thread's run, so uneven chunks (dense parts of the graph) still balance out.
+ * The calling thread always takes part as thread 0.
+ */
+class thread_pool_t
+{
+    public:
+        // begin, end, thread index
+        using task_t = std::function<void(blt::size_t, blt::size_t, blt::size_t)>;
+        
+        explicit thread_pool_t(blt::size_t thread_count = 1)
+        {
+            resize(thread_count);
+        }
+        
+        thread_pool_t(const thread_pool_t&) = delete;
+        
+        thread_pool_t& operator=(const thread_pool_t&) = delete;
+        
+        ~thread_pool_t()
+        {
+            stop();
+        }
+        
+        /**
+         * Changes the number of threads used, including the calling thread. Must not be called while a loop is running.
+         */
+        void resize(blt::size_t thread_count);
+        
+        // number of threads work is split between, including the calling thread
+        [[nodiscard]] blt::size_t size() const
+        {
+            return workers.size() + 1;
+        }
+        
+        /**
+         * Calls task on every chunk of [0, count) and waits for all of them to finish.
+         */
+        void parallel_for(blt::size_t count, blt::size_t chunk_size, const task_t& task);
+    
+    private:
+        // [front, back) of the chunks a thread owns, packed so both ends can be updated with a single CAS.
+        struct alignas(64) queue_t
+        {
+            std::atomic<blt::u64> range{0};
+        };
+        
+        static blt::u64 pack(blt::u64 front, blt::u64 back)
+        {
+            return (back << 32) | front;
+        }
+        
+        // seen is the generation at the time the thread was created, anything newer is work to be done
+        void worker(blt::size_t thread, blt::u64 seen);
+        
+        void run(blt::size_t thread);
+        
+        bool pop(blt::size_t thread, blt::size_t& chunk);
+        
+        bool steal(blt::size_t victim, blt::size_t& chunk);
+        
+        void stop();
+        
+        std::vector<std::thread> workers;
+        std::unique_ptr<queue_t[]> queues;
+        
+        std::mutex mutex;
+        std::condition_variable start_cond;
+        std::condition_variable done_cond;
+        blt::u64 generation = 0;
+        blt::size_t running = 0;
+        bool stopping = false;
+        
+        const task_t* task = nullptr;
+        blt::size_t count = 0;
+        blt::size_t chunk_size = 1;
+};
+
+#endif //GRAPHS_THREAD_POOL_H
@@ -20,13 +20,15 @@
 #define GRAPHS_TOKENIZER_H
 
 #include <graph_base.h>
+#include <string>
+#include <string_view>
 #include <vector>
 
 namespace proc
 {
     enum class state_t
     {
-        NONE,           // Default state, no token found.
+        NONE,           // Default state, no token found. returned for anything which can't be tokenized
         SQUARE_OPEN,    // [
         SQUARE_CLOSE,   // ]
         CURLY_OPEN,     // {
@@ -45,6 +47,7 @@ namespace proc
         EQUAL,          // =
         COMMA,          // ,
         NEWLINE,        // \n
+        END,            // end of the input
     };
     
     struct token_t
@@ -53,7 +56,9 @@ namespace proc
         state_t token;
         // position inside file
         blt::size_t token_pos;
-        // all data associated with token. will contain all text if text or the token characters otherwise
+        // line the token starts on, starting from 1
+        blt::size_t line;
+        // all data associated with token. will contain all text if text (without the quotes) or the token characters otherwise
         std::string_view token_data;
     };
     
@@ -74,24 +79,42 @@ namespace proc
      *
      * // can't make the other kind but imagine it works
      * [[Edges]]
-     * jim, parker; brett, parker
+     * jim, parker; brett, parker # comments can follow an entry
      * brett, jim
      *
      * [[Descriptions]]
      * brett: me silly
      * parker: boyfriend <3
      * jim: parker's friend
+     *
+     * Block comments are written the C way as well. Comments and quotes only start at the beginning of a token, so parker's and a//b are a single identifier each.
+     * Quoted text can span lines and has no escapes, use the other kind of quote to put one inside of it.
      */
     
+    /**
+     * Splits the input into tokens without copying any of it, every token is a view into the input. Comments and whitespace other
+     * than newlines are skipped.
+     */
     class tokenizer
     {
         public:
+            // str has to outlive the tokenizer and every token it returns
             explicit tokenizer(std::string_view str): data(str)
             {}
             
-            explicit tokenizer(std::string&& str): data(std::move(str))
+            explicit tokenizer(std::string&& str): storage(std::move(str)), data(storage)
             {}
             
+            tokenizer(const tokenizer&) = delete;
+            
+            tokenizer& operator=(const tokenizer&) = delete;
+            
+            /**
+             * @return the next token, END once the input has run out
+             */
+            token_t next();
+            
+            // tokenizes everything which is left of the input
             const std::vector<token_t>& tokenize();
         
         private:
@@ -105,33 +128,30 @@ namespace proc
                 return data[current_pos++];
             }
             
-            bool has_next(blt::size_t size = 0)
+            [[nodiscard]] bool has_next(blt::size_t size = 0) const
             {
                 return (current_pos + size) < data.size();
             }
             
-            [[nodiscard]] bool is_digit(char c) const;
+            // characters which end an identifier or value
+            [[nodiscard]] static bool is_separator(char c);
             
-            void new_token()
-            {
-                if (state == state_t::NONE)
-                    return;
-                tokens.push_back({state, begin, {&data[begin], current_pos - begin}});
-                state = state_t::NONE;
-            }
+            // skips whitespace (but not newlines) and comments, false if a block comment is never closed
+            bool skip_ignored();
             
-            bool can_state(state_t s)
+            token_t make_token(state_t type, std::string_view token_data) const
             {
-                return s == state || state == state_t::NONE;
+                return {type, begin, begin_line, token_data};
             }
         
         private:
-            state_t state = state_t::NONE;
             blt::size_t current_pos = 0;
             blt::size_t line_number = 1;
             blt::size_t begin = current_pos;
+            blt::size_t begin_line = line_number;
             
-            std::string data;
+            std::string storage;
+            std::string_view data;
             
             std::vector<token_t> tokens;
     };
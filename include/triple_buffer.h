@@ -0,0 +1,76 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAPHS_TRIPLE_BUFFER_H
+#define GRAPHS_TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <blt/std/types.h>
+
+/**
+ * Lock free single producer / single consumer triple buffer.
+ *
+ * The writer fills back() and publishes it, the reader picks up whatever was published last with update() and reads front().
+ * Neither side ever waits on the other, the writer can publish as often as it likes and the reader only sees the newest value.
+ */
+template<typename T>
+class triple_buffer_t
+{
+    public:
+        // writer side, the buffer to fill before calling publish()
+        T& back()
+        {
+            return buffers[back_index];
+        }
+        
+        void publish()
+        {
+            back_index = middle.exchange(static_cast<blt::u8>(back_index | DIRTY), std::memory_order_acq_rel) & INDEX_MASK;
+        }
+        
+        /**
+         * reader side, swaps in the most recently published buffer
+         * @return false if nothing has been published since the last call, front() is unchanged
+         */
+        bool update()
+        {
+            if (!(middle.load(std::memory_order_relaxed) & DIRTY))
+                return false;
+            front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+        
+        const T& front() const
+        {
+            return buffers[front_index];
+        }
+    
+    private:
+        static constexpr blt::u8 DIRTY = 0b100;
+        static constexpr blt::u8 INDEX_MASK = 0b011;
+        
+        T buffers[3];
+        // owned by the reader
+        blt::u8 front_index = 0;
+        // index of the buffer which is neither being read nor written, with DIRTY set if it hasn't been read yet
+        alignas(64) std::atomic<blt::u8> middle{1};
+        // owned by the writer
+        alignas(64) blt::u8 back_index = 2;
+};
+
+#endif //GRAPHS_TRIPLE_BUFFER_H
@@ -0,0 +1,139 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAPHS_UNIFORM_GRID_H
+#define GRAPHS_UNIFORM_GRID_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <blt/std/types.h>
+#include <blt/std/hashmap.h>
+#include <blt/math/vectors.h>
+#include <graph_base.h>
+#include <force_algorithms.h>
+
+/**
+ * Cell list used for cutoff repulsion, nodes only repel the nodes in their own and the eight surrounding cells.
+ *
+ * Nodes are binned into square cells the size of the cutoff radius and copied out sorted by cell, so every cell is a contiguous
+ * block which can be handed straight to force_equation::rep_block. Only cells with nodes in them are stored (spatial hash), a spread
+ * out graph doesn't cost more memory than a tight one.
+ * The surrounding cells reach up to 2 * sqrt(2) radii away, so nodes are checked against the cutoff radius before being handed on.
+ */
+class uniform_grid_t
+{
+    public:
+        // nodes within the cutoff radius are gathered and handed to the equation this many at a time
+        static constexpr blt::size_t INTERACTION_BLOCK = 64;
+        // cells past this are clamped, keeps cx +- 1 from overflowing for far away (or infinite) positions
+        static constexpr float MAX_CELL = static_cast<float>(1 << 30);
+        
+        void build(const node_state_t& nodes, float cell_size);
+        
+        /**
+         * @return the repulsive force acting on node from every node in the surrounding cells
+         */
+        template<typename EQUATION>
+        [[nodiscard]] blt::vec2 repulsion(const EQUATION& equation, const particle_t& node) const;
+        
+        void clear()
+        {
+            cells.clear();
+            x.clear();
+            y.clear();
+            repulsiveness.clear();
+            mass.clear();
+        }
+    
+    private:
+        struct cell_range_t
+        {
+            blt::u32 begin = 0, end = 0;
+        };
+        
+        [[nodiscard]] blt::i32 cell_of(float v) const
+        {
+            const auto cell = std::floor(v * inv_cell_size);
+            // a NaN position has no cell, it's binned into the origin so the cast stays defined
+            if (std::isnan(cell))
+                return 0;
+            return static_cast<blt::i32>(std::clamp(cell, -MAX_CELL, MAX_CELL));
+        }
+        
+        static blt::u64 make_key(blt::i32 cx, blt::i32 cy)
+        {
+            return (static_cast<blt::u64>(static_cast<blt::u32>(cx)) << 32) | static_cast<blt::u32>(cy);
+        }
+        
+        float cell_size = 1;
+        float inv_cell_size = 1;
+        float cutoff_sq = 1;
+        blt::hashmap_t<blt::u64, cell_range_t> cells;
+        // node data sorted by cell
+        std::vector<float> x, y;
+        std::vector<float> repulsiveness;
+        std::vector<float> mass;
+        // scratch space for build(), kept to avoid reallocating every step
+        std::vector<std::pair<blt::u64, blt::u32>> keys;
+};
+
+// defined here so it is compiled for the concrete equation type of the step calling it, see simulation_t::step_with()
+template<typename EQUATION>
+blt::vec2 uniform_grid_t::repulsion(const EQUATION& equation, const particle_t& node) const
+{
+    blt::vec2 force;
+    const auto px = node.pos.x();
+    const auto py = node.pos.y();
+    const auto cx = cell_of(px);
+    const auto cy = cell_of(py);
+    
+    float block_x[INTERACTION_BLOCK], block_y[INTERACTION_BLOCK], block_rep[INTERACTION_BLOCK], block_mass[INTERACTION_BLOCK];
+    blt::size_t count = 0;
+    for (blt::i32 oy = -1; oy <= 1; oy++)
+    {
+        for (blt::i32 ox = -1; ox <= 1; ox++)
+        {
+            const auto itr = cells.find(make_key(cx + ox, cy + oy));
+            if (itr == cells.end())
+                continue;
+            const auto [begin, end] = itr->second;
+            for (blt::u32 i = begin; i < end; i++)
+            {
+                const auto dx = x[i] - px;
+                const auto dy = y[i] - py;
+                if (dx * dx + dy * dy >= cutoff_sq)
+                    continue;
+                block_x[count] = x[i];
+                block_y[count] = y[i];
+                block_rep[count] = repulsiveness[i];
+                block_mass[count] = mass[i];
+                if (++count == INTERACTION_BLOCK)
+                {
+                    force += equation.rep_block(node, {block_x, block_y, block_rep, block_mass, count});
+                    count = 0;
+                }
+            }
+        }
+    }
+    if (count > 0)
+        force += equation.rep_block(node, {block_x, block_y, block_rep, block_mass, count});
+    return force;
+}
+
+#endif //GRAPHS_UNIFORM_GRID_H
@@ -0,0 +1,208 @@
+#pragma once
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GRAPHS_VIEW_GRID_H
+#define GRAPHS_VIEW_GRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <blt/std/types.h>
+#include <blt/std/hashmap.h>
+#include <blt/math/vectors.h>
+#include <graph_base.h>
+
+/**
+ * Grid over the whole layout used to find what is inside the view without walking every node and edge.
+ *
+ * Nodes and edges are counting sorted into flat per cell lists (the same layout as adjacency_t), cells are sized to hold a few nodes
+ * each on average. Edges are listed in every cell their bounding box touches, edges covering more than conf::VIEW_GRID_MAX_EDGE_CELLS
+ * cells are kept on a list of their own which every query returns. Queries only narrow things down, anything returned can still be
+ * outside of the area.
+ *
+ * The grid is loose, nodes which move stay in the cell they were binned into and queries are padded by the furthest any of them has
+ * moved since (the drift). It is only built again once that reaches a cell, so a running simulation costs a pass over the positions
+ * per update instead of a rebuild. An edge's bounding box can't have moved further than its nodes, so the same padding covers them.
+ */
+class view_grid_t
+{
+    public:
+        void build(const node_state_t& nodes, const std::vector<edge_t>& edges);
+        
+        /**
+         * Catches up with nodes which moved since the grid was built, building it again if any of them moved further than a cell.
+         * @param edges the same edges the grid was built with, only used if it has to be built again
+         * @return true if the grid was built again
+         */
+        bool refresh(const node_state_t& nodes, const std::vector<edge_t>& edges);
+        
+        /**
+         * Catches up with a single node being moved without going over the rest.
+         * @return false if it moved further than a cell, the grid then has to be refreshed before the next query
+         */
+        bool moved(blt::u64 index, const blt::vec2& pos)
+        {
+            if (index >= binned_x.size())
+                return false;
+            const auto dx = pos.x() - binned_x[index];
+            const auto dy = pos.y() - binned_y[index];
+            const auto moved_sq = dx * dx + dy * dy;
+            if (!(moved_sq < cell_size * cell_size))
+                return false;
+            drift = std::max(drift, std::sqrt(moved_sq));
+            return true;
+        }
+        
+        // calls func with the index of every node which could be inside area
+        template<typename FUNC>
+        void for_nodes(const view_rect_t& area, FUNC&& func) const
+        {
+            if (columns == 0)
+                return;
+            const auto padded = area.expand(drift);
+            const auto [x0, y0] = cell_of(padded.min);
+            const auto [x1, y1] = cell_of(padded.max);
+            for (auto cy = y0; cy <= y1; cy++)
+            {
+                for (auto cx = x0; cx <= x1; cx++)
+                {
+                    const auto cell = cy * columns + cx;
+                    for (auto i = node_offsets[cell]; i < node_offsets[cell + 1]; i++)
+                        func(node_list[i]);
+                }
+            }
+        }
+        
+        // calls func once with the index (into the edge list given to build) of every edge which could be inside area
+        template<typename FUNC>
+        void for_edges(const view_rect_t& area, FUNC&& func)
+        {
+            if (columns == 0)
+                return;
+            // edges are listed in more than one cell, stamping them with the query keeps any from being returned twice
+            if (++query == 0)
+            {
+                std::fill(edge_seen.begin(), edge_seen.end(), 0);
+                query = 1;
+            }
+            const auto padded = area.expand(drift);
+            const auto [x0, y0] = cell_of(padded.min);
+            const auto [x1, y1] = cell_of(padded.max);
+            for (auto cy = y0; cy <= y1; cy++)
+            {
+                for (auto cx = x0; cx <= x1; cx++)
+                {
+                    const auto cell = cy * columns + cx;
+                    for (auto i = edge_offsets[cell]; i < edge_offsets[cell + 1]; i++)
+                    {
+                        const auto edge = edge_list[i];
+                        if (edge_seen[edge] == query)
+                            continue;
+                        edge_seen[edge] = query;
+                        func(edge);
+                    }
+                }
+            }
+            for (const auto edge : long_edges)
+                func(edge);
+        }
+    
+    private:
+        struct cell_t
+        {
+            blt::u32 x, y;
+        };
+        
+        // clamped to the grid, anything outside of the layout (or not a number) is in the closest cell along the border
+        [[nodiscard]] cell_t cell_of(const blt::vec2& pos) const
+        {
+            return {clamp_cell((pos.x() - origin.x()) * inv_cell_size, columns), clamp_cell((pos.y() - origin.y()) * inv_cell_size, rows)};
+        }
+        
+        static blt::u32 clamp_cell(float v, blt::u32 count)
+        {
+            // written so NaN fails the first check, casting it (or anything out of range) to an integer is undefined
+            if (!(v >= 1))
+                return 0;
+            if (v >= static_cast<float>(count - 1))
+                return count - 1;
+            return static_cast<blt::u32>(v);
+        }
+        
+        blt::vec2 origin;
+        float cell_size = 1;
+        float inv_cell_size = 1;
+        blt::u32 columns = 0, rows = 0;
+        // furthest any node is from where it was binned
+        float drift = 0;
+        // positions the nodes were binned at
+        std::vector<float> binned_x, binned_y;
+        
+        // nodes / edges of cell i are list[offsets[i], offsets[i + 1])
+        std::vector<blt::u32> node_offsets, node_list;
+        std::vector<blt::u32> edge_offsets, edge_list;
+        std::vector<blt::u32> long_edges;
+        
+        std::vector<blt::u32> edge_seen;
+        blt::u32 query = 0;
+};
+
+/**
+ * Thins out things too small to make out, only the first thing to land in each square of the screen is drawn.
+ */
+class lod_filter_t
+{
+    public:
+        // cell_pixels is the size of a square on screen
+        void begin(const view_rect_t& view, float cell_pixels);
+        
+        // true if pos is the first point in its square since begin()
+        bool claim(const blt::vec2& pos);
+        
+        // true if this is the first line between the squares of p1 and p2 since begin()
+        bool claim(const blt::vec2& p1, const blt::vec2& p2);
+    
+    private:
+        // squares counted from the corner of the view, lines can reach far past it so they are clamped well outside of it instead
+        [[nodiscard]] blt::i32 square_of(float v, float origin) const
+        {
+            constexpr float limit = 1 << 30;
+            const auto square = std::floor((v - origin) * inv_cell_size);
+            // NaN fails every comparison, it ends up in square 0 with everything else that can't be placed
+            if (!(square > -limit))
+                return square < 0 ? -static_cast<blt::i32>(limit) : 0;
+            return static_cast<blt::i32>(std::min(square, limit));
+        }
+        
+        [[nodiscard]] blt::u64 key_of(const blt::vec2& pos) const
+        {
+            const auto x = square_of(pos.x(), origin.x());
+            const auto y = square_of(pos.y(), origin.y());
+            return (static_cast<blt::u64>(static_cast<blt::u32>(x)) << 32) | static_cast<blt::u32>(y);
+        }
+        
+        blt::vec2 origin;
+        float inv_cell_size = 1;
+        // one flag per square of the view, points are only claimed once they overlap it so the border squares take the rest
+        blt::u32 columns = 0, rows = 0;
+        std::vector<bool> points;
+        blt::hashset_t<blt::u64> lines;
+};
+
+#endif //GRAPHS_VIEW_GRID_H
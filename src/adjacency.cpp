@@ -0,0 +1,55 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <adjacency.h>
+
+void adjacency_t::build(blt::size_t node_count, const edge_table_t& edge_set)
+{
+    edges.clear();
+    edges.reserve(edge_set.size());
+    offsets.assign(node_count + 1, 0);
+    
+    // count the degree of every node, shifted by one so the prefix sum turns it into the row offsets
+    for (const auto& edge : edge_set)
+    {
+        if (edge.getFirst() >= node_count || edge.getSecond() >= node_count)
+        {
+            BLT_WARN("Edge Error %ld %ld %ld", edge.getFirst(), edge.getSecond(), node_count);
+            continue;
+        }
+        offsets[edge.getFirst() + 1]++;
+        offsets[edge.getSecond() + 1]++;
+        edges.push_back(edge);
+    }
+    for (blt::size_t i = 1; i < offsets.size(); i++)
+        offsets[i] += offsets[i - 1];
+    
+    neighbour_list.resize(offsets.back());
+    edge_indices.resize(offsets.back());
+    
+    std::vector<blt::u32> cursor{offsets.begin(), offsets.end() - 1};
+    for (blt::size_t i = 0; i < edges.size(); i++)
+    {
+        const auto first = edges[i].getFirst();
+        const auto second = edges[i].getSecond();
+        
+        neighbour_list[cursor[first]] = static_cast<blt::u32>(second);
+        edge_indices[cursor[first]++] = static_cast<blt::u32>(i);
+        
+        neighbour_list[cursor[second]] = static_cast<blt::u32>(first);
+        edge_indices[cursor[second]++] = static_cast<blt::u32>(i);
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <barnes_hut.h>
+#include <algorithm>
+#include <limits>
+
+void barnes_hut_t::build(const node_state_t& nodes)
+{
+    clear();
+    if (nodes.empty())
+        return;
+    
+    blt::vec2 min{std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    blt::vec2 max{std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    
+    positions.reserve(nodes.size());
+    indices.reserve(nodes.size());
+    for (blt::size_t i = 0; i < nodes.size(); i++)
+    {
+        const auto pos = nodes.getPosition(i);
+        min = {std::min(min.x(), pos.x()), std::min(min.y(), pos.y())};
+        max = {std::max(max.x(), pos.x()), std::max(max.y(), pos.y())};
+        indices.push_back(static_cast<blt::u32>(i));
+        positions.push_back(pos);
+    }
+    repulsiveness = nodes.repulsiveness;
+    mass = nodes.mass;
+    
+    // cells have to be square otherwise the opening angle doesn't mean anything
+    const auto size = std::max(std::max(max.x() - min.x(), max.y() - min.y()), 1.0f);
+    // the tree has roughly 4/3 * n cells once every node is in its own leaf
+    cells.reserve(nodes.size() * 2 + 1);
+    cells.emplace_back();
+    build_cell(0, 0, static_cast<blt::u32>(indices.size()), min, size, 0);
+}
+
+void barnes_hut_t::build_cell(blt::u32 cell, blt::u32 begin, blt::u32 end, const blt::vec2& min, float size, blt::u32 depth)
+{
+    cell_t c;
+    c.min = min;
+    c.size = size;
+    c.begin = begin;
+    c.end = end;
+    c.count = end - begin;
+    if (c.count > 0)
+    {
+        for (blt::u32 i = begin; i < end; i++)
+        {
+            c.center += positions[indices[i]] * mass[indices[i]];
+            c.repulsiveness += repulsiveness[indices[i]];
+            c.mass += mass[indices[i]];
+        }
+        c.center = c.mass == 0 ? positions[indices[begin]] : c.center / c.mass;
+        c.repulsiveness /= static_cast<float>(c.count);
+    }
+    
+    if (c.count <= 1 || depth >= MAX_DEPTH)
+    {
+        cells[cell] = c;
+        return;
+    }
+    
+    const auto half = size / 2.0f;
+    const blt::vec2 mid{min.x() + half, min.y() + half};
+    
+    auto* first = indices.data() + begin;
+    auto* last = indices.data() + end;
+    auto* split_y = std::partition(first, last, [this, &mid](blt::u32 i) { return positions[i].y() < mid.y(); });
+    auto* split_low = std::partition(first, split_y, [this, &mid](blt::u32 i) { return positions[i].x() < mid.x(); });
+    auto* split_high = std::partition(split_y, last, [this, &mid](blt::u32 i) { return positions[i].x() < mid.x(); });
+    
+    const auto y = static_cast<blt::u32>(split_y - indices.data());
+    const auto low = static_cast<blt::u32>(split_low - indices.data());
+    const auto high = static_cast<blt::u32>(split_high - indices.data());
+    
+    // children are allocated before recursing, cells may reallocate so don't hold references over this.
+    c.first_child = static_cast<blt::u32>(cells.size());
+    cells[cell] = c;
+    cells.resize(cells.size() + 4);
+    
+    build_cell(c.first_child + 0, begin, low, min, half, depth + 1);
+    build_cell(c.first_child + 1, low, y, {mid.x(), min.y()}, half, depth + 1);
+    build_cell(c.first_child + 2, y, high, {min.x(), mid.y()}, half, depth + 1);
+    build_cell(c.first_child + 3, high, end, mid, half, depth + 1);
+}
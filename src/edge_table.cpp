@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <edge_table.h>
+#include <algorithm>
+
+bool edge_table_t::insert(edge_t edge)
+{
+    if ((edge_list.size() + 1) * 2 > slots.size())
+        rehash(std::max(slots.size() * 2, MIN_SLOTS));
+    const auto key = edge.key();
+    auto& slot = slots[find_slot(key)];
+    if (slot.key != EMPTY)
+        return false;
+    slot = {key, edge_list.size()};
+    edge_list.push_back(std::move(edge));
+    return true;
+}
+
+bool edge_table_t::erase(blt::u64 n1, blt::u64 n2)
+{
+    if (slots.empty())
+        return false;
+    auto hole = find_slot(edge_key(n1, n2));
+    if (slots[hole].key == EMPTY)
+        return false;
+    const auto index = slots[hole].index;
+    
+    // no tombstones, later keys of the same probe run are shifted back into the hole so lookups can still stop at the first empty slot.
+    // a key can only move back if that doesn't put it in front of the slot it hashes to
+    const auto mask = slots.size() - 1;
+    for (auto next = (hole + 1) & mask; slots[next].key != EMPTY; next = (next + 1) & mask)
+    {
+        const auto home = hash(slots[next].key) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+    }
+    slots[hole].key = EMPTY;
+    
+    if (index != edge_list.size() - 1)
+    {
+        edge_list[index] = std::move(edge_list.back());
+        slots[find_slot(edge_list[index].key())].index = index;
+    }
+    edge_list.pop_back();
+    return true;
+}
+
+void edge_table_t::reserve(blt::size_t count)
+{
+    edge_list.reserve(count);
+    auto capacity = MIN_SLOTS;
+    while (capacity < count * 2)
+        capacity *= 2;
+    if (capacity > slots.size())
+        rehash(capacity);
+}
+
+void edge_table_t::rehash(blt::size_t capacity)
+{
+    slots.assign(capacity, {EMPTY, 0});
+    for (blt::size_t i = 0; i < edge_list.size(); i++)
+        slots[find_slot(edge_list[i].key())] = {edge_list[i].key(), i};
+}
@@ -15,15 +15,7 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <force_algorithms.h>
-#include <blt/std/utility.h>
-
-/**
- * Function for mixing between two points
- */
-BLT_ATTRIB_NO_SIDE_EFFECTS inline float mix(const float v1, const float v2)
-{
-    return (v1 + v2) / 2.0f;
-}
+#include <force_kernels.h>
 
 /**
  * --------------------------------------------------------
@@ -31,69 +23,61 @@ BLT_ATTRIB_NO_SIDE_EFFECTS inline float mix(const float v1, const float v2)
  * --------------------------------------------------------
  */
 
-force_equation::equation_data force_equation::calc_data(const std::pair<blt::size_t, node_t>& v1, const std::pair<blt::size_t, node_t>& v2)
+blt::vec2 force_equation::rep_block(const particle_t& v1, const particle_block_t& block) const
 {
-    auto dir = dir_v(v1, v2);
-    auto dir2 = dir_v(v2, v1);
-    auto mag = dir.magnitude();
-    auto mag2 = dir2.magnitude();
-    auto unit = mag == 0 ? blt::vec2() : dir / mag;
-    auto unit_inv = mag2 == 0 ? blt::vec2() : dir2 / mag2;
-    auto mag_sq = mag * mag;
-    return {unit, unit_inv, mag, mag_sq};
+    blt::vec2 force;
+    for (blt::size_t i = 0; i < block.count; i++)
+    {
+        const particle_t v2{{block.x[i], block.y[i]}, block.repulsiveness[i], block.mass[i]};
+        if (v2.pos.x() == v1.pos.x() && v2.pos.y() == v1.pos.y())
+            continue;
+        force += rep(v1, v2);
+    }
+    return force;
 }
 
-void force_equation::draw_inputs_base()
+#ifndef GRAPHS_HEADLESS
+
+bool force_equation::draw_inputs_base()
 {
     namespace im = ImGui;
-    im::SliderFloat("Initial Temperature", &initial_temperature, 1, 100);
-    im::SliderFloat("Cooling Rate", &cooling_rate, 0, 0.999999, "%.6f");
-    im::InputFloat("Min Cooling", &min_cooling, 0.5, 1);
+    bool changed = false;
+    changed |= im::SliderFloat("Initial Temperature", &initial_temperature, 1, 100);
+    changed |= im::SliderFloat("Cooling Rate", &cooling_rate, 0, 0.999999, "%.6f");
+    changed |= im::InputFloat("Min Cooling", &min_cooling, 0.5, 1);
+    return changed;
 }
 
+#endif
+
 /**
  * --------------------------------------------------------
  *                      Eades_equation
  * --------------------------------------------------------
  */
 
-blt::vec2 Eades_equation::attr(const std::pair<blt::size_t, node_t>& v1, const std::pair<blt::size_t, node_t>& v2, const edge_t& edge) const
+blt::vec2 Eades_equation::rep_block(const particle_t& v1, const particle_block_t& block) const
 {
-    auto data = calc_data(v1, v2);
-    return (spring_constant * std::log(data.mag / edge.ideal_spring_length) * data.unit) - rep(v1, v2);
+    return kernels::eades_rep_block(v1, block);
 }
 
-blt::vec2 Eades_equation::rep(const std::pair<blt::size_t, node_t>& v1, const std::pair<blt::size_t, node_t>& v2) const
-{
-    auto data = calc_data(v1, v2);
-    // scaling factor included because of the scales this algorithm is working on (large viewport)
-    auto scale = (mix(v1.second.repulsiveness, v2.second.repulsiveness) * 10000) / data.mag_sq;
-    return scale * data.unit_inv;
-}
+#ifndef GRAPHS_HEADLESS
 
-void Eades_equation::draw_inputs()
+bool Eades_equation::draw_inputs()
 {
     namespace im = ImGui;
-    im::InputFloat("Spring Constant", &spring_constant, 0.25, 10);
+    return im::InputFloat("Spring Constant", &spring_constant, 0.25, 10);
 }
 
+#endif
+
 /**
  * --------------------------------------------------------
  *              Fruchterman_Reingold_equation
  * --------------------------------------------------------
  */
 
-blt::vec2 Fruchterman_Reingold_equation::attr(const std::pair<blt::size_t, node_t>& v1, const std::pair<blt::size_t, node_t>& v2, const edge_t& edge) const
+blt::vec2 Fruchterman_Reingold_equation::rep_block(const particle_t& v1, const particle_block_t& block) const
 {
-    auto data = calc_data(v1, v2);
-    float scale = data.mag_sq / edge.ideal_spring_length;
-    return (scale * data.unit);
+    return kernels::fruchterman_reingold_rep_block(v1, block, conf::DEFAULT_SPRING_LENGTH);
 }
-
-blt::vec2 Fruchterman_Reingold_equation::rep(const std::pair<blt::size_t, node_t>& v1, const std::pair<blt::size_t, node_t>& v2) const
-{
-    auto data = calc_data(v1, v2);
-    const auto ideal_spring_length = conf::DEFAULT_SPRING_LENGTH;
-    float scale = (ideal_spring_length * ideal_spring_length) / data.mag;
-    return scale * data.unit_inv;
-}
\ No newline at end of file
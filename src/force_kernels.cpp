@@ -0,0 +1,257 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <force_kernels.h>
+#include <atomic>
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(__EMSCRIPTEN__) && (defined(__GNUC__) || defined(__clang__))
+    #define GRAPHS_SIMD_X86
+    #include <immintrin.h>
+#endif
+
+namespace kernels
+{
+    namespace
+    {
+        enum class equation_t
+        {
+            EADES,
+            FRUCHTERMAN_REINGOLD
+        };
+        
+        /*
+         * Both equations come down to force -= scale * dir with dir = other - v1:
+         *  Eades: scale = (r1 + r2) / 2 * 10000 * m2 / |dir|^3
+         *  F&R:   scale = L^2 * m2 / |dir|^2
+         * coefficient is the constant part, 5000 for Eades and L^2 for F&R.
+         */
+        template<equation_t EQUATION>
+        blt::vec2 rep_scalar(const particle_t& v1, const particle_block_t& block, float coefficient)
+        {
+            float fx = 0, fy = 0;
+            for (blt::size_t i = 0; i < block.count; i++)
+            {
+                const float dx = block.x[i] - v1.pos.x();
+                const float dy = block.y[i] - v1.pos.y();
+                const float mag_sq = dx * dx + dy * dy;
+                if (mag_sq == 0)
+                    continue;
+                float scale;
+                if constexpr (EQUATION == equation_t::EADES)
+                    scale = coefficient * (v1.repulsiveness + block.repulsiveness[i]) * block.mass[i] / (mag_sq * std::sqrt(mag_sq));
+                else
+                    scale = coefficient * block.mass[i] / mag_sq;
+                fx -= scale * dx;
+                fy -= scale * dy;
+            }
+            return {fx, fy};
+        }
+
+#ifdef GRAPHS_SIMD_X86
+        
+        template<equation_t EQUATION>
+        __attribute__((target("sse2"))) blt::vec2 rep_sse(const particle_t& v1, const particle_block_t& block, float coefficient)
+        {
+            const __m128 px = _mm_set1_ps(v1.pos.x());
+            const __m128 py = _mm_set1_ps(v1.pos.y());
+            const __m128 pr = _mm_set1_ps(v1.repulsiveness);
+            const __m128 coef = _mm_set1_ps(coefficient);
+            const __m128 zero = _mm_setzero_ps();
+            __m128 fx = zero, fy = zero;
+            
+            blt::size_t i = 0;
+            for (; i + 4 <= block.count; i += 4)
+            {
+                const __m128 dx = _mm_sub_ps(_mm_loadu_ps(block.x + i), px);
+                const __m128 dy = _mm_sub_ps(_mm_loadu_ps(block.y + i), py);
+                const __m128 mag_sq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+                __m128 scale = _mm_mul_ps(coef, _mm_loadu_ps(block.mass + i));
+                __m128 denominator = mag_sq;
+                if constexpr (EQUATION == equation_t::EADES)
+                {
+                    scale = _mm_mul_ps(scale, _mm_add_ps(pr, _mm_loadu_ps(block.repulsiveness + i)));
+                    denominator = _mm_mul_ps(mag_sq, _mm_sqrt_ps(mag_sq));
+                }
+                // lanes on top of v1 divide by zero, the mask throws them away
+                scale = _mm_and_ps(_mm_div_ps(scale, denominator), _mm_cmpgt_ps(mag_sq, zero));
+                fx = _mm_sub_ps(fx, _mm_mul_ps(scale, dx));
+                fy = _mm_sub_ps(fy, _mm_mul_ps(scale, dy));
+            }
+            
+            alignas(16) float sx[4], sy[4];
+            _mm_store_ps(sx, fx);
+            _mm_store_ps(sy, fy);
+            const auto tail = rep_scalar<EQUATION>(v1, {block.x + i, block.y + i, block.repulsiveness + i, block.mass + i, block.count - i},
+                                                   coefficient);
+            return blt::vec2{sx[0] + sx[1] + sx[2] + sx[3], sy[0] + sy[1] + sy[2] + sy[3]} + tail;
+        }
+        
+        template<equation_t EQUATION>
+        __attribute__((target("avx2,fma"))) blt::vec2 rep_avx2(const particle_t& v1, const particle_block_t& block, float coefficient)
+        {
+            const __m256 px = _mm256_set1_ps(v1.pos.x());
+            const __m256 py = _mm256_set1_ps(v1.pos.y());
+            const __m256 pr = _mm256_set1_ps(v1.repulsiveness);
+            const __m256 coef = _mm256_set1_ps(coefficient);
+            const __m256 zero = _mm256_setzero_ps();
+            __m256 fx = zero, fy = zero;
+            
+            blt::size_t i = 0;
+            for (; i + 8 <= block.count; i += 8)
+            {
+                const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(block.x + i), px);
+                const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(block.y + i), py);
+                const __m256 mag_sq = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+                __m256 scale = _mm256_mul_ps(coef, _mm256_loadu_ps(block.mass + i));
+                __m256 denominator = mag_sq;
+                if constexpr (EQUATION == equation_t::EADES)
+                {
+                    scale = _mm256_mul_ps(scale, _mm256_add_ps(pr, _mm256_loadu_ps(block.repulsiveness + i)));
+                    denominator = _mm256_mul_ps(mag_sq, _mm256_sqrt_ps(mag_sq));
+                }
+                scale = _mm256_and_ps(_mm256_div_ps(scale, denominator), _mm256_cmp_ps(mag_sq, zero, _CMP_GT_OQ));
+                fx = _mm256_fnmadd_ps(scale, dx, fx);
+                fy = _mm256_fnmadd_ps(scale, dy, fy);
+            }
+            
+            alignas(32) float sx[8], sy[8];
+            _mm256_store_ps(sx, fx);
+            _mm256_store_ps(sy, fy);
+            auto force = rep_scalar<EQUATION>(v1, {block.x + i, block.y + i, block.repulsiveness + i, block.mass + i, block.count - i},
+                                              coefficient);
+            for (blt::size_t j = 0; j < 8; j++)
+                force += blt::vec2{sx[j], sy[j]};
+            return force;
+        }
+        
+        template<equation_t EQUATION>
+        __attribute__((target("avx512f"))) blt::vec2 rep_avx512(const particle_t& v1, const particle_block_t& block, float coefficient)
+        {
+            const __m512 px = _mm512_set1_ps(v1.pos.x());
+            const __m512 py = _mm512_set1_ps(v1.pos.y());
+            const __m512 pr = _mm512_set1_ps(v1.repulsiveness);
+            const __m512 coef = _mm512_set1_ps(coefficient);
+            const __m512 zero = _mm512_setzero_ps();
+            __m512 fx = zero, fy = zero;
+            
+            // the tail is handled with masked loads instead of a scalar loop
+            for (blt::size_t i = 0; i < block.count; i += 16)
+            {
+                const auto remaining = block.count - i;
+                const __mmask16 lanes = remaining >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << remaining) - 1);
+                const __m512 dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, block.x + i), px);
+                const __m512 dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, block.y + i), py);
+                const __m512 mag_sq = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+                __m512 scale = _mm512_mul_ps(coef, _mm512_maskz_loadu_ps(lanes, block.mass + i));
+                __m512 denominator = mag_sq;
+                if constexpr (EQUATION == equation_t::EADES)
+                {
+                    scale = _mm512_mul_ps(scale, _mm512_add_ps(pr, _mm512_maskz_loadu_ps(lanes, block.repulsiveness + i)));
+                    denominator = _mm512_mul_ps(mag_sq, _mm512_maskz_sqrt_ps(lanes, mag_sq));
+                }
+                const __mmask16 valid = _mm512_mask_cmp_ps_mask(lanes, mag_sq, zero, _CMP_GT_OQ);
+                scale = _mm512_maskz_div_ps(valid, scale, denominator);
+                fx = _mm512_fnmadd_ps(scale, dx, fx);
+                fy = _mm512_fnmadd_ps(scale, dy, fy);
+            }
+            
+            alignas(64) float sx[16], sy[16];
+            _mm512_store_ps(sx, fx);
+            _mm512_store_ps(sy, fy);
+            blt::vec2 force;
+            for (blt::size_t j = 0; j < 16; j++)
+                force += blt::vec2{sx[j], sy[j]};
+            return force;
+        }
+
+#endif
+        
+        using kernel_t = blt::vec2 (*)(const particle_t&, const particle_block_t&, float);
+        
+        struct kernel_table_t
+        {
+            simd_level_t level;
+            const char* name;
+            kernel_t eades;
+            kernel_t fruchterman_reingold;
+        };
+        
+        const kernel_table_t tables[] = {
+                {simd_level_t::SCALAR, "Scalar",  rep_scalar<equation_t::EADES>, rep_scalar<equation_t::FRUCHTERMAN_REINGOLD>},
+#ifdef GRAPHS_SIMD_X86
+                {simd_level_t::SSE,    "SSE",     rep_sse<equation_t::EADES>,    rep_sse<equation_t::FRUCHTERMAN_REINGOLD>},
+                {simd_level_t::AVX2,   "AVX2",    rep_avx2<equation_t::EADES>,   rep_avx2<equation_t::FRUCHTERMAN_REINGOLD>},
+                {simd_level_t::AVX512, "AVX-512", rep_avx512<equation_t::EADES>, rep_avx512<equation_t::FRUCHTERMAN_REINGOLD>},
+#endif
+        };
+        
+        simd_level_t detect_simd_level()
+        {
+#ifdef GRAPHS_SIMD_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f"))
+                return simd_level_t::AVX512;
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                return simd_level_t::AVX2;
+            if (__builtin_cpu_supports("sse2"))
+                return simd_level_t::SSE;
+#endif
+            return simd_level_t::SCALAR;
+        }
+        
+        const kernel_table_t* find_table(simd_level_t level)
+        {
+            const kernel_table_t* best = &tables[0];
+            for (const auto& table : tables)
+            {
+                if (table.level <= level)
+                    best = &table;
+            }
+            return best;
+        }
+        
+        const simd_level_t max_level = detect_simd_level();
+        
+        // swapped by setSimdLevel() while the simulation thread might be using the kernels
+        std::atomic<const kernel_table_t*> current = find_table(max_level);
+    }
+    
+    simd_level_t getSimdLevel()
+    {
+        return current.load(std::memory_order_relaxed)->level;
+    }
+    
+    const char* getSimdLevelName()
+    {
+        return current.load(std::memory_order_relaxed)->name;
+    }
+    
+    void setSimdLevel(simd_level_t level)
+    {
+        current.store(find_table(std::min(level, max_level)), std::memory_order_relaxed);
+    }
+    
+    blt::vec2 eades_rep_block(const particle_t& v1, const particle_block_t& block)
+    {
+        return current.load(std::memory_order_relaxed)->eades(v1, block, 5000.0f);
+    }
+    
+    blt::vec2 fruchterman_reingold_rep_block(const particle_t& v1, const particle_block_t& block, float ideal_spring_length)
+    {
+        return current.load(std::memory_order_relaxed)->fruchterman_reingold(v1, block, ideal_spring_length * ideal_spring_length);
+    }
+}
@@ -0,0 +1,228 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <generators.h>
+#include <graph.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <blt/std/time.h>
+
+namespace
+{
+    struct area_t
+    {
+        blt::vec2 min;
+        blt::vec2 size;
+    };
+    
+    // one node per cell of a grid with at least count cells, the cells used are picked with a partial Fisher-Yates shuffle
+    void place_nodes(graph_batch_t& batch, random_t& rng, blt::u64 count, const area_t& area, std::vector<blt::vec2>& positions)
+    {
+        const double cell = std::sqrt(static_cast<double>(area.size.x()) * area.size.y() / static_cast<double>(count));
+        const auto columns = std::max(static_cast<blt::u64>(std::ceil(area.size.x() / cell)), static_cast<blt::u64>(1));
+        const auto rows = (count + columns - 1) / columns;
+        const auto cell_width = area.size.x() / static_cast<float>(columns);
+        const auto cell_height = area.size.y() / static_cast<float>(rows);
+        
+        std::vector<blt::u32> cells(columns * rows);
+        std::iota(cells.begin(), cells.end(), 0);
+        positions.resize(count);
+        for (blt::u64 i = 0; i < count; i++)
+        {
+            std::swap(cells[i], cells[i + rng.below(cells.size() - i)]);
+            const auto column = cells[i] % columns;
+            const auto row = cells[i] / columns;
+            positions[i] = area.min + blt::vec2{(static_cast<float>(column) + static_cast<float>(rng.uniform())) * cell_width,
+                                                (static_cast<float>(row) + static_cast<float>(rng.uniform())) * cell_height};
+            batch.add_node(positions[i], node_t());
+        }
+    }
+    
+    /**
+     * Instead of rolling for every one of the n(n - 1) / 2 pairs, the gap to the next edge is drawn from the geometric distribution
+     * and the pairs in between are skipped over. Batagelj and Brandes, "Efficient generation of large random networks".
+     */
+    void connect_random(graph_batch_t& batch, random_t& rng, blt::u64 base, blt::u64 count, double p)
+    {
+        if (p <= 0)
+            return;
+        const auto log_q = std::log(1.0 - std::min(p, 1.0));
+        blt::u64 v = 1;
+        blt::i64 w = -1;
+        while (v < count)
+        {
+            // p == 1 gives log_q = -inf, every gap is zero
+            w += 1 + (p >= 1 ? 0 : static_cast<blt::i64>(std::floor(std::log(1.0 - rng.uniform()) / log_q)));
+            while (w >= static_cast<blt::i64>(v) && v < count)
+            {
+                w -= static_cast<blt::i64>(v);
+                v++;
+            }
+            if (v < count)
+                batch.connect(base + v, base + static_cast<blt::u64>(w));
+        }
+    }
+    
+    /**
+     * Starts from a clique of attachments + 1 nodes, every node after it picks attachments distinct nodes to connect to. Picking a
+     * random end of a random edge picks a node with a chance proportional to its degree, so the ends of every edge so far are kept in
+     * a list.
+     */
+    void connect_preferential(graph_batch_t& batch, random_t& rng, blt::u64 base, blt::u64 count, blt::u64 attachments)
+    {
+        attachments = std::min(attachments, count - 1);
+        std::vector<blt::u64> ends;
+        ends.reserve(count * attachments * 2);
+        for (blt::u64 i = 0; i <= attachments; i++)
+        {
+            for (blt::u64 j = 0; j < i; j++)
+            {
+                batch.connect(base + i, base + j);
+                ends.push_back(i);
+                ends.push_back(j);
+            }
+        }
+        
+        std::vector<blt::u64> targets;
+        for (blt::u64 node = attachments + 1; node < count; node++)
+        {
+            targets.clear();
+            while (targets.size() < attachments)
+            {
+                const auto target = ends[rng.below(ends.size())];
+                if (std::find(targets.begin(), targets.end(), target) == targets.end())
+                    targets.push_back(target);
+            }
+            for (const auto target : targets)
+            {
+                batch.connect(base + node, base + target);
+                ends.push_back(node);
+                ends.push_back(target);
+            }
+        }
+    }
+    
+    /**
+     * Nodes are counting sorted into a grid of cells at least radius wide, so every node within radius of a node is in its own cell
+     * or one of the eight around it. Each cell is only checked against itself and the four cells after it, which finds every pair once.
+     */
+    void connect_geometric(graph_batch_t& batch, blt::u64 base, const std::vector<blt::vec2>& positions, const area_t& area, float radius)
+    {
+        const auto count = positions.size();
+        // no more cells than nodes, a tiny radius would otherwise need an enormous grid of empty cells
+        const auto cell = std::max(radius, std::sqrt(area.size.x() * area.size.y() / static_cast<float>(count)));
+        const auto columns = std::max(static_cast<blt::u64>(area.size.x() / cell), static_cast<blt::u64>(1));
+        const auto rows = std::max(static_cast<blt::u64>(area.size.y() / cell), static_cast<blt::u64>(1));
+        const auto cell_of = [&](const blt::vec2& pos) {
+            const auto column = std::min(static_cast<blt::u64>(std::max((pos.x() - area.min.x()) / cell, 0.0f)), columns - 1);
+            const auto row = std::min(static_cast<blt::u64>(std::max((pos.y() - area.min.y()) / cell, 0.0f)), rows - 1);
+            return row * columns + column;
+        };
+        
+        std::vector<blt::u32> offsets(columns * rows + 1, 0);
+        for (const auto& pos : positions)
+            offsets[cell_of(pos) + 1]++;
+        for (blt::size_t i = 1; i < offsets.size(); i++)
+            offsets[i] += offsets[i - 1];
+        std::vector<blt::u32> sorted(count);
+        std::vector<blt::u32> cursor{offsets.begin(), offsets.end() - 1};
+        for (blt::u32 i = 0; i < count; i++)
+            sorted[cursor[cell_of(positions[i])]++] = i;
+        
+        const auto radius_sq = radius * radius;
+        const auto connect_close = [&](blt::u32 node, blt::size_t begin, blt::size_t end) {
+            for (auto j = begin; j < end; j++)
+            {
+                const auto other = sorted[j];
+                const auto diff = positions[other] - positions[node];
+                if (diff.x() * diff.x() + diff.y() * diff.y() <= radius_sq)
+                    batch.connect(base + node, base + other);
+            }
+        };
+        for (blt::u64 row = 0; row < rows; row++)
+        {
+            for (blt::u64 column = 0; column < columns; column++)
+            {
+                const auto index = row * columns + column;
+                for (auto i = offsets[index]; i < offsets[index + 1]; i++)
+                {
+                    connect_close(sorted[i], i + 1, offsets[index + 1]);
+                    if (column + 1 < columns)
+                        connect_close(sorted[i], offsets[index + 1], offsets[index + 2]);
+                    if (row + 1 < rows)
+                    {
+                        const auto below = index + columns;
+                        connect_close(sorted[i], offsets[column > 0 ? below - 1 : below], offsets[std::min(below + 2, (row + 2) * columns)]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+generator_result_t generate_graph(graph_t& graph, const generator_settings_t& settings, bounding_box bb)
+{
+    const auto start = blt::system::getCurrentTimeNanoseconds();
+    if (settings.node_count <= 0)
+        return {};
+    
+    // don't allow points too close to the edges of the window.
+    if (bb.is_screen)
+    {
+        bb.max_x -= conf::POINT_SIZE;
+        bb.max_y -= conf::POINT_SIZE;
+        bb.min_x += conf::POINT_SIZE;
+        bb.min_y += conf::POINT_SIZE;
+    }
+    const area_t area{{static_cast<float>(bb.min_x), static_cast<float>(bb.min_y)},
+                      {std::max(static_cast<float>(bb.max_x - bb.min_x), 1.0f), std::max(static_cast<float>(bb.max_y - bb.min_y), 1.0f)}};
+    
+    random_t rng{settings.seed != 0 ? settings.seed : std::random_device{}()};
+    const auto count = static_cast<blt::u64>(settings.node_count);
+    const auto base = static_cast<blt::u64>(graph.numberOfNodes());
+    const auto degree = std::max(static_cast<double>(settings.average_degree), 0.0);
+    
+    auto batch = graph.batch();
+    batch.reserve(count, static_cast<blt::size_t>(static_cast<double>(count) * degree / 2));
+    std::vector<blt::vec2> positions;
+    place_nodes(batch, rng, count, area, positions);
+    
+    if (count > 1)
+    {
+        switch (settings.model)
+        {
+            case graph_model_t::RANDOM:
+                connect_random(batch, rng, base, count, degree / static_cast<double>(count - 1));
+                break;
+            case graph_model_t::PREFERENTIAL_ATTACHMENT:
+                // every node past the first few adds attachments edges, each of which adds to the degree of both ends
+                connect_preferential(batch, rng, base, count, std::max(static_cast<blt::u64>(std::lround(degree / 2)), static_cast<blt::u64>(1)));
+                break;
+            case graph_model_t::GEOMETRIC:
+                // the expected degree is the number of nodes inside a circle of radius, less the part of the circle covered by the node's
+                // own cell which no other node can be in (about one cell). ignores the circles cut off by the edges of the area
+                connect_geometric(batch, base, positions, area, static_cast<float>(std::sqrt(
+                        (degree + 1) * area.size.x() * area.size.y() / (M_PI * static_cast<double>(count)))));
+                break;
+        }
+    }
+    batch.commit();
+    
+    const auto end = blt::system::getCurrentTimeNanoseconds();
+    return {count, graph.numberOfEdges(), static_cast<double>(end - start) / 1e6};
+}
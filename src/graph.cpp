@@ -15,159 +15,543 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
-#include <blt/gfx/window.h>
 #include <graph.h>
-#include <random>
-#include <blt/gfx/raycast.h>
+#include <force_kernels.h>
+#include <algorithm>
+#include <functional>
+#include <cctype>
 #include <blt/std/ranges.h>
+#include <blt/std/time.h>
 #include <blt/math/interpolation.h>
+#ifndef GRAPHS_HEADLESS
+    #include <blt/gfx/window.h>
+    #include <blt/gfx/renderer/batch_2d_renderer.h>
+    #include <blt/gfx/raycast.h>
+    #include <texture_atlas.h>
+    #include <graph_renderer.h>
 
-extern blt::gfx::batch_renderer_2d renderer_2d;
 extern blt::gfx::matrix_state_manager global_matrices;
+extern texture_atlas_t atlas;
+extern graph_renderer_t graph_renderer;
 
 int sub_ticks = 1;
+#endif
 
-void graph_t::render()
+void graph_t::sync()
 {
-    const double frame_time = blt::gfx::getFrameDeltaSeconds();
-    if (sim && (current_iterations < max_iterations || run_infinitely) && max_force_last > threshold)
+    if (run_in_background != background.running())
     {
-        for (int _ = 0; _ < sub_ticks; _++)
+        if (run_in_background)
         {
-            // calculate new forces
-            for (const auto& v1 : blt::enumerate(nodes))
-            {
-                blt::vec2 attractive;
-                blt::vec2 repulsive;
-                for (const auto& v2 : blt::enumerate(nodes))
-                {
-                    if (v1.first == v2.first)
-                        continue;
-                    if (auto edge = connected(v1.first, v2.first))
-                        attractive += equation->attr(v1, v2, edge->get());
-                    repulsive += equation->rep(v1, v2);
-                }
-                v1.second.getVelocityRef() = attractive + repulsive;
-            }
-            max_force_last = 0;
-            // update positions
-            for (auto& v : nodes)
-            {
-                const float sim_factor = static_cast<float>(frame_time * sim_speed) * 0.05f;
-                v.getPositionRef() += v.getVelocityRef() * equation->cooling_factor(current_iterations) * sim_factor;
-                max_force_last = std::max(max_force_last, v.getVelocityRef().magnitude());
-            }
-            current_iterations++;
-        }
+            background.start();
+            synced_version = 0;
+            synced_settings_version = 0;
+        } else
+            background.stop();
+        // a layout doesn't move between threads, it would have to start over anyway
+        layout.reset();
+        layout_progress = -1;
     }
+    if (!background.running())
+        return;
     
-    for (const auto& [index, point] : blt::enumerate(nodes))
+    if (nodes.size() != adjacency.nodeCount())
+        invalidate_adjacency();
+    if (synced_version != topology_version)
     {
-        auto& obj = point.getRenderObj();
-        auto f_index = static_cast<blt::f32>(index) + 1;
-        renderer_2d.drawPointInternal(blt::gfx::render_info_t::make_info(point.texture), obj, 15.0f * f_index);
-        renderer_2d.drawPointInternal(blt::gfx::render_info_t::make_info(point.outline_color), obj.apply_scale(point.outline_scale), 14.0f * f_index);
+        synced_version = topology_version;
+        background.submit([nodes = node_state, adjacency = getAdjacency(), version = topology_version, iterations = simulation.current_iterations,
+                                  max_force = simulation.max_force_last, moved = moved_version](simulation_state_t& state) mutable {
+            state.nodes = std::move(nodes);
+            state.adjacency = std::move(adjacency);
+            state.version = version;
+            state.moved_version = moved;
+            state.simulation.current_iterations = iterations;
+            state.simulation.max_force_last = max_force;
+        });
     }
-    for (const auto& edge : edges)
+    // only when something changed, a command wakes the thread up even when it has nothing to simulate
+    if (synced_settings_version != settings_version)
     {
-        if (edge.getFirst() >= nodes.size() || edge.getSecond() >= nodes.size())
+        synced_settings_version = settings_version;
+        std::shared_ptr<force_equation> equation = simulation.getEquation().clone();
+        background.submit([settings = simulation.settings, equation](simulation_state_t& state) {
+            state.simulation.settings = settings;
+            state.simulation.set_equation(equation->clone());
+        });
+    }
+    
+    if (const auto* snapshot = background.poll())
+    {
+        simulation.current_iterations = snapshot->current_iterations;
+        simulation.max_force_last = snapshot->max_force_last;
+        simulation.timings = snapshot->timings;
+        steps_per_second = snapshot->steps_per_second;
+        if (snapshot->task_id == layout_request)
+            layout_progress = snapshot->task_progress;
+        // positions from before the last topology change no longer line up with the nodes, and positions from before the last
+        // move would snap a node being dragged back to where it was
+        if (snapshot->version == topology_version && snapshot->moved_version == moved_version && snapshot->x.size() == node_state.size())
         {
-            BLT_WARN("Edge Error %ld %ld %ld", edge.getFirst(), edge.getSecond(), nodes.size());
-        } else
+            node_state.x = snapshot->x;
+            node_state.y = snapshot->y;
+            invalidate_positions();
+        }
+    }
+}
+
+void graph_t::move_node(blt::u64 node, const blt::vec2& pos)
+{
+    node_state.setPosition(node, pos);
+    // dragging a node shouldn't go over every other node each frame, the grid is only refreshed once it has left its cell
+    positions_dirty = true;
+    if (!view_grid_dirty && !view_grid.moved(node, pos))
+        view_grid_dirty = true;
+    if (background.running())
+    {
+        moved_version++;
+        background.submit([node, pos, version = topology_version, moved = moved_version](simulation_state_t& state) {
+            state.moved_version = moved;
+            if (state.version == version && node < state.nodes.size())
+                state.nodes.setPosition(node, pos);
+        });
+    }
+}
+
+void graph_t::run_multilevel_layout()
+{
+    layout_progress = 0;
+    layout_request++;
+    if (background.running())
+    {
+        // runs in place of the simulation a slice at a time, the positions come back with the snapshots published in between
+        background.submit([settings = multilevel_settings, id = layout_request](simulation_state_t& state) {
+            auto layout = std::make_shared<multilevel_layout_t>(settings);
+            state.task_progress = 0;
+            state.task_id = id;
+            state.task = [layout, version = state.version](simulation_state_t& owner) {
+                // the nodes the layout was started on have been replaced since
+                if (owner.version != version)
+                    return true;
+                const bool done = layout->advance(owner.simulation, owner.nodes, owner.adjacency, conf::MULTILEVEL_SLICE_MS);
+                owner.task_progress = layout->getProgress();
+                return done;
+            };
+        });
+        return;
+    }
+    layout.emplace(multilevel_settings);
+    layout_version = topology_version;
+}
+
+bool graph_t::advance_layout(double max_milliseconds)
+{
+    if (!layout)
+        return true;
+    bool done = true;
+    // nodes were added or removed since the layout started, what it has worked out no longer fits the graph
+    if (layout_version == topology_version)
+    {
+        done = layout->advance(simulation, node_state, getAdjacency(), max_milliseconds);
+        invalidate_positions();
+    }
+    if (done)
+    {
+        layout.reset();
+        layout_progress = -1;
+    } else
+        layout_progress = layout->getProgress();
+    return done;
+}
+
+void graph_t::reset_iterations()
+{
+    simulation.current_iterations = 0;
+    if (background.running())
+    {
+        background.submit([](simulation_state_t& state) {
+            state.simulation.current_iterations = 0;
+        });
+    }
+}
+
+void graph_t::erase_node(blt::u64 node)
+{
+    // the last node is about to change index, it has to be in the lookup to be moved
+    getNames().erase(nodes[node].name);
+    for (const auto other : connected_nodes[node])
+    {
+        edges.erase(node, other);
+        unlink(other, node);
+    }
+    
+    const auto last = nodes.size() - 1;
+    if (node != last)
+    {
+        // the last node takes over the index, its edges are the only ones which have to be renumbered
+        for (const auto other : connected_nodes[last])
         {
-            auto n1 = nodes[edge.getFirst()];
-            auto n2 = nodes[edge.getSecond()];
-            auto draw_info = blt::gfx::render_info_t::make_info(edge.color);
-            renderer_2d.drawLine(draw_info, 5.0f, n1.getRenderObj().pos, n2.getRenderObj().pos, edge.thickness);
+            auto edge = std::move(*edges.find(last, other));
+            edges.erase(last, other);
+            if (edge.i1 == last)
+                edge.i1 = node;
+            else
+                edge.i2 = node;
+            edges.insert(std::move(edge));
+            
+            auto& other_connections = connected_nodes[other];
+            *std::find(other_connections.begin(), other_connections.end(), last) = node;
         }
+        connected_nodes[node] = std::move(connected_nodes[last]);
+        nodes[node] = std::move(nodes[last]);
+        names_to_node[nodes[node].name] = node;
     }
+    
+    connected_nodes.pop_back();
+    nodes.pop_back();
+    node_state.swap_erase(node);
+    named_nodes = nodes.size();
+}
+
+void graph_t::unlink(blt::u64 node, blt::u64 other)
+{
+    auto& connections = connected_nodes[node];
+    if (const auto itr = std::find(connections.begin(), connections.end(), other); itr != connections.end())
+    {
+        *itr = connections.back();
+        connections.pop_back();
+    }
+}
+
+/** ---- graph_batch_t ---- */
+
+void graph_batch_t::reserve(blt::size_t node_count, blt::size_t edge_count)
+{
+    graph.nodes.reserve(graph.nodes.size() + node_count);
+    graph.node_state.reserve(graph.node_state.size() + node_count);
+    graph.connected_nodes.reserve(graph.connected_nodes.size() + node_count);
+    graph.edges.reserve(graph.edges.size() + edge_count);
+    added_edges.reserve(added_edges.size() + edge_count);
 }
 
-void graph_t::create_random_graph(bounding_box bb, const blt::size_t min_nodes, const blt::size_t max_nodes, const blt::f64 connectivity,
-                                  const blt::f64 scaling_connectivity, const blt::f64 distance_factor)
+blt::u64 graph_batch_t::add_node(const blt::vec2& pos, node_t node)
 {
-    // don't allow points too close to the edges of the window.
-    if (bb.is_screen)
+    const auto index = graph.nodes.size();
+    graph.nodes.push_back(std::move(node));
+    graph.node_state.push_back(pos);
+    graph.connected_nodes.emplace_back();
+    nodes_added = true;
+    return index;
+}
+
+void graph_batch_t::commit()
+{
+    if (!nodes_added && added_edges.empty() && removed_edges.empty() && removed_nodes.empty())
+        return;
+    // the snapshot loader fills in the nodes itself
+    graph.connected_nodes.resize(graph.nodes.size());
+    
+    for (const auto& [n1, n2] : removed_edges)
     {
-        bb.max_x -= conf::POINT_SIZE;
-        bb.max_y -= conf::POINT_SIZE;
-        bb.min_x += conf::POINT_SIZE;
-        bb.min_y += conf::POINT_SIZE;
+        if (graph.edges.erase(n1, n2))
+        {
+            graph.unlink(n1, n2);
+            graph.unlink(n2, n1);
+        }
     }
-    static std::random_device dev;
-    static std::uniform_real_distribution chance(0.0, 1.0);
-    std::uniform_int_distribution node_count_dist(min_nodes, max_nodes);
-    std::uniform_real_distribution pos_x_dist(static_cast<blt::f32>(bb.min_x), static_cast<blt::f32>(bb.max_x));
-    std::uniform_real_distribution pos_y_dist(static_cast<blt::f32>(bb.min_y), static_cast<blt::f32>(bb.max_y));
     
-    const auto node_count = node_count_dist(dev);
+    // everything below indexes by the endpoints, an edge to a node which doesn't exist (or from a node to itself) is dropped here
+    const auto node_count = graph.nodes.size();
+    const auto invalid = std::remove_if(added_edges.begin(), added_edges.end(), [node_count](const added_edge_t& edge) {
+        return edge.first >= node_count || edge.second >= node_count || edge.first == edge.second;
+    });
+    if (invalid != added_edges.end())
+    {
+        BLT_WARN("%lu edges added to the graph refer to a node which doesn't exist or connect a node to itself, they were skipped",
+                 static_cast<unsigned long>(added_edges.end() - invalid));
+        added_edges.erase(invalid, added_edges.end());
+    }
     
-    for (blt::size_t i = 0; i < node_count; i++)
+    if (!added_edges.empty())
     {
-        float x, y;
-        do
+        // counting sorted by the smaller end, which counts the degrees needed to size every list of neighbours along the way. the
+        // edges then go into the table in node order, so the edge list (and the adjacency built from it) walks the nodes in order
+        // instead of jumping around them. stable, so the edge the table keeps out of any added twice is still the first one added
+        std::vector<blt::u32> offsets(node_count + 1, 0);
+        std::vector<blt::u32> degrees(node_count, 0);
+        for (const auto& edge : added_edges)
         {
-            bool can_break = true;
-            x = pos_x_dist(dev);
-            y = pos_y_dist(dev);
-            for (const auto& node : nodes)
+            offsets[std::min(edge.first, edge.second) + 1]++;
+            degrees[edge.first]++;
+            degrees[edge.second]++;
+        }
+        for (blt::size_t i = 1; i < offsets.size(); i++)
+            offsets[i] += offsets[i - 1];
+        std::vector<added_edge_t> sorted(added_edges.size());
+        for (const auto& edge : added_edges)
+            sorted[offsets[std::min(edge.first, edge.second)]++] = edge;
+        
+        for (const auto& [node, degree] : blt::enumerate(degrees))
+        {
+            if (auto& connections = graph.connected_nodes[node]; connections.empty())
+                connections.reserve(degree);
+        }
+        graph.edges.reserve(graph.edges.size() + sorted.size());
+        
+        for (const auto& added : sorted)
+        {
+            const bool inserted = added.data == NO_DATA ? graph.edges.insert(edge_t{added.first, added.second})
+                                                        : graph.edges.insert(std::move(edge_data[added.data]));
+            if (inserted)
             {
-                const auto& rp = node.getRenderObj().pos;
-                const float dx = rp.x() - x;
-                const float dy = rp.y() - y;
-                
-                if (const float dist = std::sqrt(dx * dx + dy * dy); dist <= conf::POINT_SIZE)
-                {
-                    can_break = false;
-                    break;
-                }
+                graph.connected_nodes[added.first].push_back(added.second);
+                graph.connected_nodes[added.second].push_back(added.first);
             }
-            if (can_break)
-                break;
-        } while (true);
-        nodes.push_back(node_t({x, y, conf::POINT_SIZE}));
-        names_to_node.insert({nodes.back().name, nodes.size() - 1});
+        }
     }
     
-    for (const auto& [index1, node1] : blt::enumerate(nodes))
+    // largest first, the node moved into a hole is always the last one and every node after the hole has already been removed
+    std::sort(removed_nodes.begin(), removed_nodes.end(), std::greater<>());
+    removed_nodes.erase(std::unique(removed_nodes.begin(), removed_nodes.end()), removed_nodes.end());
+    for (const auto node : removed_nodes)
+        graph.erase_node(node);
+    
+    added_edges.clear();
+    edge_data.clear();
+    removed_edges.clear();
+    removed_nodes.clear();
+    nodes_added = false;
+    graph.invalidate_adjacency();
+}
+
+void graph_t::update_view_grid()
+{
+    // only how the nodes look changes the largest radius, not them moving around
+    if (max_node_scale_dirty)
+    {
+        max_node_scale = 0;
+        for (const auto& node : nodes)
+            max_node_scale = std::max(max_node_scale, node.scale);
+        max_node_scale_dirty = false;
+    }
+    if (!view_grid_dirty)
+        return;
+    const auto& edge_list = getAdjacency().getEdges();
+    if (view_grid_version != topology_version)
+    {
+        view_grid.build(node_state, edge_list);
+        view_grid_version = topology_version;
+    } else
+        view_grid.refresh(node_state, edge_list);
+    view_grid_dirty = false;
+}
+
+blt::i64 graph_t::node_at(const blt::vec2& pos)
+{
+    update_view_grid();
+    // the grid only knows where centers are, so every cell a circle reaching pos could be centered in is searched
+    blt::i64 found = -1;
+    view_grid.for_nodes(view_rect_t{pos, pos, 0}.expand(max_node_scale), [this, &pos, &found](blt::u32 index) {
+        if ((found < 0 || index < found) && (node_state.getPosition(index) - pos).magnitude() < nodes[index].scale)
+            found = index;
+    });
+    return found;
+}
+
+std::vector<blt::u64> graph_t::nodes_in_rect(const blt::vec2& corner1, const blt::vec2& corner2)
+{
+    update_view_grid();
+    const blt::vec2 min{std::min(corner1.x(), corner2.x()), std::min(corner1.y(), corner2.y())};
+    const blt::vec2 max{std::max(corner1.x(), corner2.x()), std::max(corner1.y(), corner2.y())};
+    std::vector<blt::u64> found;
+    view_grid.for_nodes(view_rect_t{min, max, 0}, [this, &min, &max, &found](blt::u32 index) {
+        const auto pos = node_state.getPosition(index);
+        if (pos.x() >= min.x() && pos.x() <= max.x() && pos.y() >= min.y() && pos.y() <= max.y())
+            found.push_back(index);
+    });
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+std::vector<blt::u64> graph_t::nodes_in_polygon(const std::vector<blt::vec2>& polygon)
+{
+    if (polygon.size() < 3)
+        return {};
+    update_view_grid();
+    blt::vec2 min = polygon.front();
+    blt::vec2 max = polygon.front();
+    for (const auto& point : polygon)
+    {
+        min = {std::min(min.x(), point.x()), std::min(min.y(), point.y())};
+        max = {std::max(max.x(), point.x()), std::max(max.y(), point.y())};
+    }
+    std::vector<blt::u64> found;
+    view_grid.for_nodes(view_rect_t{min, max, 0}, [this, &polygon, &found](blt::u32 index) {
+        // even-odd rule, count the edges a ray going right from the node crosses
+        const auto pos = node_state.getPosition(index);
+        bool inside = false;
+        for (blt::size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+        {
+            const auto& a = polygon[i];
+            const auto& b = polygon[j];
+            if ((a.y() > pos.y()) != (b.y() > pos.y()) && pos.x() < (b.x() - a.x()) * (pos.y() - a.y()) / (b.y() - a.y()) + a.x())
+                inside = !inside;
+        }
+        if (inside)
+            found.push_back(index);
+    });
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+bool graph_t::use_equation(std::string_view name)
+{
+    const auto letters_of = [](std::string_view str) {
+        std::string letters;
+        for (const char c : str)
+        {
+            if (std::isalpha(static_cast<unsigned char>(c)))
+                letters += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return letters;
+    };
+    const auto wanted = letters_of(name);
+    std::unique_ptr<force_equation> equations[] = {std::make_unique<Eades_equation>(), std::make_unique<Fruchterman_Reingold_equation>()};
+    for (auto& equation : equations)
     {
-        for (const auto& [index2, node2] : blt::enumerate(nodes))
+        if (letters_of(equation->name()) == wanted)
         {
-            if (index1 == index2)
-                continue;
-            const auto diff = node2.getPosition() - node1.getPosition();
-            const auto diff_sq = (diff * diff);
-            const auto dist = distance_factor / static_cast<float>(std::sqrt(diff_sq.x() + diff_sq.y()));
-            double dexp;
-            if (dist == 0)
-                dexp = 0;
-            else
-                dexp = 1 / (std::exp(dist) - dist);
-            if (const auto rand = chance(dev); rand <= connectivity && rand >= dexp * scaling_connectivity)
-                connect(index1, index2);
+            simulation.set_equation(std::move(equation));
+            invalidate_settings();
+            return true;
         }
     }
+    return false;
+}
+
+#ifndef GRAPHS_HEADLESS
+
+view_rect_t visible_area(blt::i32 width, blt::i32 height)
+{
+    const auto corner = [width, height](float x, float y) {
+        return blt::gfx::calculateRay2D(x, y, width, height, global_matrices.getScale2D(), global_matrices.getView2D(), global_matrices.getOrtho());
+    };
+    const auto a = corner(0, 0);
+    const auto b = corner(static_cast<float>(width), static_cast<float>(height));
+    const auto world_width = std::max(std::abs(b.x() - a.x()), 1e-6f);
+    return {blt::vec2{std::min(a.x(), b.x()), std::min(a.y(), b.y())}, blt::vec2{std::max(a.x(), b.x()), std::max(a.y(), b.y())},
+            static_cast<float>(width) / world_width};
+}
+
+void graph_t::render(profiler_t& profiler, const view_rect_t& view)
+{
+    if (!background.running() && layout)
+    {
+        profile_scope_t scope{profiler, "multilevel layout"};
+        advance_layout(conf::MULTILEVEL_SLICE_MS);
+    } else if (!background.running() && simulation.should_step())
+    {
+        profile_scope_t scope{profiler, "simulation"};
+        const double frame_time = blt::gfx::getFrameDeltaSeconds();
+        simulation.timings = {};
+        const float sim_factor = static_cast<float>(frame_time * simulation.settings.sim_speed) * 0.05f;
+        const auto& adj = getAdjacency();
+        simulation.profiler = &profiler;
+        for (int _ = 0; _ < sub_ticks; _++)
+            simulation.step(node_state, adj, sim_factor);
+        simulation.profiler = nullptr;
+        invalidate_positions();
+    }
     
-    std::uniform_int_distribution node_select_dist(0ul, nodes.size() - 1);
-    for (blt::size_t i = 0; i < nodes.size(); i++)
     {
-        if (connected_nodes[i].size() <= 1)
+        // everything stays on the gpu between frames, only what changed is sent again
+        profile_scope_t scope{profiler, "upload graph"};
+        if (positions_dirty)
         {
-            for (blt::size_t j = connected_nodes[i].size(); j < 2; j++)
-            {
-                blt::u64 select;
-                do
-                {
-                    select = node_select_dist(dev);
-                    if (select != i && !connected_nodes[i].contains(select))
-                        break;
-                } while (true);
-                connect(i, select);
-            }
+            graph_renderer.upload_positions(node_state);
+            positions_dirty = false;
+            visible_dirty = true;
+        }
+        // a texture which just finished loading changes the region of every node which was using the placeholder for it
+        if (nodes_dirty || uploaded_atlas_generation != atlas.getGeneration())
+        {
+            max_node_size = 0;
+            for (const auto& node : nodes)
+                max_node_size = std::max(max_node_size, node.scale * node.outline_scale);
+            graph_renderer.upload_nodes(nodes, atlas);
+            uploaded_atlas_generation = atlas.getGeneration();
+            nodes_dirty = false;
+            visible_dirty = true;
         }
+        if (uploaded_edges_version != topology_version)
+        {
+            graph_renderer.upload_edges(getAdjacency().getEdges());
+            uploaded_edges_version = topology_version;
+            visible_dirty = true;
+        }
+    }
+    
+    const bool view_moved = view.min != culled_view.min || view.max != culled_view.max ||
+                            view.pixels_per_unit != culled_view.pixels_per_unit;
+    if (visible_dirty || view_moved)
+    {
+        profile_scope_t scope{profiler, "cull"};
+        cull(view);
+        culled_view = view;
+        visible_dirty = false;
     }
 }
 
+void graph_t::cull(const view_rect_t& view)
+{
+    update_view_grid();
+    
+    visible_nodes.clear();
+    node_lod.begin(view, conf::LOD_CELL_PIXELS);
+    view_grid.for_nodes(view.expand(max_node_size / 2), [this, &view](blt::u32 index) {
+        const auto& node = nodes[index];
+        const auto pos = node_state.getPosition(index);
+        const auto size = node.scale * node.outline_scale;
+        if (!view.overlaps(pos, size))
+            return;
+        // too small for the texture to be made out, nodes landing on the same few pixels would all be drawn on top of each other
+        if (size * view.pixels_per_unit < conf::LOD_NODE_PIXELS)
+        {
+            if (node_lod.claim(pos))
+                visible_nodes.push_back(index);
+            return;
+        }
+        // textures are only loaded once their node is in view and large enough on screen for the texture to be drawn
+        atlas.request(node.texture);
+        visible_nodes.push_back(index);
+    });
+    // the grid hands nodes out by cell, they are still layered in index order
+    std::sort(visible_nodes.begin(), visible_nodes.end());
+    
+    // zoomed out far enough that nodes are only a few pixels across
+    const bool zoomed_out = max_node_size * view.pixels_per_unit < conf::LOD_NODE_PIXELS;
+    const auto& edge_list = getAdjacency().getEdges();
+    visible_edges.clear();
+    edge_lod.begin(view, conf::LOD_EDGE_CELL_PIXELS);
+    view_grid.for_edges(view, [this, &view, &edge_list, zoomed_out](blt::u32 index) {
+        const auto& edge = edge_list[index];
+        const auto p1 = node_state.getPosition(edge.getFirst());
+        const auto p2 = node_state.getPosition(edge.getSecond());
+        if (!view.overlaps(p1, p2))
+            return;
+        // edges between the same few pixels would all be drawn on top of each other
+        if (zoomed_out && !edge_lod.claim(p1, p2))
+            return;
+        visible_edges.push_back(index);
+    });
+    
+    graph_renderer.upload_visible(visible_nodes, visible_edges);
+}
+
+#endif
+
+#ifndef GRAPHS_HEADLESS
+
 void engine_t::draw_gui(const blt::gfx::window_data& data)
 {
     double ft = blt::gfx::getFrameDeltaSeconds();
@@ -175,17 +559,20 @@ void engine_t::draw_gui(const blt::gfx::window_data& data)
     im::SetNextWindowSize({350, static_cast<float>(data.height)});
     if (im::Begin("Info", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
     {
-        static int min_nodes = 5;
-        static int max_nodes = 25;
-        
         static bounding_box bb{0, 0, data.width, data.height};
-        
-        static float connectivity = 0.12;
-        static float scaling_connectivity = 0.5;
-        static float distance_factor = 100;
+        static generator_result_t generated;
         
         //im::SetNextItemOpen(true, ImGuiCond_Once);
         im::Text("FPS: %lf Frame-time (ms): %lf Frame-time (S): %lf", 1.0 / ft, ft * 1000.0, ft);
+        if (im::Button("Save"))
+            save_requested = true;
+        if (journal.compacting())
+        {
+            im::SameLine();
+            im::Text("Saving...");
+        }
+        if (im::CollapsingHeader("Frame Profiler"))
+            profiler.draw_gui();
         im::SetNextItemOpen(true, ImGuiCond_Once);
         if (im::CollapsingHeader("Help"))
         {
@@ -214,26 +601,82 @@ void engine_t::draw_gui(const blt::gfx::window_data& data)
                 bb.min_y = 0;
             }
             im::SeparatorText("Node Settings");
-            im::InputInt("Min Nodes", &min_nodes);
-            im::InputInt("Max Nodes", &max_nodes);
-            im::SliderFloat("Connectivity", &connectivity, 0, 1);
-            im::SliderFloat("Scaling Connectivity", &scaling_connectivity, 0, 1);
-            im::InputFloat("Distance Factor", &distance_factor, 5, 100);
+            auto& generator = graph.getGeneratorSettings();
+            const char* models[] = {"Random (G(n, p))", "Preferential Attachment", "Geometric"};
+            int model = static_cast<int>(generator.model);
+            if (im::ListBox("##GraphModel", &model, models, 3, 3))
+                generator.model = static_cast<graph_model_t>(model);
+            im::InputInt("Nodes", &generator.node_count, 100, 10000);
+            im::InputFloat("Average Degree", &generator.average_degree, 0.5, 2);
+            im::InputScalar("Seed (0 for random)", ImGuiDataType_U64, &generator.seed);
             if (im::Button("Reset Graph"))
             {
-                graph.reset(bb, min_nodes, max_nodes, connectivity, scaling_connectivity, distance_factor);
+                generated = graph.generate(bb);
+                journal.invalidate();
+                selector.clear();
+            }
+            if (generated.nodes > 0)
+            {
+                im::SameLine();
+                im::Text("%lu nodes, %lu edges in %.1f ms", static_cast<unsigned long>(generated.nodes),
+                         static_cast<unsigned long>(generated.edges), generated.milliseconds);
             }
         }
         if (im::CollapsingHeader("Simulation Settings"))
         {
-            im::InputInt("Max Iterations", &graph.getMaxIterations());
-            im::Checkbox("Run Infinitely", &graph.getIterControl());
+            bool settings_changed = false;
+            settings_changed |= im::InputInt("Max Iterations", &graph.getMaxIterations());
+            settings_changed |= im::Checkbox("Run Infinitely", &graph.getIterControl());
             im::InputInt("Sub-ticks Per Frame", &sub_ticks);
-            im::InputFloat("Threshold", &graph.getThreshold(), 0.01, 1);
-            graph.getSimulator()->draw_inputs_base();
-            graph.getSimulator()->draw_inputs();
+            settings_changed |= im::InputInt("Threads", &graph.getThreadCount());
+            settings_changed |= im::InputFloat("Threshold", &graph.getThreshold(), 0.01, 1);
+            settings_changed |= graph.getSimulator()->draw_inputs_base();
+            settings_changed |= graph.getSimulator()->draw_inputs();
+            im::Checkbox("Run In Background", &graph.getBackgroundControl());
             im::Text("Current Cooling Factor: %f", graph.getCoolingFactor());
-            im::SliderFloat("Simulation Speed", &graph.getSimSpeed(), 0, 4);
+            settings_changed |= im::SliderFloat("Simulation Speed", &graph.getSimSpeed(), 0, 4);
+            im::SeparatorText("Repulsion");
+            const char* modes[] = {"Exact", "Barnes-Hut", "Cutoff Grid"};
+            int mode = static_cast<int>(graph.getRepulsionMode());
+            if (im::ListBox("##RepulsionMode", &mode, modes, 3, 3))
+                graph.setRepulsionMode(static_cast<repulsion_mode_t>(mode));
+            if (graph.getRepulsionMode() == repulsion_mode_t::BARNES_HUT)
+                settings_changed |= im::SliderFloat("Opening Angle (Theta)", &graph.getTheta(), 0, 2);
+            if (graph.getRepulsionMode() == repulsion_mode_t::CUTOFF)
+                settings_changed |= im::SliderFloat("Cutoff Radius", &graph.getCutoffRadius(), conf::DEFAULT_SPRING_LENGTH,
+                                                    conf::DEFAULT_SPRING_LENGTH * 20);
+            if (settings_changed)
+                graph.invalidate_settings();
+            im::Text("Vector Kernels: %s", kernels::getSimdLevelName());
+            if (im::Button("Measure Error"))
+                graph.measure_repulsion_error();
+            if (graph.getLastError() >= 0)
+            {
+                im::SameLine();
+                im::Text("Relative RMS Error: %f", graph.getLastError());
+            }
+            im::SeparatorText("Multilevel Layout");
+            auto& multilevel = graph.getMultilevelSettings();
+            im::InputInt("Coarsest Size", &multilevel.coarsest_size);
+            im::InputInt("Coarsest Iterations", &multilevel.coarsest_iterations);
+            im::InputInt("Level Iterations", &multilevel.level_iterations);
+            im::InputInt("Level Work (Node Steps)", &multilevel.level_work, 10000, 100000);
+            im::SliderFloat("Fine Level Theta", &multilevel.fine_theta, 0, 2);
+            im::SliderFloat("Expansion", &multilevel.expansion, 0.25, 1.5);
+            im::InputFloat("Step Size", &multilevel.step_size, 0.001, 0.01, "%.4f");
+            if (graph.getLayoutProgress() >= 0)
+                im::ProgressBar(graph.getLayoutProgress());
+            else if (im::Button("Run Multilevel Layout"))
+                graph.run_multilevel_layout();
+            const auto& timings = graph.getTimings();
+            if (graph.getBackgroundControl())
+            {
+                im::SeparatorText("Timings (ms per step)");
+                im::Text("Steps Per Second: %f", graph.getStepsPerSecond());
+            } else
+                im::SeparatorText("Timings (ms per frame)");
+            im::Text("Tree: %lf Repulsion: %lf", timings.tree, timings.repulsion);
+            im::Text("Attraction: %lf Integration: %lf", timings.attraction, timings.integration);
         }
         im::SetNextItemOpen(true, ImGuiCond_Once);
         if (im::CollapsingHeader("System Controls"))
@@ -273,3 +716,5 @@ void engine_t::draw_gui(const blt::gfx::window_data& data)
         im::End();
     }
 }
+
+#endif
@@ -0,0 +1,442 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <graph_renderer.h>
+#include <blt/std/logging.h>
+#include <blt/std/ranges.h>
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+namespace
+{
+#ifdef __EMSCRIPTEN__
+    constexpr auto glsl_version = "#version 300 es\nprecision highp float;\nprecision highp int;\nprecision highp sampler2D;\n";
+#else
+    constexpr auto glsl_version = "#version 330 core\n";
+#endif
+    
+    // shared by both vertex shaders, node positions are fetched by index out of the position textures
+    constexpr auto position_lookup = R"(
+uniform sampler2D x_positions;
+uniform sampler2D y_positions;
+
+uniform mat4 ortho;
+uniform mat4 view;
+uniform float viewport_width;
+
+vec2 node_position(int index)
+{
+    ivec2 texel = ivec2(index % POSITION_TEXTURE_WIDTH, index / POSITION_TEXTURE_WIDTH);
+    return vec2(texelFetch(x_positions, texel, 0).r, texelFetch(y_positions, texel, 0).r);
+}
+
+// screen pixels per unit of world space
+float pixel_scale(mat4 transform)
+{
+    return abs(transform[0][0]) * viewport_width * 0.5;
+}
+)";
+    
+    constexpr auto node_vertex_shader = R"(
+layout (location = 0) in vec2 sizes;
+layout (location = 1) in vec4 color;
+layout (location = 2) in vec4 uv_rect;
+layout (location = 3) in int page;
+layout (location = 4) in uint node_index;
+
+uniform float lod_pixels;
+
+out vec2 frag_corner;
+out vec2 frag_uv;
+out vec4 frag_color;
+out float inner_radius;
+flat out int frag_page;
+
+void main()
+{
+    // a quad from -1 to 1 drawn as a triangle strip, no vertex buffer needed
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+    mat4 transform = ortho * view;
+    float scale = pixel_scale(transform);
+    // kept at least a couple pixels across so a zoomed out graph doesn't disappear
+    float size = max(sizes.x * sizes.y, 2.0 / scale);
+    
+    frag_corner = corner;
+    frag_color = color;
+    // the texture takes up the middle of the node, the outline is whatever is left
+    inner_radius = 1.0 / sizes.y;
+    vec2 texture_corner = corner * sizes.y;
+    frag_uv = mix(uv_rect.xy, uv_rect.zw, vec2(texture_corner.x * 0.5 + 0.5, 0.5 - texture_corner.y * 0.5));
+    // too small to make out the texture, the whole node is drawn in the outline color
+    frag_page = size * scale < lod_pixels ? -1 : page;
+    
+    gl_Position = transform * vec4(node_position(int(node_index)) + corner * size * 0.5, 0.0, 1.0);
+    gl_Position.z = 0.0;
+}
+)";
+    
+    constexpr auto node_fragment_shader = R"(
+in vec2 frag_corner;
+in vec2 frag_uv;
+in vec4 frag_color;
+in float inner_radius;
+flat in int frag_page;
+
+uniform sampler2D pages[ATLAS_MAX_PAGES];
+
+out vec4 colour;
+
+void main()
+{
+    // derivatives have to be taken before anything branches, the texture is sampled with them inside of the page lookup below
+    vec2 uv_dx = dFdx(frag_uv);
+    vec2 uv_dy = dFdy(frag_uv);
+    float radius = length(frag_corner);
+    if (radius > 1.0)
+        discard;
+    if (frag_page < 0 || radius > inner_radius)
+    {
+        colour = frag_color;
+        return;
+    }
+    vec4 texel = frag_color;
+    PAGE_LOOKUP
+    colour = texel;
+}
+)";
+    
+    constexpr auto edge_vertex_shader = R"(
+layout (location = 0) in uvec2 endpoints;
+layout (location = 1) in vec4 color;
+layout (location = 2) in float thickness;
+
+out vec4 frag_color;
+
+void main()
+{
+    vec2 p1 = node_position(int(endpoints.x));
+    vec2 p2 = node_position(int(endpoints.y));
+    mat4 transform = ortho * view;
+    // never thinner than a pixel, thin edges would flicker in and out when zoomed out
+    float width = max(thickness, 1.0 / pixel_scale(transform));
+    vec2 direction = p2 - p1;
+    float distance = length(direction);
+    vec2 normal = distance > 0.0 ? vec2(-direction.y, direction.x) / distance : vec2(0.0);
+    
+    float along = float(gl_VertexID & 1);
+    float side = float(gl_VertexID >> 1) * 2.0 - 1.0;
+    frag_color = color;
+    gl_Position = transform * vec4(mix(p1, p2, along) + normal * side * width * 0.5, 0.0, 1.0);
+    gl_Position.z = 0.0;
+}
+)";
+    
+    constexpr auto edge_fragment_shader = R"(
+in vec4 frag_color;
+
+out vec4 colour;
+
+void main()
+{
+    colour = frag_color;
+}
+)";
+    
+    std::string header()
+    {
+        return std::string(glsl_version) + "#define POSITION_TEXTURE_WIDTH " + std::to_string(conf::POSITION_TEXTURE_WIDTH) +
+               "\n#define ATLAS_MAX_PAGES " + std::to_string(conf::ATLAS_MAX_PAGES) + "\n";
+    }
+    
+    // sampler arrays can only be indexed by constants, so the page is picked with a branch per page
+    std::string page_lookup()
+    {
+        std::string lookup;
+        for (blt::size_t i = 0; i < conf::ATLAS_MAX_PAGES; i++)
+        {
+            const auto page = std::to_string(i);
+            lookup += (i == 0 ? "if" : "else if") + std::string(" (frag_page == ") + page + ")\n        texel = textureGrad(pages[" + page +
+                      "], frag_uv, uv_dx, uv_dy);\n    ";
+        }
+        return lookup;
+    }
+    
+    GLuint compile(GLenum type, const std::string& source)
+    {
+        const auto shader = glCreateShader(type);
+        const char* data = source.c_str();
+        glShaderSource(shader, 1, &data, nullptr);
+        glCompileShader(shader);
+        GLint success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            char log[1024];
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            BLT_ERROR("Unable to compile graph shader: %s", log);
+        }
+        return shader;
+    }
+    
+    GLuint link(const std::string& vertex_source, const std::string& fragment_source)
+    {
+        const auto vertex = compile(GL_VERTEX_SHADER, vertex_source);
+        const auto fragment = compile(GL_FRAGMENT_SHADER, fragment_source);
+        const auto program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glLinkProgram(program);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            char log[1024];
+            glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+            BLT_ERROR("Unable to link graph shader: %s", log);
+        }
+        return program;
+    }
+    
+    // uploads a buffer's contents, only reallocating the buffer when it has to grow
+    template<typename T>
+    void upload_buffer(GLuint buffer, const std::vector<T>& data, blt::size_t& capacity)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (data.size() > capacity)
+        {
+            capacity = data.capacity();
+            glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(T)), nullptr, GL_DYNAMIC_DRAW);
+        }
+        if (!data.empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(data.size() * sizeof(T)), data.data());
+    }
+}
+
+void graph_renderer_t::create()
+{
+    const auto vertex_header = header() + position_lookup;
+    auto fragment = std::string(node_fragment_shader);
+    fragment.replace(fragment.find("PAGE_LOOKUP"), std::string("PAGE_LOOKUP").size(), page_lookup());
+    
+    node_program.id = link(vertex_header + node_vertex_shader, header() + fragment);
+    edge_program.id = link(vertex_header + edge_vertex_shader, header() + edge_fragment_shader);
+    for (auto* program : {&node_program, &edge_program})
+    {
+        program->ortho = glGetUniformLocation(program->id, "ortho");
+        program->view = glGetUniformLocation(program->id, "view");
+        program->viewport_width = glGetUniformLocation(program->id, "viewport_width");
+        glUseProgram(program->id);
+        // atlas pages take the first units, the positions go after them
+        glUniform1i(glGetUniformLocation(program->id, "x_positions"), conf::ATLAS_MAX_PAGES);
+        glUniform1i(glGetUniformLocation(program->id, "y_positions"), conf::ATLAS_MAX_PAGES + 1);
+    }
+    glUseProgram(node_program.id);
+    glUniform1f(glGetUniformLocation(node_program.id, "lod_pixels"), conf::LOD_NODE_PIXELS);
+    for (blt::size_t i = 0; i < conf::ATLAS_MAX_PAGES; i++)
+        glUniform1i(glGetUniformLocation(node_program.id, ("pages[" + std::to_string(i) + "]").c_str()), static_cast<GLint>(i));
+    glUseProgram(0);
+    
+    glGenTextures(2, positions);
+    for (const auto texture : positions)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    glGenVertexArrays(1, &node_vao);
+    glGenBuffers(1, &node_vbo);
+    glBindVertexArray(node_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, node_vbo);
+    constexpr auto node_stride = static_cast<GLsizei>(sizeof(node_instance_t));
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, node_stride, reinterpret_cast<void*>(offsetof(node_instance_t, scale)));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, node_stride, reinterpret_cast<void*>(offsetof(node_instance_t, color)));
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, node_stride, reinterpret_cast<void*>(offsetof(node_instance_t, uv)));
+    glVertexAttribIPointer(3, 1, GL_INT, node_stride, reinterpret_cast<void*>(offsetof(node_instance_t, page)));
+    glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, node_stride, reinterpret_cast<void*>(offsetof(node_instance_t, index)));
+    for (GLuint i = 0; i < 5; i++)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+    
+    glGenVertexArrays(1, &edge_vao);
+    glGenBuffers(1, &edge_vbo);
+    glBindVertexArray(edge_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, edge_vbo);
+    constexpr auto edge_stride = static_cast<GLsizei>(sizeof(edge_instance_t));
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, edge_stride, reinterpret_cast<void*>(offsetof(edge_instance_t, first)));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, edge_stride, reinterpret_cast<void*>(offsetof(edge_instance_t, color)));
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, edge_stride, reinterpret_cast<void*>(offsetof(edge_instance_t, thickness)));
+    for (GLuint i = 0; i < 3; i++)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void graph_renderer_t::cleanup()
+{
+    glDeleteProgram(node_program.id);
+    glDeleteProgram(edge_program.id);
+    glDeleteVertexArrays(1, &node_vao);
+    glDeleteVertexArrays(1, &edge_vao);
+    glDeleteBuffers(1, &node_vbo);
+    glDeleteBuffers(1, &edge_vbo);
+    glDeleteTextures(2, positions);
+    node_program = {};
+    edge_program = {};
+    position_rows = position_count = node_count = edge_count = 0;
+    node_capacity = edge_capacity = 0;
+}
+
+void graph_renderer_t::upload_nodes(const std::vector<node_t>& nodes, const texture_atlas_t& atlas)
+{
+    node_instances.clear();
+    for (const auto& [index, node] : blt::enumerate(nodes))
+    {
+        node_instance_t instance{node.scale, node.outline_scale, {}, {}, -1, static_cast<blt::u32>(index)};
+        std::copy_n(node.outline_color.data(), 4, instance.color);
+        if (const auto* region = atlas.find(node.texture))
+        {
+            instance.uv[0] = region->uv_min.x();
+            instance.uv[1] = region->uv_min.y();
+            instance.uv[2] = region->uv_max.x();
+            instance.uv[3] = region->uv_max.y();
+            instance.page = static_cast<blt::i32>(region->page);
+        }
+        node_instances.push_back(instance);
+    }
+}
+
+void graph_renderer_t::upload_edges(const std::vector<edge_t>& edges)
+{
+    edge_instances.clear();
+    for (const auto& edge : edges)
+    {
+        edge_instance_t instance{static_cast<blt::u32>(edge.getFirst()), static_cast<blt::u32>(edge.getSecond()), {}, edge.thickness};
+        std::copy_n(edge.color.data(), 4, instance.color);
+        edge_instances.push_back(instance);
+    }
+}
+
+void graph_renderer_t::upload_positions(const node_state_t& nodes)
+{
+    constexpr auto width = conf::POSITION_TEXTURE_WIDTH;
+    const auto rows = std::max((nodes.size() + width - 1) / width, static_cast<blt::size_t>(1));
+    if (rows > position_rows)
+    {
+        // a bit of room to grow so adding nodes one at a time doesn't reallocate every time
+        position_rows = rows + rows / 4;
+        for (const auto texture : positions)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, static_cast<GLsizei>(position_rows), 0, GL_RED, GL_FLOAT, nullptr);
+        }
+    }
+    
+    // full rows go up in one copy straight out of node_state_t, the last partial row in a second
+    const auto full_rows = nodes.size() / width;
+    const auto remainder = nodes.size() % width;
+    const float* data[2] = {nodes.x.data(), nodes.y.data()};
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindTexture(GL_TEXTURE_2D, positions[i]);
+        if (full_rows > 0)
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, static_cast<GLsizei>(full_rows), GL_RED, GL_FLOAT, data[i]);
+        if (remainder > 0)
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, static_cast<GLint>(full_rows), static_cast<GLsizei>(remainder), 1, GL_RED, GL_FLOAT,
+                            data[i] + full_rows * width);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    position_count = nodes.size();
+}
+
+void graph_renderer_t::upload_visible(const std::vector<blt::u32>& nodes, const std::vector<blt::u32>& edges)
+{
+    visible_nodes.clear();
+    for (const auto node : nodes)
+    {
+        if (node < node_instances.size())
+            visible_nodes.push_back(node_instances[node]);
+    }
+    visible_edges.clear();
+    for (const auto edge : edges)
+    {
+        if (edge < edge_instances.size())
+            visible_edges.push_back(edge_instances[edge]);
+    }
+    upload_buffer(node_vbo, visible_nodes, node_capacity);
+    upload_buffer(edge_vbo, visible_edges, edge_capacity);
+    node_count = visible_nodes.size();
+    edge_count = visible_edges.size();
+}
+
+void graph_renderer_t::render(const blt::mat4x4& ortho, const blt::mat4x4& view, blt::i32 width, const texture_atlas_t& atlas)
+{
+    const auto& pages = atlas.getPages();
+    for (blt::size_t i = 0; i < pages.size(); i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, pages[i]);
+    }
+    glActiveTexture(GL_TEXTURE0 + conf::ATLAS_MAX_PAGES);
+    glBindTexture(GL_TEXTURE_2D, positions[0]);
+    glActiveTexture(GL_TEXTURE0 + conf::ATLAS_MAX_PAGES + 1);
+    glBindTexture(GL_TEXTURE_2D, positions[1]);
+    
+    // everything is drawn in order, edges first and nodes after in the order they were given
+    const bool depth_test = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    
+    for (const auto* program : {&edge_program, &node_program})
+    {
+        glUseProgram(program->id);
+        glUniformMatrix4fv(program->ortho, 1, GL_FALSE, ortho.ptr());
+        glUniformMatrix4fv(program->view, 1, GL_FALSE, view.ptr());
+        glUniform1f(program->viewport_width, static_cast<float>(width));
+    }
+    
+    // the position textures don't exist until the first upload
+    if (position_count > 0)
+    {
+        glUseProgram(edge_program.id);
+        glBindVertexArray(edge_vao);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(edge_count));
+        
+        glUseProgram(node_program.id);
+        glBindVertexArray(node_vao);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(node_count));
+    }
+    
+    glBindVertexArray(0);
+    glUseProgram(0);
+    if (depth_test)
+        glEnable(GL_DEPTH_TEST);
+    for (blt::size_t i = 0; i < conf::ATLAS_MAX_PAGES + 2; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,536 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <journal.h>
+#include <graph.h>
+#include <mapped_file.h>
+#include <snapshot.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <type_traits>
+
+namespace
+{
+    template<typename T>
+    void write(std::vector<char>& out, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+    
+    void write(std::vector<char>& out, const std::string& str)
+    {
+        write(out, static_cast<blt::u32>(str.size()));
+        out.insert(out.end(), str.begin(), str.end());
+    }
+    
+    void write(std::vector<char>& out, const blt::color4& color)
+    {
+        write(out, color.x());
+        write(out, color.y());
+        write(out, color.z());
+        write(out, color.w());
+    }
+    
+    void write_node(std::vector<char>& out, const node_t& node)
+    {
+        write(out, node.scale);
+        write(out, node.outline_scale);
+        write(out, node.outline_color);
+        write(out, node.name);
+        write(out, node.texture);
+        write(out, node.description);
+    }
+    
+    // bounds checked reads out of the payload of a single record
+    class record_reader_t
+    {
+        public:
+            record_reader_t(const char* data, blt::size_t size): data(data), size(size)
+            {}
+            
+            template<typename T>
+            T read()
+            {
+                T value{};
+                if (pos + sizeof(T) > size)
+                {
+                    valid = false;
+                    return value;
+                }
+                std::memcpy(&value, data + pos, sizeof(T));
+                pos += sizeof(T);
+                return value;
+            }
+            
+            std::string read_string()
+            {
+                const auto length = read<blt::u32>();
+                if (!valid || length > size - pos)
+                {
+                    valid = false;
+                    return {};
+                }
+                std::string str{data + pos, length};
+                pos += length;
+                return str;
+            }
+            
+            blt::color4 read_color()
+            {
+                const auto r = read<float>();
+                const auto g = read<float>();
+                const auto b = read<float>();
+                const auto a = read<float>();
+                return blt::color4{r, g, b, a};
+            }
+            
+            void read_node(node_t& node)
+            {
+                node.scale = read<float>();
+                node.outline_scale = read<float>();
+                node.outline_color = read_color();
+                node.name = read_string();
+                node.texture = read_string();
+                node.description = read_string();
+            }
+            
+            bool valid = true;
+        
+        private:
+            const char* data;
+            blt::size_t size;
+            blt::size_t pos = 0;
+    };
+}
+
+void journal_t::open(std::string journal_path, blt::u64 stamp)
+{
+    close();
+    path = std::move(journal_path);
+    // opened for the snapshot of a compaction, whatever was recorded while it was being written starts the new journal
+    if (marked)
+        pending = std::move(carried);
+    else
+    {
+        pending.clear();
+        record_count = 0;
+    }
+    invalid = false;
+    marked = false;
+    carried.clear();
+    stopping = false;
+    pending_reset = stamp;
+    opened = true;
+#ifdef __EMSCRIPTEN__
+    // no pthreads in the web build, records are written as they are made instead.
+    write_out(pending, pending_reset);
+#else
+    writer = std::thread(&journal_t::run, this);
+#endif
+}
+
+void journal_t::close()
+{
+    if (!is_open())
+        return;
+#ifndef __EMSCRIPTEN__
+    {
+        std::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    cond.notify_all();
+    writer.join();
+#endif
+    file.close();
+    opened = false;
+}
+
+void journal_t::begin_compaction()
+{
+    marked = true;
+    marked_invalid = invalid;
+    // the copy has everything up to here, including whatever the journal couldn't describe
+    invalid = false;
+    carried.clear();
+    marked_count = record_count;
+    marked_oldest = oldest_record;
+    record_count = 0;
+}
+
+void journal_t::finish_compaction(blt::u64 stamp)
+{
+    if (!marked)
+        return;
+    marked = false;
+    if (!is_open())
+        return;
+    {
+        std::scoped_lock lock(mutex);
+        // anything still pending is either part of the snapshot or also in carried
+        pending = std::move(carried);
+        pending_reset = stamp;
+    }
+    carried.clear();
+#ifdef __EMSCRIPTEN__
+    write_out(pending, pending_reset);
+#else
+    cond.notify_all();
+#endif
+}
+
+void journal_t::abandon_compaction()
+{
+    if (!marked)
+        return;
+    marked = false;
+    invalid |= marked_invalid;
+    if (marked_count > 0)
+    {
+        record_count += marked_count;
+        oldest_record = marked_oldest;
+    }
+    carried.clear();
+}
+
+void journal_t::invalidate()
+{
+    invalid = true;
+}
+
+bool journal_t::should_compact() const
+{
+    if (!is_open() || marked)
+        return false;
+    if (invalid || record_count >= conf::JOURNAL_COMPACT_RECORDS)
+        return true;
+    const auto age = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - oldest_record) / 1e9;
+    return record_count > 0 && age >= conf::AUTOSAVE_INTERVAL;
+}
+
+void journal_t::record_add_node(const blt::vec2& pos, const node_t& node)
+{
+    if (!begin_record(journal_op_t::ADD_NODE))
+        return;
+    write(record, pos.x());
+    write(record, pos.y());
+    write_node(record, node);
+    end_record();
+}
+
+void journal_t::record_remove_node(blt::u64 node)
+{
+    if (!begin_record(journal_op_t::REMOVE_NODE))
+        return;
+    write(record, node);
+    end_record();
+}
+
+void journal_t::record_move_node(blt::u64 node, const blt::vec2& pos)
+{
+    if (!begin_record(journal_op_t::MOVE_NODE))
+        return;
+    write(record, node);
+    write(record, pos.x());
+    write(record, pos.y());
+    end_record();
+}
+
+void journal_t::record_connect(blt::u64 n1, blt::u64 n2)
+{
+    if (!begin_record(journal_op_t::CONNECT))
+        return;
+    write(record, n1);
+    write(record, n2);
+    end_record();
+}
+
+void journal_t::record_disconnect(blt::u64 n1, blt::u64 n2)
+{
+    if (!begin_record(journal_op_t::DISCONNECT))
+        return;
+    write(record, n1);
+    write(record, n2);
+    end_record();
+}
+
+void journal_t::record_set_node(blt::u64 index, const node_t& node)
+{
+    if (!begin_record(journal_op_t::SET_NODE))
+        return;
+    write(record, index);
+    write_node(record, node);
+    end_record();
+}
+
+void journal_t::record_set_edge(const edge_t& edge)
+{
+    if (!begin_record(journal_op_t::SET_EDGE))
+        return;
+    write(record, static_cast<blt::u64>(edge.getFirst()));
+    write(record, static_cast<blt::u64>(edge.getSecond()));
+    write(record, edge.ideal_spring_length);
+    write(record, edge.thickness);
+    write(record, edge.color);
+    write(record, edge.description);
+    end_record();
+}
+
+bool journal_t::begin_record(journal_op_t op)
+{
+    // with a compaction running the records are kept for the journal going on top of it, even if there is no journal yet
+    if (!(is_open() || marked) || invalid)
+        return false;
+    record.clear();
+    write(record, op);
+    // size of the payload, filled in by end_record
+    write(record, blt::u32{0});
+    return true;
+}
+
+void journal_t::end_record()
+{
+    const auto size = static_cast<blt::u32>(record.size() - sizeof(journal_op_t) - sizeof(blt::u32));
+    std::memcpy(record.data() + sizeof(journal_op_t), &size, sizeof(size));
+    if (marked)
+        carried.insert(carried.end(), record.begin(), record.end());
+    if (is_open() && !(marked && marked_invalid))
+    {
+        std::scoped_lock lock(mutex);
+        pending.insert(pending.end(), record.begin(), record.end());
+#ifdef __EMSCRIPTEN__
+        write_out(pending, pending_reset);
+#endif
+    }
+    if (record_count++ == 0)
+        oldest_record = blt::system::getCurrentTimeNanoseconds();
+}
+
+void journal_t::run()
+{
+    std::vector<char> writing;
+    while (true)
+    {
+        std::optional<blt::u64> reset_stamp;
+        bool stop;
+        {
+            std::unique_lock lock(mutex);
+            cond.wait_for(lock, std::chrono::duration<float>(conf::JOURNAL_FLUSH_INTERVAL), [this]() {
+                return stopping || pending_reset.has_value();
+            });
+            writing.swap(pending);
+            reset_stamp.swap(pending_reset);
+            stop = stopping;
+        }
+        
+        write_out(writing, reset_stamp);
+        if (stop)
+            return;
+    }
+}
+
+void journal_t::write_out(std::vector<char>& records, std::optional<blt::u64>& reset_stamp)
+{
+    // whatever was recorded before the compaction was dropped by finish_compaction(), records only holds those for the new file
+    if (reset_stamp)
+        start_file(*reset_stamp);
+    reset_stamp.reset();
+    if (!records.empty() && file)
+    {
+        file.write(records.data(), static_cast<std::streamsize>(records.size()));
+        file.flush();
+    }
+    records.clear();
+}
+
+void journal_t::start_file(blt::u64 stamp)
+{
+    file.close();
+    
+    journal_header_t header{};
+    std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header.version = JOURNAL_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.stamp = stamp;
+    
+    // the old journal stays in place until the new one is complete
+    const auto temp_path = path + ".tmp";
+    {
+        std::ofstream temp{temp_path, std::ios::binary | std::ios::trunc};
+        temp.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!temp)
+        {
+            BLT_WARN("Unable to write journal %s", path.c_str());
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error)
+    {
+        BLT_WARN("Unable to write journal %s: %s", path.c_str(), error.message().c_str());
+        return;
+    }
+    file.open(path, std::ios::binary | std::ios::app);
+}
+
+blt::size_t journal_t::replay(graph_t& graph, const std::string& path, blt::u64 stamp)
+{
+    if (!std::filesystem::exists(path))
+        return 0;
+    mapped_file_t file{path};
+    journal_header_t header{};
+    if (file.size() < sizeof(header))
+        return 0;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || header.version != JOURNAL_VERSION ||
+        header.byte_order != SNAPSHOT_BYTE_ORDER)
+    {
+        BLT_WARN("%s is not a journal this version can read", path.c_str());
+        return 0;
+    }
+    if (header.stamp != stamp)
+    {
+        BLT_WARN("Journal %s belongs to a different snapshot, ignoring it", path.c_str());
+        return 0;
+    }
+    
+    const auto valid_node = [&graph](blt::u64 node) {
+        return node < graph.nodes.size();
+    };
+    const auto valid_pair = [&valid_node](blt::u64 n1, blt::u64 n2) {
+        return n1 != n2 && valid_node(n1) && valid_node(n2);
+    };
+    
+    blt::size_t applied = 0;
+    blt::size_t skipped = 0;
+    blt::size_t pos = sizeof(header);
+    constexpr auto RECORD_HEADER_SIZE = sizeof(journal_op_t) + sizeof(blt::u32);
+    while (pos + RECORD_HEADER_SIZE <= file.size())
+    {
+        journal_op_t op;
+        blt::u32 size;
+        std::memcpy(&op, file.data() + pos, sizeof(op));
+        std::memcpy(&size, file.data() + pos + sizeof(op), sizeof(size));
+        pos += RECORD_HEADER_SIZE;
+        // the write was cut off
+        if (size > file.size() - pos)
+            break;
+        record_reader_t reader{file.data() + pos, size};
+        pos += size;
+        
+        bool ok = true;
+        switch (op)
+        {
+            case journal_op_t::ADD_NODE:
+            {
+                const auto x = reader.read<float>();
+                const auto y = reader.read<float>();
+                node_t node;
+                reader.read_node(node);
+                if ((ok = reader.valid && !node.name.empty()))
+                    graph.add_node({x, y}, std::move(node));
+                break;
+            }
+            case journal_op_t::REMOVE_NODE:
+            {
+                const auto node = reader.read<blt::u64>();
+                if ((ok = reader.valid && valid_node(node)))
+                    graph.remove_node(node);
+                break;
+            }
+            case journal_op_t::MOVE_NODE:
+            {
+                const auto node = reader.read<blt::u64>();
+                const auto x = reader.read<float>();
+                const auto y = reader.read<float>();
+                if ((ok = reader.valid && valid_node(node)))
+                    graph.move_node(node, {x, y});
+                break;
+            }
+            case journal_op_t::CONNECT:
+            case journal_op_t::DISCONNECT:
+            {
+                const auto n1 = reader.read<blt::u64>();
+                const auto n2 = reader.read<blt::u64>();
+                if ((ok = reader.valid && valid_pair(n1, n2)))
+                {
+                    if (op == journal_op_t::CONNECT)
+                        graph.connect(n1, n2);
+                    else
+                        graph.disconnect(n1, n2);
+                }
+                break;
+            }
+            case journal_op_t::SET_NODE:
+            {
+                const auto index = reader.read<blt::u64>();
+                node_t node;
+                reader.read_node(node);
+                if ((ok = reader.valid && valid_node(index) && !node.name.empty()))
+                {
+                    auto& target = graph.nodes[index];
+                    if (target.name != node.name)
+                    {
+                        auto& names = graph.getNames();
+                        names.erase(target.name);
+                        names.insert({node.name, index});
+                    }
+                    target = std::move(node);
+                    graph.invalidate_nodes();
+                }
+                break;
+            }
+            case journal_op_t::SET_EDGE:
+            {
+                const auto n1 = reader.read<blt::u64>();
+                const auto n2 = reader.read<blt::u64>();
+                const auto length = reader.read<float>();
+                const auto thickness = reader.read<float>();
+                const auto color = reader.read_color();
+                auto description = reader.read_string();
+                if ((ok = reader.valid && valid_pair(n1, n2)))
+                {
+                    auto edge = graph.edges.find(n1, n2);
+                    if ((ok = edge != nullptr))
+                    {
+                        edge->ideal_spring_length = length;
+                        edge->thickness = thickness;
+                        edge->color = color;
+                        edge->description = std::move(description);
+                        graph.invalidate_adjacency();
+                    }
+                }
+                break;
+            }
+            default:
+                ok = false;
+                break;
+        }
+        // every record carries its size, one which doesn't fit is stepped over without losing the ones after it
+        if (ok)
+            applied++;
+        else
+            skipped++;
+    }
+    if (skipped > 0)
+        BLT_WARN("Journal %s has %lu records which don't fit the graph, they were skipped", path.c_str(), static_cast<unsigned long>(skipped));
+    return applied;
+}
@@ -16,145 +16,543 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <loader.h>
+#include <mapped_file.h>
+#include <parser.h>
 #include <blt/std/logging.h>
+#include <blt/std/ranges.h>
+#include <filesystem>
 #include <fstream>
 #include <random>
 #include <nlohmann/json.hpp>
 
-using json = nlohmann::json;
+// ordered so files are written header and nodes first, which lets the streaming loader resolve edges as they arrive
+using json = nlohmann::ordered_json;
 
-template<typename T>
-T load_with_default(const json& data, std::string_view key, T def)
-{
-    if (data.contains(key))
-        return data[key].get<T>();
-    return def;
-}
-
-std::optional<loader_t> loader_t::load_for(engine_t& engine, const blt::gfx::window_data& window_data, std::string_view path,
-                                           std::optional<std::string_view> save_path)
+/**
+ * SAX handler building the graph straight from the parser's events, the file is never held in memory as a json tree.
+ *
+ * Elements of the top level arrays are collected into a small flat element_t and added to the graph as soon as they are closed.
+ * Anything referring to a node by name which hasn't been seen yet (files written by older versions have edges before nodes) is
+ * kept as a pending element and resolved once the whole file has been read.
+ */
+struct loader_t::sax_handler_t
 {
-    auto& graph = engine.graph;
-    graph.clear();
+    using number_integer_t = json::number_integer_t;
+    using number_unsigned_t = json::number_unsigned_t;
+    using number_float_t = json::number_float_t;
+    using string_t = json::string_t;
+    using binary_t = json::binary_t;
     
-    static std::random_device dev;
-    std::uniform_real_distribution pos_x_dist(0.0, static_cast<blt::f64>(window_data.width));
-    std::uniform_real_distribution pos_y_dist(0.0, static_cast<blt::f64>(window_data.height));
+    enum class section_t
+    {
+        NONE, TEXTURES, NODES, EDGES, DESCRIPTIONS, RELATIONSHIPS, NODE_COUNT, EDGE_COUNT
+    };
     
-    if (save_path && std::filesystem::exists(*save_path))
-        path = *save_path;
-    if (!std::filesystem::exists(path))
+    struct element_t
     {
-        BLT_WARN("Unable to load graph file!");
-        return {};
+        std::optional<float> x, y, size, scale, length, thickness;
+        std::optional<std::string> name, texture, path, description;
+        // the two ends of an edge / relationship
+        std::vector<std::string> names;
+        std::vector<float> color;
+        
+        void clear()
+        {
+            x = y = size = scale = length = thickness = {};
+            name = texture = path = description = {};
+            names.clear();
+            color.clear();
+        }
+    };
+    
+    sax_handler_t(graph_t& graph, loader_t& loader, blt::i32 width, blt::i32 height):
+            graph(graph), loader(loader), pos_x_dist(0.0, static_cast<blt::f64>(width)), pos_y_dist(0.0, static_cast<blt::f64>(height))
+    {}
+    
+    bool null()
+    {
+        return true;
     }
-    std::ifstream file{std::string(path)};
-    json data = json::parse(file);
     
-    loader_t loader;
-    if (data.contains("textures"))
+    bool boolean(bool)
+    {
+        return true;
+    }
+    
+    bool number_integer(number_integer_t val)
+    {
+        return number(static_cast<double>(val));
+    }
+    
+    bool number_unsigned(number_unsigned_t val)
     {
-        for (const auto& texture : data["textures"])
+        return number(static_cast<double>(val));
+    }
+    
+    bool number_float(number_float_t val, const string_t&)
+    {
+        return number(val);
+    }
+    
+    bool string(string_t& val)
+    {
+        if (depth == 3 && element_is_array)
+            element.names.push_back(std::move(val));
+        else if (depth == 3)
         {
-            auto texture_path = texture["path"].get<std::string>();
-            auto texture_key = load_with_default(texture, "name", texture_path);
-            loader.textures.emplace_back(texture_key, texture_path);
-        }
+            if (element_key == "name")
+                element.name = std::move(val);
+            else if (element_key == "texture")
+                element.texture = std::move(val);
+            else if (element_key == "path")
+                element.path = std::move(val);
+            else if (element_key == "description")
+                element.description = std::move(val);
+        } else if (depth == 4 && element_key == "nodes")
+            element.names.push_back(std::move(val));
+        return true;
+    }
+    
+    bool binary(binary_t&)
+    {
+        return true;
     }
     
-    if (data.contains("nodes"))
+    bool start_object(std::size_t)
     {
-        for (const auto& node : data["nodes"])
+        return open(false);
+    }
+    
+    bool start_array(std::size_t)
+    {
+        return open(true);
+    }
+    
+    bool end_object()
+    {
+        return close();
+    }
+    
+    bool end_array()
+    {
+        return close();
+    }
+    
+    bool key(string_t& val)
+    {
+        if (depth == 1)
         {
-            auto x = static_cast<blt::f32>(load_with_default(node, "x", pos_x_dist(dev)));
-            auto y = static_cast<blt::f32>(load_with_default(node, "y", pos_y_dist(dev)));
-            auto size = static_cast<blt::f32>(load_with_default(node, "size", static_cast<blt::f64>(conf::POINT_SIZE)));
-            auto name = load_with_default<std::string>(node, "name", get_name());
-            auto texture = load_with_default<std::string>(node, "texture", conf::DEFAULT_IMAGE);
-            auto outline_scale = load_with_default(node, "scale", conf::OUTLINE_SCALE);
-            auto outline_color = load_with_default(node, "color", json::array());
-            
-            BLT_ASSERT(!graph.names_to_node.contains(name) && "Graph node name must be unique!");
-            graph.names_to_node.insert({name, static_cast<blt::u64>(graph.nodes.size())});
-            graph.nodes.emplace_back(blt::gfx::point2d_t{x, y, size}, std::move(name));
-            graph.nodes.back().texture = std::move(texture);
-            graph.nodes.back().outline_scale = outline_scale;
-            if (outline_color.is_array() && outline_color.size() >= 3)
-            {
-                auto r = static_cast<float>(outline_color[0].get<double>());
-                auto g = static_cast<float>(outline_color[1].get<double>());
-                auto b = static_cast<float>(outline_color[2].get<double>());
-                if (outline_color > 3)
-                    graph.nodes.back().outline_color = blt::vec4{r, g, b, static_cast<float>(outline_color[3].get<double>())};
-                else
-                    graph.nodes.back().outline_color = blt::make_color(r, g, b);
-            }
-        }
+            section = section_of(val);
+            // saved files have every edge before the relationships, which can then find their edge straight away
+            if (section == section_t::RELATIONSHIPS)
+                batch.commit();
+        } else if (depth == 3)
+            element_key = std::move(val);
+        return true;
+    }
+    
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex)
+    {
+        BLT_WARN("Unable to parse graph file at byte %lu: %s", static_cast<unsigned long>(position), ex.what());
+        return false;
+    }
+    
+    // everything which had to wait for the rest of the file
+    void resolve_pending()
+    {
+        for (auto& pending : pending_edges)
+            add_edge(pending, true);
+        // relationships can only find their edge once the edges are in the graph
+        batch.commit();
+        for (auto& pending : pending_descriptions)
+            add_description(pending, true);
+        for (auto& pending : pending_relationships)
+            add_relationship(pending, true);
+        pending_edges.clear();
+        pending_descriptions.clear();
+        pending_relationships.clear();
     }
     
-    if (data.contains("edges"))
+    /**
+     * Adds an element built by something other than the json parser, the way it would have been added at the end of its section.
+     * new_element is left with whatever element was used last so the memory can be reused.
+     */
+    void add_element(section_t element_section, element_t& new_element)
     {
-        for (const auto& edge : data["edges"])
+        section = element_section;
+        std::swap(element, new_element);
+        finish_element();
+        section = section_t::NONE;
+    }
+    
+    private:
+        static section_t section_of(std::string_view key)
         {
-            std::string index1;
-            std::string index2;
-            if (edge.is_array())
+            if (key == "textures")
+                return section_t::TEXTURES;
+            if (key == "nodes")
+                return section_t::NODES;
+            if (key == "edges")
+                return section_t::EDGES;
+            if (key == "descriptions")
+                return section_t::DESCRIPTIONS;
+            if (key == "relationships")
+                return section_t::RELATIONSHIPS;
+            if (key == "node_count")
+                return section_t::NODE_COUNT;
+            if (key == "edge_count")
+                return section_t::EDGE_COUNT;
+            return section_t::NONE;
+        }
+        
+        bool number(double val)
+        {
+            if (depth == 1)
+            {
+                // optional header, only used to size everything up front
+                const auto count = static_cast<blt::size_t>(std::max(val, 0.0));
+                if (section == section_t::NODE_COUNT)
+                    batch.reserve(count, 0);
+                else if (section == section_t::EDGE_COUNT)
+                    batch.reserve(0, count);
+            } else if (depth == 3 && !element_is_array)
             {
-                index1 = edge[0].get<std::string>();
-                index2 = edge[1].get<std::string>();
-            } else
+                const auto value = static_cast<float>(val);
+                if (element_key == "x")
+                    element.x = value;
+                else if (element_key == "y")
+                    element.y = value;
+                else if (element_key == "size")
+                    element.size = value;
+                else if (element_key == "scale")
+                    element.scale = value;
+                else if (element_key == "length")
+                    element.length = value;
+                else if (element_key == "thickness")
+                    element.thickness = value;
+            } else if (depth == 4 && element_key == "color")
+                element.color.push_back(static_cast<float>(val));
+            return true;
+        }
+        
+        bool open(bool is_array)
+        {
+            depth++;
+            if (depth == 3)
+            {
+                element.clear();
+                element_key.clear();
+                element_is_array = is_array;
+            }
+            return true;
+        }
+        
+        bool close()
+        {
+            if (depth == 3)
+                finish_element();
+            if (depth == 2)
+                section = section_t::NONE;
+            depth--;
+            return true;
+        }
+        
+        void finish_element()
+        {
+            switch (section)
             {
-                auto& nodes = edge["nodes"];
-                index1 = nodes[0].get<std::string>();
-                index2 = nodes[1].get<std::string>();
+                case section_t::TEXTURES:
+                    if (element.path)
+                        loader.textures.emplace_back(element.name ? *element.name : *element.path, *element.path);
+                    break;
+                case section_t::NODES:
+                    add_node();
+                    break;
+                case section_t::EDGES:
+                    add_edge(element, false);
+                    break;
+                case section_t::DESCRIPTIONS:
+                    add_description(element, false);
+                    break;
+                case section_t::RELATIONSHIPS:
+                    add_relationship(element, false);
+                    break;
+                default:
+                    break;
             }
-            auto ideal_length = load_with_default(edge, "length", conf::DEFAULT_SPRING_LENGTH);
-            auto thickness = load_with_default(edge, "thickness", conf::DEFAULT_THICKNESS);
+        }
+        
+        void add_node()
+        {
+            auto x = element.x ? *element.x : static_cast<blt::f32>(pos_x_dist(dev));
+            auto y = element.y ? *element.y : static_cast<blt::f32>(pos_y_dist(dev));
+            auto name = element.name ? std::move(*element.name) : get_name();
             
-            edge_t e{graph.names_to_node[index1], graph.names_to_node[index2]};
-            e.ideal_spring_length = ideal_length;
-            e.thickness = thickness;
+            BLT_ASSERT(!graph.getNames().contains(name) && "Graph node name must be unique!");
+            batch.add_node({x, y}, node_t{element.size ? *element.size : conf::POINT_SIZE, std::move(name)});
+            auto& node = graph.nodes.back();
+            node.texture = element.texture ? std::move(*element.texture) : conf::DEFAULT_IMAGE;
+            node.outline_scale = element.scale ? *element.scale : conf::OUTLINE_SCALE;
+            const auto& color = element.color;
+            if (color.size() > 3)
+                node.outline_color = blt::vec4{color[0], color[1], color[2], color[3]};
+            else if (color.size() == 3)
+                node.outline_color = blt::make_color(color[0], color[1], color[2]);
+        }
+        
+        // finds both ends of an edge, false if either isn't known (yet)
+        bool find_ends(const element_t& edge, blt::u64& n1, blt::u64& n2) const
+        {
+            if (edge.names.size() < 2)
+                return false;
+            auto& names = graph.getNames();
+            const auto i1 = names.find(edge.names[0]);
+            const auto i2 = names.find(edge.names[1]);
+            if (i1 == names.end() || i2 == names.end())
+                return false;
+            n1 = i1->second;
+            n2 = i2->second;
+            return true;
+        }
+        
+        void add_edge(element_t& edge, bool last_chance)
+        {
+            blt::u64 n1, n2;
+            if (!find_ends(edge, n1, n2))
+            {
+                if (!last_chance)
+                    pending_edges.push_back(std::move(edge));
+                else
+                    BLT_WARN("Edge %s -> %s refers to a node which doesn't exist!", name_or_empty(edge, 0), name_or_empty(edge, 1));
+                return;
+            }
             
-            graph.connect(e);
+            edge_t e{n1, n2};
+            e.ideal_spring_length = edge.length ? *edge.length : conf::DEFAULT_SPRING_LENGTH;
+            e.thickness = edge.thickness ? *edge.thickness : conf::DEFAULT_THICKNESS;
+            batch.connect(std::move(e));
+        }
+        
+        void add_description(element_t& desc, bool last_chance)
+        {
+            if (!desc.name)
+                return;
+            auto& names = graph.getNames();
+            if (auto node = names.find(*desc.name); node != names.end())
+                graph.nodes[node->second].description = desc.description ? std::move(*desc.description) : "";
+            else if (!last_chance)
+                pending_descriptions.push_back(std::move(desc));
+            else
+                BLT_WARN("Node %s doesn't exist!", desc.name->c_str());
+        }
+        
+        void add_relationship(element_t& desc, bool last_chance)
+        {
+            blt::u64 n1, n2;
+            if (find_ends(desc, n1, n2))
+            {
+                if (auto edge = graph.edges.find(n1, n2))
+                {
+                    edge->description = desc.description ? std::move(*desc.description) : "";
+                    graph.invalidate_adjacency();
+                    return;
+                }
+            }
+            // edges are only in the graph once the batch is committed
+            if (!last_chance)
+                pending_relationships.push_back(std::move(desc));
+            else
+                BLT_WARN("Edge %s -> %s doesn't exist!", name_or_empty(desc, 0), name_or_empty(desc, 1));
+        }
+        
+        static const char* name_or_empty(const element_t& element, blt::size_t index)
+        {
+            return index < element.names.size() ? element.names[index].c_str() : "";
+        }
+        
+        graph_t& graph;
+        loader_t& loader;
+        
+        // seeded once, std::random_device can be a syscall for every number
+        random_t dev{std::random_device{}()};
+        std::uniform_real_distribution<blt::f64> pos_x_dist;
+        std::uniform_real_distribution<blt::f64> pos_y_dist;
+        
+        // number of objects / arrays currently open. 1 is the file itself, 2 a section and 3 an element of a section
+        blt::size_t depth = 0;
+        section_t section = section_t::NONE;
+        element_t element;
+        bool element_is_array = false;
+        std::string element_key;
+        
+        // every node and edge of the file, applied at the end by resolve_pending()
+        graph_batch_t batch{graph};
+        
+        std::vector<element_t> pending_edges;
+        std::vector<element_t> pending_descriptions;
+        std::vector<element_t> pending_relationships;
+};
+
+/**
+ * Turns the declarations of a .graph file into elements for the sax handler, which takes care of names that are used before
+ * the node they refer to is declared.
+ */
+struct loader_t::dsl_handler_t : public proc::parse_handler_t
+{
+    using section_t = sax_handler_t::section_t;
+    
+    explicit dsl_handler_t(sax_handler_t& elements): elements(elements)
+    {}
+    
+    void texture(const proc::texture_decl_t& decl) final
+    {
+        element.clear();
+        element.name = decl.name;
+        element.path = decl.path;
+        elements.add_element(section_t::TEXTURES, element);
+    }
+    
+    void node(const proc::node_decl_t& decl) final
+    {
+        element.clear();
+        element.name = decl.name;
+        if (decl.texture)
+            element.texture = *decl.texture;
+        if (decl.location)
+        {
+            element.x = decl.location->x();
+            element.y = decl.location->y();
         }
+        element.size = decl.size;
+        element.scale = decl.scale;
+        if (decl.color)
+            element.color.assign({decl.color->x(), decl.color->y(), decl.color->z(), decl.color->w()});
+        elements.add_element(section_t::NODES, element);
+        
+        if (decl.description)
+            description({decl.name, *decl.description});
     }
     
-    if (data.contains("descriptions"))
+    void edge(const proc::edge_decl_t& decl) final
     {
-        for (const auto& desc : data["descriptions"])
+        element.clear();
+        element.names.emplace_back(decl.first);
+        element.names.emplace_back(decl.second);
+        element.length = decl.length;
+        element.thickness = decl.thickness;
+        elements.add_element(section_t::EDGES, element);
+        
+        if (decl.description)
         {
-            if (auto node = graph.names_to_node.find(desc["name"].get<std::string>()); node != graph.names_to_node.end())
-                graph.nodes[node->second].description = desc["description"];
-            else
-                BLT_WARN("Node %s doesn't exist!", desc["name"].get<std::string>().c_str());
+            element.clear();
+            element.names.emplace_back(decl.first);
+            element.names.emplace_back(decl.second);
+            element.description = *decl.description;
+            elements.add_element(section_t::RELATIONSHIPS, element);
         }
     }
     
-    if (data.contains("relationships"))
+    void description(const proc::description_decl_t& decl) final
     {
-        for (const auto& desc : data["relationships"])
+        element.clear();
+        element.name = decl.name;
+        element.description = decl.text;
+        elements.add_element(section_t::DESCRIPTIONS, element);
+    }
+    
+    sax_handler_t& elements;
+    sax_handler_t::element_t element;
+};
+
+std::optional<loader_t> loader_t::load_for(graph_t& graph, blt::i32 width, blt::i32 height, std::string_view path,
+                                           std::optional<std::string_view> save_path)
+{
+    graph.clear();
+    
+    if (save_path)
+    {
+        // the snapshot written on exit loads far faster, unless the json has been edited since it was written
+        const auto snapshot = snapshot_path(*save_path);
+        if (std::filesystem::exists(snapshot) &&
+            (!std::filesystem::exists(*save_path) || std::filesystem::last_write_time(snapshot) >= std::filesystem::last_write_time(*save_path)))
         {
-            auto nodes = desc["nodes"];
-            auto n1 = graph.names_to_node[nodes[0].get<std::string>()];
-            auto n2 = graph.names_to_node[nodes[1].get<std::string>()];
-            if (auto node = graph.edges.find({n1, n2}); node != graph.edges.end())
+            if (auto loader = load_snapshot(graph, snapshot))
             {
-                edge_t e = *node;
-                e.description = desc["description"];
-                graph.edges.erase({n1, n2});
-                graph.edges.insert(e);
-            } else
-                BLT_WARN("Edge %s -> %s doesn't exist!", nodes[0].get<std::string>().c_str(), nodes[1].get<std::string>().c_str());
+                if (loader->stamp != 0)
+                {
+                    if (const auto records = journal_t::replay(graph, journal_path(*save_path), loader->stamp))
+                        BLT_INFO("Recovered %lu edits from the journal", static_cast<unsigned long>(records));
+                }
+                return loader;
+            }
         }
+        if (std::filesystem::exists(*save_path))
+            path = *save_path;
     }
+    if (!std::filesystem::exists(path))
+    {
+        BLT_WARN("Unable to load graph file!");
+        return {};
+    }
+    if (std::filesystem::path(path).extension() == ".graph")
+        return load_dsl(graph, width, height, path);
+    std::ifstream file{std::string(path)};
+    
+    loader_t loader;
+    sax_handler_t handler{graph, loader, width, height};
+    if (!json::sax_parse(file, &handler))
+    {
+        graph.clear();
+        return {};
+    }
+    handler.resolve_pending();
     
     return loader;
 }
 
-void loader_t::save_for(engine_t& engine, const loader_t& loader, std::string_view path)
+std::optional<loader_t> loader_t::load_dsl(graph_t& graph, blt::i32 width, blt::i32 height, std::string_view path)
+{
+    graph.clear();
+    
+    mapped_file_t file{std::string(path)};
+    // an empty file is an empty graph, the parser is fine with that
+    if (!file.is_open())
+    {
+        BLT_WARN("Unable to load graph file!");
+        return {};
+    }
+    
+    loader_t loader;
+    sax_handler_t elements{graph, loader, width, height};
+    dsl_handler_t handler{elements};
+    proc::parser_t parser{file.view()};
+    if (!parser.parse(handler))
+    {
+        graph.clear();
+        return {};
+    }
+    elements.resolve_pending();
+    
+    return loader;
+}
+
+bool loader_t::save_for(graph_t& graph, const loader_t& loader, std::string_view path)
+{
+    return write_json(graph, loader, path);
+}
+
+bool loader_t::save_for(const graph_copy_t& graph, const loader_t& loader, std::string_view path)
+{
+    return write_json(copy_view_t{*graph.nodes, graph.node_state, *graph.edges}, loader, path);
+}
+
+template<typename GRAPH>
+bool loader_t::write_json(const GRAPH& graph, const loader_t& loader, std::string_view path)
 {
-    auto& graph = engine.graph;
     json data;
+    // lets the loader reserve everything up front
+    data["node_count"] = graph.nodes.size();
+    data["edge_count"] = graph.edges.size();
     data["textures"] = json::array();
     data["nodes"] = json::array();
     data["edges"] = json::array();
@@ -169,15 +567,16 @@ void loader_t::save_for(engine_t& engine, const loader_t& loader, std::string_vi
         });
     }
     
-    for (const auto& node : graph.nodes)
+    for (const auto& [index, node] : blt::enumerate(graph.nodes))
     {
         const auto& color = node.outline_color;
+        const auto pos = graph.node_state.getPosition(index);
         data["nodes"].push_back(json{
                 {"name",    node.name},
                 {"texture", node.texture},
-                {"size",    node.getRenderObj().scale},
-                {"x",       node.getPosition().x()},
-                {"y",       node.getPosition().y()},
+                {"size",    node.scale},
+                {"x",       pos.x()},
+                {"y",       pos.y()},
                 {"scale",   node.outline_scale},
                 {"color",   json::array({color.x(), color.y(), color.z(), color.w()})}
         });
@@ -200,6 +599,24 @@ void loader_t::save_for(engine_t& engine, const loader_t& loader, std::string_vi
         });
     }
     
-    std::ofstream file{std::string(path)};
-    file << data.dump(4);
+    // a save cut short by a crash never replaces the last good one
+    const auto temp_path = std::string(path) + ".tmp";
+    {
+        std::ofstream file{temp_path, std::ios::trunc};
+        file << data.dump(4);
+        if (!file)
+        {
+            BLT_WARN("Failed to write %s!", temp_path.c_str());
+            return false;
+        }
+    }
+    
+    std::error_code error;
+    std::filesystem::rename(temp_path, std::string(path), error);
+    if (error)
+    {
+        BLT_WARN("Unable to replace %s: %s", std::string(path).c_str(), error.message().c_str());
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
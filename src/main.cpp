@@ -24,11 +24,16 @@
 #include <blt/math/log_util.h>
 #include <graph.h>
 #include <loader.h>
+#include <save_thread.h>
+#include <texture_atlas.h>
+#include <graph_renderer.h>
 
 blt::gfx::matrix_state_manager global_matrices;
 blt::gfx::resource_manager resources;
 blt::gfx::batch_renderer_2d renderer_2d(resources, global_matrices);
 blt::gfx::first_person_camera_2d camera;
+texture_atlas_t atlas;
+graph_renderer_t graph_renderer;
 
 namespace im = ImGui;
 
@@ -39,68 +44,125 @@ namespace im = ImGui;
  *  - Selected Node
  *  - ability to add nodes to the graph
  *  - ability to add edges to the graph
- *  - ability to remove edges from the graph (multi selection?)
- *  - ability to remove nodes from graph (make use of multi selection?)
+ *  - ability to remove the edges between every node of a box / lasso selection
  */
 engine_t engine;
 loader_t loader_data;
+save_thread_t saver;
 
 void init(const blt::gfx::window_data& data)
 {
     using namespace blt::gfx;
     resources.setPrefixDirectory("../");
+    atlas.setPrefixDirectory("../");
     
-    resources.enqueue("res/debian.png", "debian");
-    resources.enqueue("res/parker.png", "parker");
-    resources.enqueue("res/parkerpoint.png", "parker_point");
-    resources.enqueue("res/parker cat ears.jpg", "parkercat");
-    resources.enqueue("res/ivy.jpg", "ivy");
-    resources.enqueue("res/sayori.jpg", "sayori");
-    resources.enqueue("res/jacob.jpg", "jacob");
-    resources.enqueue("res/braxton.jpg", "braxton");
-    resources.enqueue("res/ben.jpg", "ben");
-    resources.enqueue("res/no_image.jpg", "unknown");
-    resources.enqueue("res/me.png", "me");
-    resources.enqueue("res/jim.jpg", "jim");
+    // node textures are only read once a node using them is on screen, see texture_atlas_t
+    atlas.add_source("debian", "res/debian.png");
+    atlas.add_source("parker", "res/parker.png");
+    atlas.add_source("parker_point", "res/parkerpoint.png");
+    atlas.add_source("parkercat", "res/parker cat ears.jpg");
+    atlas.add_source("ivy", "res/ivy.jpg");
+    atlas.add_source("sayori", "res/sayori.jpg");
+    atlas.add_source("jacob", "res/jacob.jpg");
+    atlas.add_source("braxton", "res/braxton.jpg");
+    atlas.add_source("ben", "res/ben.jpg");
+    atlas.add_source("unknown", "res/no_image.jpg");
+    atlas.add_source("me", "res/me.png");
+    atlas.add_source("jim", "res/jim.jpg");
     
     if (auto loader = loader_t::load_for(engine, data, "default.json", "save.json"))
     {
         loader_data = *loader;
         for (const auto& [key, path] : loader_data.textures)
-            resources.enqueue(path, key);
+            atlas.add_source(key, path);
     } else
         engine.init(data);
+    // from here on every edit is journaled on top of a fresh snapshot of whatever was loaded. the snapshot is written by the save
+    // thread, edits made before it is done are kept and start the journal once update() picks up the result
+    loader_t::compact_async(engine, loader_data, saver, "save.json");
     
     global_matrices.create_internals();
     resources.load_resources();
     renderer_2d.create();
+    atlas.create();
+    graph_renderer.create();
 }
 
 void update(const blt::gfx::window_data& data)
 {
+    auto& profiler = engine.getProfiler();
+    profiler.begin_frame();
+    
     global_matrices.update_perspectives(data.width, data.height, 90, 0.1, 2000);
     
     //im::ShowDemoWindow();
     
+    {
+        profile_scope_t scope{profiler, "textures"};
+        atlas.update();
+    }
+    
     engine.render(data);
     
-    if (!im::GetIO().WantCaptureKeyboard)
-        camera.update();
-    camera.update_view(global_matrices);
-    global_matrices.update();
+    {
+        // only copying the graph happens here, the files are written by the save thread
+        profile_scope_t scope{profiler, "save"};
+        auto& journal = engine.getJournal();
+        while (const auto result = saver.poll())
+            loader_t::finish_compaction(loader_data, journal, *result);
+        if (!journal.compacting())
+        {
+            if (engine.consume_save_request())
+                loader_t::compact_async(engine, loader_data, saver, "save.json", true);
+            else if (journal.should_compact())
+                loader_t::compact_async(engine, loader_data, saver, "save.json");
+        }
+    }
+    
+    {
+        profile_scope_t scope{profiler, "camera"};
+        if (!im::GetIO().WantCaptureKeyboard)
+            camera.update();
+        camera.update_view(global_matrices);
+        global_matrices.update();
+    }
+    
+    {
+        profile_scope_t scope{profiler, "renderer_2d"};
+        renderer_2d.render(data.width, data.height);
+    }
+    
+    {
+        profile_scope_t scope{profiler, "draw graph"};
+        graph_renderer.render(global_matrices.getOrtho(), global_matrices.getView2D(), data.width, atlas);
+    }
+    
+    {
+        // a second pass of the 2d renderer, anything drawn with the first ends up underneath the graph
+        profile_scope_t scope{profiler, "overlay"};
+        engine.render_overlay(data);
+        renderer_2d.render(data.width, data.height);
+    }
     
-    renderer_2d.render(data.width, data.height);
+    profiler.end_frame();
 }
 
 int main(int, const char**)
 {
     blt::gfx::init(blt::gfx::window_data{"Force-Directed Graph Drawing", init, update, 1440, 720}.setSyncInterval(1));
     
-    loader_t::save_for(engine, loader_data, "save.json");
+    // let any save still being written finish before the final one
+    saver.stop();
+    while (const auto result = saver.poll())
+        loader_t::finish_compaction(loader_data, engine.getJournal(), *result);
+    loader_t::compact(engine, loader_data, "save.json");
+    engine.getJournal().close();
     
     global_matrices.cleanup();
     resources.cleanup();
     renderer_2d.cleanup();
+    graph_renderer.cleanup();
+    atlas.cleanup();
     blt::gfx::cleanup();
     
     return 0;
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <mapped_file.h>
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define GRAPHS_HAS_MMAP
+#endif
+
+mapped_file_t::mapped_file_t(const std::string& path)
+{
+#ifdef GRAPHS_HAS_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat info{};
+    if (::fstat(fd, &info) == 0)
+    {
+        // an empty file can't be mapped, it is still open with nothing in it
+        opened = true;
+        if (info.st_size > 0)
+        {
+            void* mapping = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                bytes = static_cast<const char*>(mapping);
+                length = static_cast<blt::size_t>(info.st_size);
+                // the whole file is read front to back once
+                ::madvise(mapping, length, MADV_SEQUENTIAL);
+            } else
+                opened = false;
+        }
+    }
+    ::close(fd);
+#else
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file)
+        return;
+    opened = true;
+    buffer.resize(static_cast<blt::size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    bytes = buffer.data();
+    length = buffer.size();
+#endif
+}
+
+mapped_file_t::~mapped_file_t()
+{
+#ifdef GRAPHS_HAS_MMAP
+    if (bytes)
+        ::munmap(const_cast<char*>(bytes), length);
+#endif
+}
@@ -0,0 +1,267 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <multilevel.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+
+namespace
+{
+    constexpr blt::u32 UNMATCHED = std::numeric_limits<blt::u32>::max();
+    
+    /**
+     * Builds the next coarser level by collapsing a matching of the edges.
+     * @param parent filled with the coarse node every node of the fine level was collapsed into
+     */
+    void coarsen_level(const node_state_t& nodes, const adjacency_t& adjacency, std::vector<blt::u32>& parent, node_state_t& coarse_nodes,
+                       adjacency_t& coarse_adjacency, std::mt19937_64& rng)
+    {
+        std::vector<blt::u32> order(nodes.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), rng);
+        
+        parent.assign(nodes.size(), UNMATCHED);
+        blt::u32 coarse_count = 0;
+        for (const auto v : order)
+        {
+            if (parent[v] != UNMATCHED)
+                continue;
+            // the edges don't have weights, pairing with the lightest neighbour keeps the coarse nodes about the same size instead
+            auto match = UNMATCHED;
+            for (const auto u : adjacency.neighbours(v))
+            {
+                if (parent[u] == UNMATCHED && (match == UNMATCHED || nodes.mass[u] < nodes.mass[match]))
+                    match = u;
+            }
+            // leaves whose neighbour is taken join it anyway, otherwise star shaped parts of the graph never get any smaller
+            if (match == UNMATCHED && adjacency.degree(v) == 1)
+            {
+                parent[v] = parent[*adjacency.neighbours(v).begin()];
+                continue;
+            }
+            parent[v] = coarse_count;
+            if (match != UNMATCHED)
+                parent[match] = coarse_count;
+            coarse_count++;
+        }
+        
+        coarse_nodes.clear();
+        coarse_nodes.reserve(coarse_count);
+        for (blt::u32 i = 0; i < coarse_count; i++)
+            coarse_nodes.push_back({}, 0, 0);
+        std::vector<blt::u32> members(coarse_count, 0);
+        for (blt::size_t i = 0; i < nodes.size(); i++)
+        {
+            const auto p = parent[i];
+            coarse_nodes.x[p] += nodes.x[i];
+            coarse_nodes.y[p] += nodes.y[i];
+            coarse_nodes.repulsiveness[p] += nodes.repulsiveness[i];
+            members[p]++;
+        }
+        // coarse nodes are laid out at the same spacing as the real ones, prolongation scales the layout back up. Weighting the
+        // repulsion by the number of nodes collapsed together instead doesn't work with the log springs of Eades
+        for (blt::u32 i = 0; i < coarse_count; i++)
+        {
+            const auto count = static_cast<float>(members[i]);
+            coarse_nodes.x[i] /= count;
+            coarse_nodes.y[i] /= count;
+            coarse_nodes.repulsiveness[i] /= count;
+            coarse_nodes.mass[i] = 1;
+        }
+        
+        edge_table_t edges;
+        edges.reserve(adjacency.getEdges().size());
+        for (const auto& edge : adjacency.getEdges())
+        {
+            const auto first = parent[edge.getFirst()];
+            const auto second = parent[edge.getSecond()];
+            if (first == second)
+                continue;
+            edge_t coarse_edge{first, second};
+            coarse_edge.ideal_spring_length = edge.ideal_spring_length;
+            edges.insert(std::move(coarse_edge));
+        }
+        coarse_adjacency.build(coarse_count, edges);
+    }
+}
+
+multilevel_layout_t::multilevel_layout_t(const multilevel_settings_t& settings): settings(settings), rng(settings.seed)
+{}
+
+void multilevel_layout_t::coarsen(const node_state_t& nodes, const adjacency_t& adjacency)
+{
+    while (true)
+    {
+        const auto& fine = coarse.empty() ? nodes : coarse.back().nodes;
+        const auto& fine_adjacency = coarse.empty() ? adjacency : coarse.back().adjacency;
+        if (fine.size() <= static_cast<blt::size_t>(std::max(settings.coarsest_size, 1)))
+            break;
+        level_t next;
+        std::vector<blt::u32> parent;
+        coarsen_level(fine, fine_adjacency, parent, next.nodes, next.adjacency, rng);
+        if (static_cast<float>(next.nodes.size()) > static_cast<float>(fine.size()) * (1.0f - settings.min_reduction))
+            break;
+        coarse.push_back(std::move(next));
+        parents.push_back(std::move(parent));
+    }
+}
+
+int multilevel_layout_t::iterations_for(blt::size_t level, blt::size_t node_count) const
+{
+    if (level == coarse.size())
+        return std::max(settings.coarsest_iterations, 1);
+    const auto budget = static_cast<blt::size_t>(std::max(settings.level_work, 0)) / std::max(node_count, static_cast<blt::size_t>(1));
+    const auto capped = std::min(static_cast<blt::size_t>(std::max(settings.level_iterations, 1)), budget);
+    return std::max(static_cast<int>(capped), std::max(settings.min_level_iterations, 1));
+}
+
+float multilevel_layout_t::temperature_for(blt::size_t level, blt::size_t node_count) const
+{
+    // the coarsest level starts from scratch and may have to move nodes across the entire layout
+    if (level == coarse.size())
+        return conf::DEFAULT_SPRING_LENGTH * std::sqrt(static_cast<float>(node_count));
+    return conf::DEFAULT_SPRING_LENGTH * 2;
+}
+
+void multilevel_layout_t::prolong(node_state_t& nodes)
+{
+    auto& fine = level == 1 ? nodes : coarse[level - 2].nodes;
+    const auto& parent_nodes = coarse[level - 1].nodes;
+    const auto& parent = parents[level - 1];
+    
+    // the fine level has more nodes at the same spacing, so it needs more room
+    blt::vec2 center;
+    for (blt::size_t i = 0; i < parent_nodes.size(); i++)
+        center += parent_nodes.getPosition(i);
+    center = center / static_cast<float>(parent_nodes.size());
+    const auto scale = settings.expansion * std::sqrt(static_cast<float>(fine.size()) / static_cast<float>(parent_nodes.size()));
+    
+    // nodes collapsed into the same parent would start on top of each other and never push apart, so they are spread out a bit
+    std::uniform_real_distribution<float> jitter(-conf::DEFAULT_SPRING_LENGTH * 0.1f, conf::DEFAULT_SPRING_LENGTH * 0.1f);
+    for (blt::size_t i = 0; i < fine.size(); i++)
+    {
+        const auto pos = center + (parent_nodes.getPosition(parent[i]) - center) * scale;
+        fine.x[i] = pos.x() + jitter(rng);
+        fine.y[i] = pos.y() + jitter(rng);
+    }
+    level--;
+}
+
+bool multilevel_layout_t::advance(simulation_t& simulation, node_state_t& nodes, const adjacency_t& adjacency, double max_milliseconds)
+{
+    if (finished)
+        return true;
+    const auto slice_start = blt::system::getCurrentTimeNanoseconds();
+    const auto level_nodes = [&](blt::size_t l) -> node_state_t& {
+        return l == 0 ? nodes : coarse[l - 1].nodes;
+    };
+    const auto level_adjacency = [&](blt::size_t l) -> const adjacency_t& {
+        return l == 0 ? adjacency : coarse[l - 1].adjacency;
+    };
+    const auto begin_level = [&]() {
+        const auto size = level_nodes(level).size();
+        level_iteration = 0;
+        level_iterations = iterations_for(level, size);
+        temperature = temperature_for(level, size);
+    };
+    
+    if (!coarsened)
+    {
+        coarsened = true;
+        start = slice_start;
+        if (nodes.empty())
+        {
+            finished = true;
+            return true;
+        }
+        coarsen(nodes, adjacency);
+        for (blt::size_t l = 0; l <= coarse.size(); l++)
+            total_work += static_cast<blt::u64>(iterations_for(l, level_nodes(l).size())) * level_nodes(l).size();
+        level = coarse.size();
+        begin_level();
+    }
+    
+    const auto saved_iterations = simulation.current_iterations;
+    const auto saved_settings = simulation.settings;
+    while (true)
+    {
+        const auto size = level_nodes(level).size();
+        // the exact repulsion of a big level would take longer than everything else together, and the refinement steps only have
+        // to be about right
+        if (size > static_cast<blt::size_t>(settings.fine_level_size))
+        {
+            simulation.settings.repulsion_mode = repulsion_mode_t::BARNES_HUT;
+            simulation.settings.theta = settings.fine_theta;
+        } else
+        {
+            simulation.settings.repulsion_mode = saved_settings.repulsion_mode;
+            simulation.settings.theta = saved_settings.theta;
+        }
+        // nodes can only move as far as the temperature allows, which cools down linearly over the level
+        simulation.settings.max_displacement = temperature * static_cast<float>(level_iterations - level_iteration) /
+                                               static_cast<float>(level_iterations);
+        simulation.current_iterations = level_iteration;
+        simulation.step(level_nodes(level), level_adjacency(level), settings.step_size);
+        level_iteration++;
+        result.iterations++;
+        finished_work += size;
+        
+        if (level_iteration >= level_iterations || simulation.max_force_last <= saved_settings.threshold)
+        {
+            // a level which settled early counts the steps it skipped, the progress doesn't stall on them
+            finished_work += static_cast<blt::u64>(level_iterations - level_iteration) * size;
+            if (level == 0)
+            {
+                finished = true;
+                break;
+            }
+            prolong(nodes);
+            begin_level();
+        }
+        const auto elapsed = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - slice_start) / 1e6;
+        if (elapsed >= max_milliseconds)
+            break;
+    }
+    simulation.current_iterations = saved_iterations;
+    simulation.settings = saved_settings;
+    
+    if (finished)
+    {
+        finished_work = total_work;
+        result.levels = coarse.size() + 1;
+        result.milliseconds = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - start) / 1e6;
+        BLT_INFO("Multilevel layout of %lu nodes took %lf ms over %lu levels and %lu iterations", nodes.size(), result.milliseconds,
+                 result.levels, result.iterations);
+        // the coarse levels are only needed while running
+        coarse.clear();
+        parents.clear();
+    }
+    return finished;
+}
+
+multilevel_result_t multilevel_layout(simulation_t& simulation, node_state_t& nodes, const adjacency_t& adjacency,
+                                      const multilevel_settings_t& settings)
+{
+    multilevel_layout_t layout(settings);
+    while (!layout.advance(simulation, nodes, adjacency, std::numeric_limits<double>::infinity()))
+    {}
+    return layout.getResult();
+}
@@ -0,0 +1,328 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <parser.h>
+#include <blt/std/logging.h>
+#include <charconv>
+#include <cctype>
+
+namespace proc
+{
+    namespace
+    {
+        bool equals_ignore_case(std::string_view a, std::string_view b)
+        {
+            if (a.size() != b.size())
+                return false;
+            for (blt::size_t i = 0; i < a.size(); i++)
+            {
+                if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i])))
+                    return false;
+            }
+            return true;
+        }
+    }
+    
+    bool parser_t::parse(parse_handler_t& handler)
+    {
+        while (!at_end)
+        {
+            if (!read_entry())
+                return false;
+            if (entry.empty())
+                continue;
+            
+            bool ok = true;
+            if (entry[0].token == state_t::SQUARE_OPEN)
+                ok = parse_section();
+            else
+            {
+                switch (section)
+                {
+                    case section_t::NONE:
+                        ok = error(entry[0], "expected a section before the first entry");
+                        break;
+                    case section_t::TEXTURES:
+                        ok = parse_texture(handler);
+                        break;
+                    case section_t::NODES:
+                        ok = parse_node(handler);
+                        break;
+                    case section_t::EDGES:
+                        ok = parse_edge(handler);
+                        break;
+                    case section_t::DESCRIPTIONS:
+                        ok = parse_description(handler);
+                        break;
+                    case section_t::UNKNOWN:
+                        // already warned about when the section started
+                        break;
+                }
+            }
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+    
+    bool parser_t::read_entry()
+    {
+        entry.clear();
+        blt::i64 depth = 0;
+        while (true)
+        {
+            const auto token = tokens.next();
+            switch (token.token)
+            {
+                case state_t::END:
+                    at_end = true;
+                    return true;
+                case state_t::NONE:
+                    return error(token, "unreadable token");
+                case state_t::NEWLINE:
+                    // lists can be split over multiple lines
+                    if (depth <= 0)
+                        return true;
+                    continue;
+                case state_t::SEMI:
+                    if (depth <= 0)
+                        return true;
+                    break;
+                case state_t::SQUARE_OPEN:
+                    depth++;
+                    break;
+                case state_t::SQUARE_CLOSE:
+                    depth--;
+                    break;
+                default:
+                    break;
+            }
+            entry.push_back(token);
+        }
+    }
+    
+    bool parser_t::parse_section()
+    {
+        if (entry.size() != 5 || entry[1].token != state_t::SQUARE_OPEN || !is_name(entry[2]) || entry[3].token != state_t::SQUARE_CLOSE ||
+            entry[4].token != state_t::SQUARE_CLOSE)
+            return error(entry[0], "sections are written as [[name]]");
+        
+        const auto name = entry[2].token_data;
+        if (equals_ignore_case(name, "textures"))
+            section = section_t::TEXTURES;
+        else if (equals_ignore_case(name, "nodes"))
+            section = section_t::NODES;
+        else if (equals_ignore_case(name, "edges"))
+            section = section_t::EDGES;
+        else if (equals_ignore_case(name, "descriptions"))
+            section = section_t::DESCRIPTIONS;
+        else
+        {
+            BLT_WARN("Unknown section [[%.*s]] on line %lu will be skipped", static_cast<int>(name.size()), name.data(),
+                     static_cast<unsigned long>(entry[2].line));
+            section = section_t::UNKNOWN;
+        }
+        return true;
+    }
+    
+    bool parser_t::parse_texture(parse_handler_t& handler)
+    {
+        if (entry.size() == 1 && is_name(entry[0]))
+            handler.texture({entry[0].token_data, entry[0].token_data});
+        else if (entry.size() == 3 && is_name(entry[0]) && entry[1].token == state_t::COLON && is_name(entry[2]))
+            handler.texture({entry[0].token_data, entry[2].token_data});
+        else
+            return error(entry[0], "textures are written as path or name: path");
+        return true;
+    }
+    
+    bool parser_t::parse_node(parse_handler_t& handler)
+    {
+        if (!is_name(entry[0]))
+            return error(entry[0], "expected the name of a node");
+        node_decl_t node;
+        node.name = entry[0].token_data;
+        if (entry.size() > 1)
+        {
+            if (entry[1].token != state_t::COLON)
+                return error(entry[1], "expected : after the name of the node");
+            const bool ok = parse_properties(2, [this, &node](const token_t& key, blt::size_t first, blt::size_t last) {
+                const auto name = key.token_data;
+                float values[4];
+                blt::size_t count = 0;
+                // lists are values separated by commas
+                const auto read_values = [this, first, last, &values, &count]() {
+                    for (blt::size_t i = first; i < last; i += 2)
+                    {
+                        if (count == 4 || !to_float(entry[i], values[count]) || (i + 1 < last && entry[i + 1].token != state_t::COMMA))
+                            return false;
+                        count++;
+                    }
+                    return true;
+                };
+                
+                if (name == "texture" || name == "description")
+                {
+                    const auto text = last - first == 1 ? entry[first].token_data : slice(entry[first], entry[last - 1]);
+                    (name == "texture" ? node.texture : node.description) = text;
+                } else if (name == "location")
+                {
+                    if (!read_values() || count != 2)
+                        return error(key, "location is written as [x, y]");
+                    node.location = blt::vec2{values[0], values[1]};
+                } else if (name == "size" || name == "scale")
+                {
+                    if (!read_values() || count != 1)
+                        return error(key, "expected a single number");
+                    (name == "size" ? node.size : node.scale) = values[0];
+                } else if (name == "color")
+                {
+                    if (!read_values() || count < 3)
+                        return error(key, "color is written as [r, g, b] or [r, g, b, a]");
+                    node.color = count == 4 ? blt::vec4{values[0], values[1], values[2], values[3]} : blt::make_color(values[0], values[1], values[2]);
+                } else
+                    BLT_WARN("Unknown node property '%.*s' on line %lu", static_cast<int>(name.size()), name.data(), static_cast<unsigned long>(key.line));
+                return true;
+            });
+            if (!ok)
+                return false;
+        }
+        handler.node(node);
+        return true;
+    }
+    
+    bool parser_t::parse_edge(parse_handler_t& handler)
+    {
+        if (entry.size() < 3 || !is_name(entry[0]) || entry[1].token != state_t::COMMA || !is_name(entry[2]))
+            return error(entry[0], "edges are written as first, second");
+        edge_decl_t edge;
+        edge.first = entry[0].token_data;
+        edge.second = entry[2].token_data;
+        if (entry.size() > 3)
+        {
+            if (entry[3].token != state_t::COLON)
+                return error(entry[3], "expected : after the nodes of the edge");
+            const bool ok = parse_properties(4, [this, &edge](const token_t& key, blt::size_t first, blt::size_t last) {
+                const auto name = key.token_data;
+                if (name == "description")
+                    edge.description = last - first == 1 ? entry[first].token_data : slice(entry[first], entry[last - 1]);
+                else if (name == "length" || name == "thickness")
+                {
+                    float value;
+                    if (last - first != 1 || !to_float(entry[first], value))
+                        return error(key, "expected a single number");
+                    (name == "length" ? edge.length : edge.thickness) = value;
+                } else
+                    BLT_WARN("Unknown edge property '%.*s' on line %lu", static_cast<int>(name.size()), name.data(), static_cast<unsigned long>(key.line));
+                return true;
+            });
+            if (!ok)
+                return false;
+        }
+        handler.edge(edge);
+        return true;
+    }
+    
+    bool parser_t::parse_description(parse_handler_t& handler)
+    {
+        if (entry.size() < 2 || !is_name(entry[0]) || entry[1].token != state_t::COLON)
+            return error(entry[0], "descriptions are written as name: text");
+        description_decl_t description;
+        description.name = entry[0].token_data;
+        // the text is taken as written, only a description which is entirely quoted loses its quotes
+        if (entry.size() == 3)
+            description.text = entry[2].token_data;
+        else if (entry.size() > 3)
+            description.text = slice(entry[2], entry.back());
+        handler.description(description);
+        return true;
+    }
+    
+    template<typename FUNC>
+    bool parser_t::parse_properties(blt::size_t index, FUNC&& func)
+    {
+        while (index < entry.size())
+        {
+            const auto& key = entry[index];
+            if (key.token != state_t::IDENT || index + 2 >= entry.size() || entry[index + 1].token != state_t::EQUAL)
+                return error(key, "properties are written as key=value");
+            
+            blt::size_t first = index + 2;
+            blt::size_t last = first;
+            if (entry[first].token == state_t::SQUARE_OPEN)
+            {
+                first++;
+                last = first;
+                while (last < entry.size() && entry[last].token != state_t::SQUARE_CLOSE)
+                    last++;
+                if (last == entry.size())
+                    return error(entry[first - 1], "unclosed [");
+                index = last + 1;
+            } else
+            {
+                while (last < entry.size() && entry[last].token != state_t::COMMA)
+                    last++;
+                index = last;
+            }
+            if (first == last)
+                return error(key, "missing value");
+            if (!func(key, first, last))
+                return false;
+            
+            if (index < entry.size())
+            {
+                if (entry[index].token != state_t::COMMA)
+                    return error(entry[index], "expected , between properties");
+                index++;
+            }
+        }
+        return true;
+    }
+    
+    std::string_view parser_t::slice(const token_t& first, const token_t& last) const
+    {
+        auto end = static_cast<blt::size_t>(last.token_data.data() - data.data()) + last.token_data.size();
+        // the closing quote isn't part of the text
+        if (last.token == state_t::TEXT)
+            end++;
+        return data.substr(first.token_pos, end - first.token_pos);
+    }
+    
+    bool parser_t::error(const token_t& token, const char* what)
+    {
+        BLT_WARN("Unable to parse graph file on line %lu: %s (at '%.*s')", static_cast<unsigned long>(token.line), what,
+                 static_cast<int>(token.token_data.size()), token.token_data.data());
+        return false;
+    }
+    
+    bool parser_t::is_name(const token_t& token)
+    {
+        return token.token == state_t::IDENT || token.token == state_t::VALUE || token.token == state_t::TEXT;
+    }
+    
+    bool parser_t::to_float(const token_t& token, float& value)
+    {
+        if (token.token != state_t::VALUE)
+            return false;
+        auto text = token.token_data;
+        if (text.back() == 'f' || text.back() == 'F')
+            text.remove_suffix(1);
+        if (!text.empty() && text.front() == '+')
+            text.remove_prefix(1);
+        const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc{} && result.ptr == text.data() + text.size();
+    }
+}
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <profiler.h>
+#include <blt/std/logging.h>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <string>
+#ifndef GRAPHS_HEADLESS
+    #include <imgui.h>
+#endif
+
+void profiler_t::begin_frame()
+{
+    frame_start = blt::system::getCurrentTimeNanoseconds();
+    // everything recorded during the frame is a child of the frame
+    depth = 1;
+}
+
+void profiler_t::end_frame()
+{
+    depth = 0;
+    record("frame", frame_start, blt::system::getCurrentTimeNanoseconds());
+    frame++;
+}
+
+bool profiler_t::write_chrome_trace(std::string_view path) const
+{
+    std::ofstream file{std::string(path)};
+    if (!file)
+    {
+        BLT_WARN("Unable to open %s for writing the profile!", std::string(path).c_str());
+        return false;
+    }
+    
+    blt::i64 first = std::numeric_limits<blt::i64>::max();
+    for_each([&first](const profile_event_t& event) {
+        first = std::min(first, event.start);
+    });
+    
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    file.precision(3);
+    file << std::fixed;
+    bool comma = false;
+    // complete ("X") events on a single thread, the viewer nests them by time
+    for_each([&](const profile_event_t& event) {
+        if (comma)
+            file << ',';
+        comma = true;
+        file << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":"
+             << static_cast<double>(event.start - first) / 1e3 << ",\"dur\":" << static_cast<double>(event.end - event.start) / 1e3
+             << ",\"args\":{\"frame\":" << event.frame << "}}";
+    });
+    file << "\n]}\n";
+    return true;
+}
+
+bool profiler_t::write_csv(std::string_view path) const
+{
+    std::ofstream file{std::string(path)};
+    if (!file)
+    {
+        BLT_WARN("Unable to open %s for writing the profile!", std::string(path).c_str());
+        return false;
+    }
+    
+    blt::i64 first = std::numeric_limits<blt::i64>::max();
+    for_each([&first](const profile_event_t& event) {
+        first = std::min(first, event.start);
+    });
+    
+    file << "frame,name,depth,start_ms,duration_ms\n";
+    file.precision(6);
+    file << std::fixed;
+    for_each([&](const profile_event_t& event) {
+        file << event.frame << ',' << event.name << ',' << event.depth << ',' << static_cast<double>(event.start - first) / 1e6 << ','
+             << static_cast<double>(event.end - event.start) / 1e6 << '\n';
+    });
+    return true;
+}
+
+#ifndef GRAPHS_HEADLESS
+
+void profiler_t::draw_gui()
+{
+    namespace im = ImGui;
+    constexpr int shown_frames = 240;
+    constexpr float row_height = 18;
+    
+    im::Checkbox("Record", &enabled);
+    im::SameLine();
+    if (im::Button("Clear"))
+        clear();
+    im::SameLine();
+    if (im::Button("Export Trace"))
+        write_chrome_trace("profile.json");
+    im::SameLine();
+    if (im::Button("Export CSV"))
+        write_csv("profile.csv");
+    
+    // only the newest frames are plotted, the export has everything in the buffer
+    std::vector<const profile_event_t*> frames;
+    for_each([&frames](const profile_event_t& event) {
+        if (event.depth == 0)
+            frames.push_back(&event);
+    });
+    if (frames.empty())
+    {
+        im::Text("No frames recorded");
+        return;
+    }
+    if (frames.size() > shown_frames)
+        frames.erase(frames.begin(), frames.end() - shown_frames);
+    
+    std::vector<float> frame_times;
+    float max_time = 0;
+    for (const auto* frame_event : frames)
+    {
+        frame_times.push_back(static_cast<float>(frame_event->end - frame_event->start) / 1e6f);
+        max_time = std::max(max_time, frame_times.back());
+    }
+    im::PlotLines("##FrameTimes", frame_times.data(), static_cast<int>(frame_times.size()), 0, "Frame Time (ms)", 0, max_time * 1.1f,
+                  {im::GetContentRegionAvail().x, 60});
+    
+    frame_offset = std::clamp(frame_offset, 0, static_cast<int>(frames.size()) - 1);
+    im::SliderInt("Frames Back", &frame_offset, 0, static_cast<int>(frames.size()) - 1);
+    const auto& selected = *frames[frames.size() - 1 - static_cast<blt::size_t>(frame_offset)];
+    const auto frame_length = static_cast<double>(std::max(selected.end - selected.start, static_cast<blt::i64>(1)));
+    im::Text("Frame %lu: %lf ms", static_cast<unsigned long>(selected.frame), frame_length / 1e6);
+    
+    blt::u32 max_depth = 0;
+    for_each([&](const profile_event_t& event) {
+        if (event.frame == selected.frame)
+            max_depth = std::max(max_depth, event.depth);
+    });
+    
+    auto* draw_list = im::GetWindowDrawList();
+    const auto origin = im::GetCursorScreenPos();
+    const auto width = im::GetContentRegionAvail().x;
+    im::Dummy({width, static_cast<float>(max_depth + 1) * row_height});
+    
+    for_each([&](const profile_event_t& event) {
+        if (event.frame != selected.frame)
+            return;
+        const auto x0 = origin.x + static_cast<float>(static_cast<double>(event.start - selected.start) / frame_length) * width;
+        const auto x1 = std::max(origin.x + static_cast<float>(static_cast<double>(event.end - selected.start) / frame_length) * width, x0 + 1);
+        const auto y0 = origin.y + static_cast<float>(event.depth) * row_height;
+        const ImVec2 min{x0, y0};
+        const ImVec2 max{x1, y0 + row_height - 1};
+        
+        // same name, same color from frame to frame
+        const auto hash = std::hash<std::string_view>{}(event.name);
+        draw_list->AddRectFilled(min, max, IM_COL32(64 + hash % 160, 64 + (hash >> 8) % 160, 64 + (hash >> 16) % 160, 255));
+        if (x1 - x0 > 48)
+            draw_list->AddText({x0 + 2, y0 + 2}, IM_COL32(255, 255, 255, 255), event.name);
+        if (im::IsMouseHoveringRect(min, max))
+            im::SetTooltip("%s: %lf ms", event.name, static_cast<double>(event.end - event.start) / 1e6);
+    });
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <save_thread.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+
+namespace
+{
+    save_result_t write_job(const save_job_t& job)
+    {
+        const auto start = blt::system::getCurrentTimeNanoseconds();
+        save_result_t result{job.path, job.loader.stamp, true, 0};
+        if (job.write_json)
+            result.success = loader_t::save_for(job.graph, job.loader, job.path);
+        if (result.success)
+            result.success = loader_t::save_snapshot(job.graph, job.loader, loader_t::snapshot_path(job.path));
+        result.seconds = static_cast<double>(blt::system::getCurrentTimeNanoseconds() - start) / 1e9;
+        if (result.success)
+            BLT_INFO("Saved %s in %.2fs", job.path.c_str(), result.seconds);
+        return result;
+    }
+}
+
+void save_thread_t::submit(save_job_t job)
+{
+#ifdef __EMSCRIPTEN__
+    // no pthreads in the web build, the job is written right away instead.
+    auto result = write_job(job);
+    std::scoped_lock lock(mutex);
+    results.push_back(std::move(result));
+#else
+    unfinished++;
+    {
+        std::scoped_lock lock(mutex);
+        jobs.push_back(std::move(job));
+        stopping = false;
+    }
+    if (!thread.joinable())
+        thread = std::thread(&save_thread_t::run, this);
+    cond.notify_one();
+#endif
+}
+
+std::optional<save_result_t> save_thread_t::poll()
+{
+    std::scoped_lock lock(mutex);
+    if (results.empty())
+        return {};
+    auto result = std::move(results.front());
+    results.pop_front();
+    return result;
+}
+
+void save_thread_t::stop()
+{
+    if (!thread.joinable())
+        return;
+    {
+        std::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+void save_thread_t::run()
+{
+    while (true)
+    {
+        save_job_t job;
+        {
+            std::unique_lock lock(mutex);
+            cond.wait(lock, [this]() { return !jobs.empty() || stopping; });
+            // everything queued is still written when stopping
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        
+        auto result = write_job(job);
+        {
+            std::scoped_lock lock(mutex);
+            results.push_back(std::move(result));
+        }
+        unfinished--;
+    }
+}
@@ -17,8 +17,13 @@
  */
 #include <selection.h>
 #include <graph.h>
+#include <journal.h>
 #include <blt/gfx/raycast.h>
+#include <blt/gfx/renderer/batch_2d_renderer.h>
 #include <blt/std/memory.h>
+#include <blt/std/logging.h>
+#include <algorithm>
+#include <iterator>
 
 extern blt::gfx::batch_renderer_2d renderer_2d;
 extern blt::gfx::matrix_state_manager global_matrices;
@@ -26,6 +31,8 @@ extern blt::gfx::matrix_state_manager global_matrices;
 blt::expanding_buffer<char> name_input;
 blt::expanding_buffer<char> texture_input;
 blt::expanding_buffer<char> description_input;
+// name of the selected node when its name field was clicked into, put back if the edit leaves it unusable
+std::string name_before_edit;
 
 struct callback_data_t
 {
@@ -57,7 +64,45 @@ int text_input_callback(ImGuiInputTextCallbackData* data)
 
 void selector_t::render(blt::i32 width, blt::i32 height)
 {
+    const auto view = visible_area(width, height);
+    for (const auto node : selection)
+    {
+        if (node >= graph.nodes.size())
+            continue;
+        const auto ref = graph.getNode(node);
+        const auto pos = ref.getPosition();
+        const auto size = ref->scale * ref->outline_scale * conf::SELECTION_RING_SCALE;
+        if (!view.overlaps(pos, size))
+            continue;
+        renderer_2d.drawPointInternal(blt::gfx::render_info_t::make_info(conf::POINT_SELECT_COLOR), blt::gfx::point2d_t{pos, size}, 1.0f);
+    }
+}
 
+void selector_t::render_overlay(blt::i32 width, blt::i32 height)
+{
+    // process_mouse() isn't called while the gui has the mouse, if the button was let go there the box is dropped here instead
+    if (area_selection != area_selection_t::NONE && !blt::gfx::isMousePressed(0))
+    {
+        area_selection = area_selection_t::NONE;
+        area_points.clear();
+    }
+    if (area_selection == area_selection_t::NONE || area_points.size() < 2)
+        return;
+    const auto view = visible_area(width, height);
+    const auto thickness = conf::DEFAULT_THICKNESS / view.pixels_per_unit;
+    const auto info = blt::gfx::render_info_t::make_info(conf::POINT_HIGHLIGHT_COLOR);
+    if (area_selection == area_selection_t::BOX)
+    {
+        const auto& a = area_points.front();
+        const auto& b = area_points.back();
+        const blt::vec2 corners[4]{a, {b.x(), a.y()}, b, {a.x(), b.y()}};
+        for (blt::size_t i = 0; i < 4; i++)
+            renderer_2d.drawLine(info, 2.0f, corners[i], corners[(i + 1) % 4], thickness);
+    } else
+    {
+        for (blt::size_t i = 0; i < area_points.size(); i++)
+            renderer_2d.drawLine(info, 2.0f, area_points[i], area_points[(i + 1) % area_points.size()], thickness);
+    }
 }
 
 void selector_t::process_mouse(blt::i32 width, blt::i32 height)
@@ -79,34 +124,40 @@ void selector_t::process_mouse(blt::i32 width, blt::i32 height)
         }
     } else
     {
-        for (const auto& [index, node] : blt::enumerate(graph.nodes))
+        const auto index = mouse_pressed ? graph.node_at(mouse_pos) : -1;
+        if (index >= 0)
         {
-            const auto pos = node.getPosition();
-            const auto dist = pos - mouse_pos;
-            const auto mag = dist.magnitude();
-            
-            if (mag < node.getRenderObj().scale && mouse_pressed)
+            set_drag_selection(index);
+            if (blt::gfx::isKeyPressed(GLFW_KEY_LEFT_SHIFT))
             {
-                set_drag_selection(static_cast<blt::i64>(index));
-                if (blt::gfx::isKeyPressed(GLFW_KEY_LEFT_SHIFT))
-                {
-                    if (secondary_selection != -1)
-                        set_primary_selection(secondary_selection);
-                    set_secondary_selection(drag_selection);
-                } else
-                {
-                    set_primary_selection(drag_selection);
-                    set_secondary_selection(-1);
-                }
-                break;
+                if (secondary_selection != -1)
+                    set_primary_selection(secondary_selection);
+                set_secondary_selection(drag_selection);
+            } else
+            {
+                set_primary_selection(drag_selection);
+                set_secondary_selection(-1);
             }
+        } else if (mouse_pressed)
+        {
+            area_selection = blt::gfx::isKeyPressed(GLFW_KEY_LEFT_CONTROL) ? area_selection_t::LASSO : area_selection_t::BOX;
+            area_points = {mouse_pos, mouse_pos};
+        } else if (area_selection == area_selection_t::BOX)
+        {
+            area_points.back() = mouse_pos;
+        } else if (area_selection == area_selection_t::LASSO && (mouse_pos - area_points.back()).magnitude() > 0)
+        {
+            area_points.push_back(mouse_pos);
         }
         if (blt::gfx::mouseReleaseLastFrame())
             set_drag_selection(-1);
+        // the release itself can be missed if it happened over the gui, so this goes by whether the button is still held
+        if (area_selection != area_selection_t::NONE && !blt::gfx::isMousePressed(0))
+            finish_area_selection(blt::gfx::isKeyPressed(GLFW_KEY_LEFT_SHIFT));
     }
     if (drag_selection >= 0 && drag_selection < static_cast<blt::i64>(graph.nodes.size()) && (blt::gfx::isMousePressed(0) || placement))
     {
-        graph.nodes[drag_selection].getPositionRef() = mouse_pos;
+        graph.move_node(drag_selection, mouse_pos);
     }
 }
 
@@ -121,9 +172,14 @@ void selector_t::process_keyboard(blt::i32 width, blt::i32 height)
             if (primary_selection != -1 && secondary_selection != -1)
             {
                 if (graph.is_connected(primary_selection, secondary_selection))
+                {
                     graph.disconnect(primary_selection, secondary_selection);
-                else
+                    journal.record_disconnect(primary_selection, secondary_selection);
+                } else
+                {
                     graph.connect(primary_selection, secondary_selection);
+                    journal.record_connect(primary_selection, secondary_selection);
+                }
             } else
             {
                 if (placement)
@@ -133,8 +189,13 @@ void selector_t::process_keyboard(blt::i32 width, blt::i32 height)
             }
         } else if (blt::gfx::isKeyPressed(GLFW_KEY_X))
         {
-            if (primary_selection != -1)
+            if (!selection.empty())
+                destroy_selection();
+            else if (primary_selection != -1)
                 destroy_node(primary_selection);
+        } else if (blt::gfx::isKeyPressed(GLFW_KEY_ESCAPE))
+        {
+            selection.clear();
         }
     }
 }
@@ -145,49 +206,100 @@ void selector_t::draw_gui(blt::i32 width, blt::i32 height)
     if (im::CollapsingHeader("Selection Information"))
     {
         im::Text("Silly (%ld) | (%ld || %ld)", drag_selection, primary_selection, secondary_selection);
-        if (primary_selection >= 0)
+        if (!selection.empty())
+            im::Text("Selected Nodes: %lu (X to remove, Escape to clear)", selection.size());
+        if (primary_selection >= 0 && primary_selection < static_cast<blt::i64>(graph.nodes.size()))
         {
             if (secondary_selection >= 0)
             {
-                auto edge_i = graph.edges.find({static_cast<blt::u64>(primary_selection), static_cast<blt::u64>(secondary_selection)});
-                if (edge_i == graph.edges.end())
+                auto edge_ptr = graph.edges.find(static_cast<blt::u64>(primary_selection), static_cast<blt::u64>(secondary_selection));
+                if (!edge_ptr)
                     return;
-                auto edge = *edge_i;
+                auto& edge = *edge_ptr;
                 bool changed = false;
+                // the journal only gets the edge once an edit is finished, not every frame of a drag or every key typed
+                bool edited = false;
                 
                 changed |= im::SliderFloat("Ideal Length", &edge.ideal_spring_length, conf::POINT_SIZE, conf::DEFAULT_SPRING_LENGTH * 4);
+                edited |= im::IsItemDeactivatedAfterEdit();
                 callback_data_t description_data{edge.description, description_input};
                 changed |= im::InputTextMultiline("Description", description_input.data(), description_input.size(), {},
                                        ImGuiInputTextFlags_CallbackResize | ImGuiInputTextFlags_CallbackEdit | ImGuiInputTextFlags_CallbackCompletion,
                                        text_input_callback, &description_data);
+                edited |= im::IsItemDeactivatedAfterEdit();
                 
                 if (changed)
-                {
-                    graph.edges.erase(edge_i);
-                    graph.edges.insert(edge);
-                }
+                    graph.invalidate_adjacency();
+                if (edited)
+                    journal.record_set_edge(edge);
             } else
             {
-                im::SliderFloat("Size", &graph.nodes[primary_selection].point.scale, 1, 100);
-                im::ColorPicker4("Color", graph.nodes[primary_selection].outline_color.data());
-                im::SliderFloat("Scale", &graph.nodes[primary_selection].outline_scale, 1, 2);
+                bool changed = false;
+                // same as for edges, only finished edits are recorded
+                bool edited = false;
+                changed |= im::SliderFloat("Size", &graph.nodes[primary_selection].scale, 1, 100);
+                edited |= im::IsItemDeactivatedAfterEdit();
+                changed |= im::ColorPicker4("Color", graph.nodes[primary_selection].outline_color.data());
+                edited |= im::IsItemDeactivatedAfterEdit();
+                changed |= im::SliderFloat("Scale", &graph.nodes[primary_selection].outline_scale, 1, 2);
+                edited |= im::IsItemDeactivatedAfterEdit();
                 callback_data_t name_data{graph.nodes[primary_selection].name, name_input};
                 callback_data_t texture_data{graph.nodes[primary_selection].texture, texture_input};
                 callback_data_t description_data{graph.nodes[primary_selection].description, description_input};
-                im::InputText("Name", name_input.data(), name_input.size(),
+                changed |= im::InputText("Name", name_input.data(), name_input.size(),
                               ImGuiInputTextFlags_CallbackResize | ImGuiInputTextFlags_CallbackEdit | ImGuiInputTextFlags_CallbackCompletion,
                               text_input_callback, &name_data);
-                im::InputText("Texture", texture_input.data(), texture_input.size(),
+                if (im::IsItemActivated())
+                {
+                    // the lookup has to have every name in it before this one starts changing
+                    graph.getNames();
+                    name_before_edit = graph.nodes[primary_selection].name;
+                }
+                if (im::IsItemDeactivatedAfterEdit())
+                {
+                    edited = true;
+                    finish_rename(static_cast<blt::u64>(primary_selection));
+                }
+                changed |= im::InputText("Texture", texture_input.data(), texture_input.size(),
                               ImGuiInputTextFlags_CallbackResize | ImGuiInputTextFlags_CallbackEdit | ImGuiInputTextFlags_CallbackCompletion,
                               text_input_callback, &texture_data);
-                im::InputTextMultiline("Description", description_input.data(), description_input.size(), {},
+                edited |= im::IsItemDeactivatedAfterEdit();
+                changed |= im::InputTextMultiline("Description", description_input.data(), description_input.size(), {},
                                        ImGuiInputTextFlags_CallbackResize | ImGuiInputTextFlags_CallbackEdit | ImGuiInputTextFlags_CallbackCompletion,
                                        text_input_callback, &description_data);
+                edited |= im::IsItemDeactivatedAfterEdit();
+                
+                if (changed)
+                    graph.invalidate_nodes();
+                if (edited)
+                    journal.record_set_node(primary_selection, graph.nodes[primary_selection]);
             }
         }
     }
 }
 
+void selector_t::finish_rename(blt::u64 node)
+{
+    // the name field writes straight into the node while typing, the lookup by name only follows once the edit is done
+    auto& name = graph.nodes[node].name;
+    auto& names = graph.getNames();
+    const auto existing = names.find(name);
+    if (name.empty() || (existing != names.end() && existing->second != node))
+    {
+        if (name.empty())
+            BLT_WARN("Nodes need a name, putting back '%s'", name_before_edit.c_str());
+        else
+            BLT_WARN("There is already a node named '%s', putting back '%s'", name.c_str(), name_before_edit.c_str());
+        name = name_before_edit;
+        from_string(name, name_input);
+        graph.invalidate_nodes();
+    } else if (name != name_before_edit)
+    {
+        names.erase(name_before_edit);
+        names.insert({name, node});
+    }
+}
+
 void selector_t::set_secondary_selection(blt::i64 n)
 {
     secondary_selection = n;
@@ -207,13 +319,16 @@ void selector_t::set_primary_selection(blt::i64 n)
 
 void selector_t::set_drag_selection(blt::i64 n)
 {
+    // only where the node ends up is recorded, not every frame of the drag
+    if (drag_selection >= 0 && drag_selection != n && drag_selection < static_cast<blt::i64>(graph.nodes.size()))
+        journal.record_move_node(drag_selection, graph.getNode(drag_selection).getPosition());
     drag_selection = n;
 }
 
 void selector_t::create_placement_node(const blt::vec2& pos)
 {
-    auto node = static_cast<blt::i64>(graph.nodes.size());
-    graph.nodes.push_back(node_t{{pos, conf::POINT_SIZE}});
+    auto node = static_cast<blt::i64>(graph.add_node(pos, node_t()));
+    journal.record_add_node(pos, graph.nodes[node]);
     set_drag_selection(node);
     set_primary_selection(node);
     placement = true;
@@ -221,51 +336,62 @@ void selector_t::create_placement_node(const blt::vec2& pos)
 
 void selector_t::destroy_node(blt::i64 node)
 {
-    auto& node_v = graph.nodes[node];
-    graph.names_to_node.erase(node_v.name);
-    erase_if(graph.edges, [node](const edge_t& e) {
-        return static_cast<blt::i64>(e.getFirst()) == node || static_cast<blt::i64>(e.getSecond()) == node;
-    });
-    std::vector<edge_t> corrected_edges;
-    for (const edge_t& v : graph.edges)
+    // the node is gone, there is no move left to record
+    drag_selection = -1;
+    graph.remove_node(static_cast<blt::u64>(node));
+    journal.record_remove_node(static_cast<blt::u64>(node));
+    set_drag_selection(-1);
+    set_primary_selection(-1);
+    // the last node took over the removed node's index, anything still selected would now point at the wrong node
+    set_secondary_selection(-1);
+    placement = false;
+    selection.clear();
+}
+
+void selector_t::clear()
+{
+    // the node being dragged isn't in the graph anymore, there is no move left to record
+    drag_selection = -1;
+    set_primary_selection(-1);
+    set_secondary_selection(-1);
+    placement = false;
+    area_selection = area_selection_t::NONE;
+    area_points.clear();
+    selection.clear();
+}
+
+void selector_t::finish_area_selection(bool add)
+{
+    auto found = area_selection == area_selection_t::BOX ? graph.nodes_in_rect(area_points.front(), area_points.back())
+                                                         : graph.nodes_in_polygon(area_points);
+    area_selection = area_selection_t::NONE;
+    area_points.clear();
+    if (!add)
     {
-        auto copy = v;
-        auto c = static_cast<blt::u64>(node);
-        if (copy.i1 > c)
-            copy.i1--;
-        if (copy.i2 > c)
-            copy.i2--;
-        if (v.i1 > c || v.i2 > c)
-            corrected_edges.push_back(copy);
+        selection = std::move(found);
+        return;
     }
-    erase_if(graph.edges, [node](const edge_t& e) {
-        return static_cast<blt::i64>(e.getFirst()) > node || static_cast<blt::i64>(e.getSecond()) > node;
-    });
-    for (const auto& v : corrected_edges)
-        graph.edges.insert(v);
-    graph.connected_nodes.erase(node);
-    for (auto& v : graph.connected_nodes)
+    std::vector<blt::u64> merged;
+    merged.reserve(selection.size() + found.size());
+    std::set_union(selection.begin(), selection.end(), found.begin(), found.end(), std::back_inserter(merged));
+    selection = std::move(merged);
+}
+
+void selector_t::destroy_selection()
+{
+    // the nodes are gone, there is no move left to record
+    drag_selection = -1;
+    auto batch = graph.batch();
+    // largest first, the same order the batch removes them in, so the journal replays to the same indices
+    for (auto itr = selection.rbegin(); itr != selection.rend(); ++itr)
     {
-        auto& map = v.second;
-        // generate the list of corrected nodes.
-        std::vector<blt::u64> corrected_nodes;
-        for (auto& n : map)
-        {
-            // shift back then nodes after this one by one
-            if (static_cast<blt::i64>(n) > node)
-            {
-                corrected_nodes.push_back(n - 1);
-            }
-        }
-        erase_if(map, [node](blt::u64 n) {
-            return static_cast<blt::i64>(n) > node;
-        });
-        for (const auto& n : corrected_nodes)
-            map.insert(n);
+        if (*itr >= graph.nodes.size())
+            continue;
+        batch.remove_node(*itr);
+        journal.record_remove_node(*itr);
     }
-    
-    graph.nodes.erase(graph.nodes.begin() + node);
-    set_drag_selection(-1);
+    batch.commit();
     set_primary_selection(-1);
-    placement = false;
+    set_secondary_selection(-1);
+    selection.clear();
 }
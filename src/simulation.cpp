@@ -0,0 +1,297 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <simulation.h>
+#include <blt/std/time.h>
+#include <chrono>
+#include <cmath>
+#include <typeinfo>
+
+/**
+ * --------------------------------------------------------
+ *                      simulation_t
+ * --------------------------------------------------------
+ */
+
+void simulation_t::step(node_state_t& nodes, const adjacency_t& adjacency, float sim_factor)
+{
+    (this->*step_function)(nodes, adjacency, sim_factor);
+}
+
+void simulation_t::select_step()
+{
+    // exact type matches only, a subclass might override something the built in step would skip over
+    if (typeid(*equation) == typeid(Eades_equation))
+        step_function = &simulation_t::step_with<Eades_equation>;
+    else if (typeid(*equation) == typeid(Fruchterman_Reingold_equation))
+        step_function = &simulation_t::step_with<Fruchterman_Reingold_equation>;
+    else
+        step_function = &simulation_t::step_with<force_equation>;
+}
+
+template<typename EQUATION>
+void simulation_t::step_with(node_state_t& nodes, const adjacency_t& adjacency, float sim_factor)
+{
+    // with the concrete type known every call into the equation below is direct, and can be inlined
+    const auto& eq = static_cast<const EQUATION&>(*equation);
+    
+    if (pool.size() != static_cast<blt::size_t>(settings.thread_count))
+        pool.resize(static_cast<blt::size_t>(std::max(settings.thread_count, 1)));
+    
+    auto start = blt::system::getCurrentTimeNanoseconds();
+    prepare_repulsion(nodes);
+    auto tree_end = blt::system::getCurrentTimeNanoseconds();
+    
+    // calculate new forces, every node is owned by exactly one chunk so threads only ever write to their own part of forces
+    pool.parallel_for(nodes.size(), conf::FORCE_CHUNK_SIZE, [this, &eq, &nodes](blt::size_t begin, blt::size_t end, blt::size_t) {
+        apply_repulsion(eq, nodes, begin, end);
+    });
+    auto repulsion_end = blt::system::getCurrentTimeNanoseconds();
+    
+    pool.parallel_for(nodes.size(), conf::FORCE_CHUNK_SIZE, [this, &eq, &nodes, &adjacency](blt::size_t begin, blt::size_t end, blt::size_t) {
+        apply_attraction(eq, nodes, adjacency, begin, end);
+    });
+    auto attraction_end = blt::system::getCurrentTimeNanoseconds();
+    
+    // update positions, the max force is reduced per chunk and then in chunk order so the result doesn't depend on the threads
+    // the temperature only changes between iterations, so it is worked out once here instead of once per node
+    const float cooling = eq.cooling_factor(current_iterations) * sim_factor;
+    chunk_max_force.assign((nodes.size() + conf::FORCE_CHUNK_SIZE - 1) / conf::FORCE_CHUNK_SIZE, 0);
+    const float max_displacement = settings.max_displacement;
+    pool.parallel_for(nodes.size(), conf::FORCE_CHUNK_SIZE, [this, &nodes, cooling, max_displacement](blt::size_t begin, blt::size_t end, blt::size_t) {
+        float max_force = 0;
+        for (blt::size_t i = begin; i < end; i++)
+        {
+            const auto velocity = forces[i];
+            nodes.vx[i] = velocity.x();
+            nodes.vy[i] = velocity.y();
+            auto displacement = velocity * cooling;
+            if (max_displacement > 0)
+            {
+                const auto length = displacement.magnitude();
+                if (length > max_displacement)
+                    displacement = displacement * (max_displacement / length);
+            }
+            nodes.x[i] += displacement.x();
+            nodes.y[i] += displacement.y();
+            max_force = std::max(max_force, forces[i].magnitude());
+        }
+        chunk_max_force[begin / conf::FORCE_CHUNK_SIZE] = max_force;
+    });
+    max_force_last = 0;
+    for (const auto max_force : chunk_max_force)
+        max_force_last = std::max(max_force_last, max_force);
+    current_iterations++;
+    auto integration_end = blt::system::getCurrentTimeNanoseconds();
+    
+    timings.tree += static_cast<double>(tree_end - start) / 1e6;
+    timings.repulsion += static_cast<double>(repulsion_end - tree_end) / 1e6;
+    timings.attraction += static_cast<double>(attraction_end - repulsion_end) / 1e6;
+    timings.integration += static_cast<double>(integration_end - attraction_end) / 1e6;
+    
+    if (profiler)
+    {
+        profiler->record("tree", start, tree_end);
+        profiler->record("repulsion", tree_end, repulsion_end);
+        profiler->record("attraction", repulsion_end, attraction_end);
+        profiler->record("integration", attraction_end, integration_end);
+    }
+}
+
+void simulation_t::prepare_repulsion(const node_state_t& nodes)
+{
+    if (settings.repulsion_mode == repulsion_mode_t::BARNES_HUT)
+        tree.build(nodes);
+    else if (settings.repulsion_mode == repulsion_mode_t::CUTOFF)
+        grid.build(nodes, settings.cutoff_radius);
+    forces.resize(nodes.size());
+}
+
+template<typename EQUATION>
+void simulation_t::apply_repulsion(const EQUATION& eq, const node_state_t& nodes, blt::size_t begin, blt::size_t end)
+{
+    for (blt::size_t i = begin; i < end; i++)
+    {
+        const auto v1 = nodes.getParticle(i);
+        switch (settings.repulsion_mode)
+        {
+            case repulsion_mode_t::BARNES_HUT:
+                forces[i] = tree.repulsion(eq, i, v1, settings.theta);
+                break;
+            case repulsion_mode_t::CUTOFF:
+                forces[i] = grid.repulsion(eq, v1);
+                break;
+            default:
+                // v1 is part of the block but doesn't repel itself, rep_block skips anything sitting on v1
+                forces[i] = eq.rep_block(v1, nodes.getBlock(0, nodes.size()));
+                break;
+        }
+    }
+}
+
+template<typename EQUATION>
+void simulation_t::apply_attraction(const EQUATION& eq, const node_state_t& nodes, const adjacency_t& adjacency, blt::size_t begin,
+                                    blt::size_t end)
+{
+    const auto& edge_list = adjacency.getEdges();
+    for (blt::size_t i = begin; i < end; i++)
+    {
+        const auto neighbours = adjacency.neighbours(i);
+        if (neighbours.size() == 0)
+            continue;
+        const auto edge_indices = adjacency.edgeIndices(i);
+        const auto v1 = nodes.getParticle(i);
+        for (blt::size_t j = 0; j < neighbours.size(); j++)
+        {
+            const auto other = neighbours.first[j];
+            forces[i] += eq.attr(v1, nodes.getParticle(other), edge_list[edge_indices.first[j]]);
+        }
+    }
+}
+
+float simulation_t::measure_repulsion_error(const node_state_t& nodes)
+{
+    prepare_repulsion(nodes);
+    apply_repulsion(*equation, nodes, 0, nodes.size());
+    double error_sq = 0;
+    double exact_sq = 0;
+    for (blt::size_t i = 0; i < nodes.size(); i++)
+    {
+        const auto exact = equation->rep_block(nodes.getParticle(i), nodes.getBlock(0, nodes.size()));
+        const auto diff = forces[i] - exact;
+        error_sq += diff.x() * diff.x() + diff.y() * diff.y();
+        exact_sq += exact.x() * exact.x() + exact.y() * exact.y();
+    }
+    last_error = exact_sq == 0 ? 0 : static_cast<float>(std::sqrt(error_sq / exact_sq));
+    return last_error;
+}
+
+/**
+ * --------------------------------------------------------
+ *                    simulation_thread_t
+ * --------------------------------------------------------
+ */
+
+void simulation_thread_t::start()
+{
+    if (running())
+        return;
+    stopping = false;
+    thread = std::thread(&simulation_thread_t::run, this);
+}
+
+void simulation_thread_t::stop()
+{
+    if (!running())
+        return;
+    {
+        std::scoped_lock lock(command_mutex);
+        stopping = true;
+    }
+    command_cond.notify_all();
+    thread.join();
+    commands.clear();
+}
+
+void simulation_thread_t::submit(command_t command)
+{
+    {
+        std::scoped_lock lock(command_mutex);
+        commands.push_back(std::move(command));
+    }
+    command_cond.notify_one();
+}
+
+const simulation_snapshot_t* simulation_thread_t::poll()
+{
+    if (!snapshots.update())
+        return nullptr;
+    return &snapshots.front();
+}
+
+void simulation_thread_t::run()
+{
+    // the state lives on this thread's stack, nothing outside of the thread can reach it except through commands.
+    simulation_state_t state;
+    std::vector<command_t> pending;
+    
+    auto second_start = blt::system::getCurrentTimeNanoseconds();
+    blt::size_t steps_this_second = 0;
+    float steps_per_second = 0;
+    
+    while (!stopping)
+    {
+        {
+            std::unique_lock lock(command_mutex);
+            // nothing to simulate, sleep until the render thread gives us something to do
+            if (commands.empty() && !state.task && !state.simulation.should_step())
+                command_cond.wait_for(lock, std::chrono::milliseconds(100), [this]() { return !commands.empty() || stopping; });
+            pending.swap(commands);
+        }
+        for (auto& command : pending)
+            command(state);
+        const bool changed = !pending.empty();
+        pending.clear();
+        
+        if (state.task)
+        {
+            if (state.task(state))
+            {
+                state.task = nullptr;
+                state.task_progress = -1;
+            }
+            publish(state, steps_per_second);
+            continue;
+        }
+        
+        if (!state.simulation.should_step())
+        {
+            if (changed)
+                publish(state, steps_per_second);
+            continue;
+        }
+        
+        state.simulation.timings = {};
+        const float sim_factor = conf::FIXED_TIMESTEP * state.simulation.settings.sim_speed * 0.05f;
+        state.simulation.step(state.nodes, state.adjacency, sim_factor);
+        steps_this_second++;
+        
+        const auto now = blt::system::getCurrentTimeNanoseconds();
+        if (now - second_start >= 1000000000)
+        {
+            steps_per_second = static_cast<float>(static_cast<double>(steps_this_second) * 1e9 / static_cast<double>(now - second_start));
+            steps_this_second = 0;
+            second_start = now;
+        }
+        publish(state, steps_per_second);
+    }
+}
+
+void simulation_thread_t::publish(simulation_state_t& state, float steps_per_second)
+{
+    auto& snapshot = snapshots.back();
+    snapshot.x = state.nodes.x;
+    snapshot.y = state.nodes.y;
+    snapshot.version = state.version;
+    snapshot.moved_version = state.moved_version;
+    snapshot.current_iterations = state.simulation.current_iterations;
+    snapshot.max_force_last = state.simulation.max_force_last;
+    snapshot.timings = state.simulation.timings;
+    snapshot.steps_per_second = steps_per_second;
+    snapshot.task_progress = state.task_progress;
+    snapshot.task_id = state.task_id;
+    snapshots.publish();
+}
@@ -0,0 +1,445 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <snapshot.h>
+#include <loader.h>
+#include <mapped_file.h>
+#include <save_thread.h>
+#include <blt/std/logging.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // a journal left behind by any earlier snapshot must never match a new one
+    blt::u64 new_stamp(blt::u64 previous)
+    {
+        static std::mt19937_64 stamps{std::random_device{}()};
+        blt::u64 stamp;
+        do
+            stamp = stamps();
+        while (stamp == 0 || stamp == previous);
+        return stamp;
+    }
+    
+    blt::u64 align(blt::u64 offset)
+    {
+        return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    }
+    
+    // deduplicates strings as they are added, textures especially tend to repeat
+    class string_table_t
+    {
+        public:
+            string_table_t()
+            {
+                static const std::string empty;
+                add(empty);
+            }
+            
+            blt::u32 add(const std::string& str)
+            {
+                if (auto itr = indices.find(str); itr != indices.end())
+                    return itr->second;
+                const auto index = static_cast<blt::u32>(strings.size());
+                indices.insert({str, index});
+                strings.push_back(&str);
+                return index;
+            }
+            
+            [[nodiscard]] const std::vector<const std::string*>& getStrings() const
+            {
+                return strings;
+            }
+        
+        private:
+            blt::hashmap_t<std::string, blt::u32> indices;
+            // every string outlives the table, they belong to the graph being saved
+            std::vector<const std::string*> strings;
+    };
+    
+    class snapshot_writer_t
+    {
+        public:
+            explicit snapshot_writer_t(std::ofstream& file): file(file)
+            {}
+            
+            template<typename T>
+            void write(const T* data, blt::size_t count)
+            {
+                file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(sizeof(T) * count));
+                offset += sizeof(T) * count;
+            }
+            
+            template<typename T>
+            void write(const std::vector<T>& data)
+            {
+                write(data.data(), data.size());
+            }
+            
+            // pads up to the start of the next section
+            blt::u64 section()
+            {
+                static constexpr char zeros[SNAPSHOT_ALIGNMENT] = {};
+                write(zeros, align(offset) - offset);
+                return offset;
+            }
+            
+            blt::u64 offset = 0;
+        
+        private:
+            std::ofstream& file;
+    };
+    
+    /**
+     * Bounds checked reads out of the mapped file, every section is validated before anything is pulled out of it.
+     */
+    class snapshot_reader_t
+    {
+        public:
+            explicit snapshot_reader_t(const mapped_file_t& file): file(file)
+            {}
+            
+            template<typename T>
+            const T* array(blt::u64 offset, blt::u64 count)
+            {
+                if (count > (file.size() - std::min<blt::u64>(offset, file.size())) / sizeof(T) || offset % alignof(T) != 0)
+                {
+                    valid = false;
+                    return nullptr;
+                }
+                return reinterpret_cast<const T*>(file.data() + offset);
+            }
+            
+            bool valid = true;
+        
+        private:
+            const mapped_file_t& file;
+    };
+    
+    const char* describe_invalid_header(const snapshot_header_t& header, blt::size_t file_size)
+    {
+        if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+            return "not a graph snapshot";
+        if (header.byte_order != SNAPSHOT_BYTE_ORDER)
+            return "written on a machine with a different byte order";
+        if (header.version != SNAPSHOT_VERSION)
+            return "unsupported version";
+        if (header.file_size != file_size)
+            return "truncated";
+        return nullptr;
+    }
+}
+
+std::string loader_t::snapshot_path(std::string_view path)
+{
+    return std::filesystem::path(path).replace_extension(".snapshot").string();
+}
+
+std::string loader_t::journal_path(std::string_view path)
+{
+    return std::filesystem::path(path).replace_extension(".journal").string();
+}
+
+bool loader_t::compact(graph_t& graph, loader_t& loader, journal_t& journal, std::string_view path)
+{
+    journal.begin_compaction();
+    const auto previous = loader.stamp;
+    loader.stamp = new_stamp(previous);
+    const save_result_t result{std::string(path), loader.stamp, save_snapshot(graph, loader, snapshot_path(path)), 0};
+    loader.stamp = previous;
+    finish_compaction(loader, journal, result);
+    return result.success;
+}
+
+void loader_t::compact_async(graph_t& graph, const loader_t& loader, journal_t& journal, save_thread_t& saver, std::string_view path,
+                             bool write_json)
+{
+    save_job_t job{graph.copy_for_save(), loader, std::string(path), write_json};
+    job.loader.stamp = new_stamp(loader.stamp);
+    journal.begin_compaction();
+    saver.submit(std::move(job));
+}
+
+void loader_t::finish_compaction(loader_t& loader, journal_t& journal, const save_result_t& result)
+{
+    if (!result.success)
+    {
+        journal.abandon_compaction();
+        return;
+    }
+    loader.stamp = result.stamp;
+    // if we die before the journal is replaced, the old journal's stamp no longer matches and the new snapshot is loaded on its own
+    if (journal.is_open())
+        journal.finish_compaction(result.stamp);
+    else
+        journal.open(journal_path(result.path), result.stamp);
+}
+
+bool loader_t::save_snapshot(graph_t& graph, const loader_t& loader, std::string_view path)
+{
+    return write_snapshot(graph, loader, path);
+}
+
+bool loader_t::save_snapshot(const graph_copy_t& graph, const loader_t& loader, std::string_view path)
+{
+    return write_snapshot(copy_view_t{*graph.nodes, graph.node_state, *graph.edges}, loader, path);
+}
+
+template<typename GRAPH>
+bool loader_t::write_snapshot(const GRAPH& graph, const loader_t& loader, std::string_view path)
+{
+    const auto node_count = graph.nodes.size();
+    string_table_t strings;
+    
+    // nodes, only the columns which aren't already laid out as SoA in node_state need gathering
+    std::vector<float> sizes, outline_scales, colors;
+    std::vector<blt::u32> names, textures, descriptions;
+    sizes.reserve(node_count);
+    outline_scales.reserve(node_count);
+    colors.reserve(node_count * 4);
+    for (const auto& node : graph.nodes)
+    {
+        sizes.push_back(node.scale);
+        outline_scales.push_back(node.outline_scale);
+        colors.insert(colors.end(), node.outline_color.data(), node.outline_color.data() + 4);
+        names.push_back(strings.add(node.name));
+        textures.push_back(strings.add(node.texture));
+        descriptions.push_back(strings.add(node.description));
+    }
+    
+    // edges, bucketed by their smaller node into CSR rows
+    std::vector<blt::u64> row_offsets(node_count + 1, 0);
+    for (const auto& edge : graph.edges)
+        row_offsets[std::min(edge.getFirst(), edge.getSecond()) + 1]++;
+    for (blt::size_t i = 0; i < node_count; i++)
+        row_offsets[i + 1] += row_offsets[i];
+    const auto edge_count = graph.edges.size();
+    std::vector<blt::u64> fill(row_offsets.begin(), row_offsets.end() - 1);
+    std::vector<blt::u32> targets(edge_count), edge_descriptions(edge_count);
+    std::vector<float> lengths(edge_count), thicknesses(edge_count), edge_colors(edge_count * 4);
+    for (const auto& edge : graph.edges)
+    {
+        const auto slot = fill[std::min(edge.getFirst(), edge.getSecond())]++;
+        targets[slot] = static_cast<blt::u32>(std::max(edge.getFirst(), edge.getSecond()));
+        lengths[slot] = edge.ideal_spring_length;
+        thicknesses[slot] = edge.thickness;
+        std::memcpy(&edge_colors[slot * 4], edge.color.data(), sizeof(float) * 4);
+        edge_descriptions[slot] = strings.add(edge.description);
+    }
+    
+    std::vector<blt::u32> texture_pairs;
+    for (const auto& [key, t_path] : loader.textures)
+    {
+        texture_pairs.push_back(strings.add(key));
+        texture_pairs.push_back(strings.add(t_path));
+    }
+    
+    // written next to the destination and moved over it once complete, a crash half way through never leaves a broken snapshot
+    const auto temp_path = std::string(path) + ".tmp";
+    std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+    if (!file)
+    {
+        BLT_WARN("Unable to open %s for writing!", temp_path.c_str());
+        return false;
+    }
+    
+    snapshot_header_t header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.node_count = node_count;
+    header.edge_count = edge_count;
+    header.texture_count = loader.textures.size();
+    header.string_count = strings.getStrings().size();
+    header.stamp = loader.stamp;
+    
+    snapshot_writer_t writer{file};
+    writer.write(&header, 1);
+    
+    header.nodes_offset = writer.section();
+    writer.write(graph.node_state.x);
+    writer.write(graph.node_state.y);
+    writer.write(sizes);
+    writer.write(outline_scales);
+    writer.write(colors);
+    writer.write(names);
+    writer.write(textures);
+    writer.write(descriptions);
+    
+    header.edges_offset = writer.section();
+    writer.write(row_offsets);
+    writer.write(targets);
+    writer.section();
+    writer.write(lengths);
+    writer.write(thicknesses);
+    writer.write(edge_colors);
+    writer.write(edge_descriptions);
+    
+    header.textures_offset = writer.section();
+    writer.write(texture_pairs);
+    
+    header.strings_offset = writer.section();
+    std::vector<blt::u64> string_offsets{0};
+    for (const auto* str : strings.getStrings())
+        string_offsets.push_back(string_offsets.back() + str->size());
+    writer.write(string_offsets);
+    for (const auto* str : strings.getStrings())
+        writer.write(str->data(), str->size());
+    
+    header.file_size = writer.offset;
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if (!file)
+    {
+        BLT_WARN("Failed to write snapshot %s!", temp_path.c_str());
+        return false;
+    }
+    
+    std::error_code error;
+    std::filesystem::rename(temp_path, std::string(path), error);
+    if (error)
+    {
+        BLT_WARN("Unable to replace %s: %s", std::string(path).c_str(), error.message().c_str());
+        return false;
+    }
+    return true;
+}
+
+std::optional<loader_t> loader_t::load_snapshot(graph_t& graph, std::string_view path)
+{
+    graph.clear();
+    
+    const mapped_file_t file{std::string(path)};
+    if (file.size() < sizeof(snapshot_header_t))
+        return {};
+    
+    snapshot_header_t header{};
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (const auto* reason = describe_invalid_header(header, file.size()))
+    {
+        BLT_WARN("Unable to load snapshot %s, %s!", std::string(path).c_str(), reason);
+        return {};
+    }
+    
+    const auto n = header.node_count;
+    const auto e = header.edge_count;
+    snapshot_reader_t reader{file};
+    
+    auto offset = header.nodes_offset;
+    const auto* x = reader.array<float>(offset, n);
+    const auto* y = reader.array<float>(offset += n * sizeof(float), n);
+    const auto* sizes = reader.array<float>(offset += n * sizeof(float), n);
+    const auto* outline_scales = reader.array<float>(offset += n * sizeof(float), n);
+    const auto* colors = reader.array<float>(offset += n * sizeof(float), n * 4);
+    const auto* names = reader.array<blt::u32>(offset += n * 4 * sizeof(float), n);
+    const auto* textures = reader.array<blt::u32>(offset += n * sizeof(blt::u32), n);
+    const auto* descriptions = reader.array<blt::u32>(offset += n * sizeof(blt::u32), n);
+    
+    offset = header.edges_offset;
+    const auto* row_offsets = reader.array<blt::u64>(offset, n + 1);
+    const auto* targets = reader.array<blt::u32>(offset += (n + 1) * sizeof(blt::u64), e);
+    offset = align(offset + e * sizeof(blt::u32));
+    const auto* lengths = reader.array<float>(offset, e);
+    const auto* thicknesses = reader.array<float>(offset += e * sizeof(float), e);
+    const auto* edge_colors = reader.array<float>(offset += e * sizeof(float), e * 4);
+    const auto* edge_descriptions = reader.array<blt::u32>(offset += e * 4 * sizeof(float), e);
+    
+    const auto* texture_pairs = reader.array<blt::u32>(header.textures_offset, header.texture_count * 2);
+    
+    const auto string_count = header.string_count;
+    const auto* string_offsets = reader.array<blt::u64>(header.strings_offset, string_count + 1);
+    const auto string_data_offset = header.strings_offset + (string_count + 1) * sizeof(blt::u64);
+    const auto* string_data = string_offsets ? reader.array<char>(string_data_offset, string_offsets[string_count]) : nullptr;
+    
+    if (!reader.valid || string_count == 0)
+    {
+        BLT_WARN("Unable to load snapshot %s, a section is out of bounds!", std::string(path).c_str());
+        return {};
+    }
+    
+    // every index is checked before anything is built so a corrupt file can't leave half a graph behind
+    bool indices_valid = row_offsets[0] == 0 && row_offsets[n] == e;
+    for (blt::u64 i = 0; i < n && indices_valid; i++)
+        indices_valid = names[i] < string_count && textures[i] < string_count && descriptions[i] < string_count &&
+                        row_offsets[i] <= row_offsets[i + 1];
+    for (blt::u64 i = 0; i < n && indices_valid; i++)
+    {
+        for (auto j = row_offsets[i]; j < row_offsets[i + 1] && indices_valid; j++)
+            indices_valid = targets[j] < n && targets[j] != i && edge_descriptions[j] < string_count;
+    }
+    for (blt::u64 i = 0; i < header.texture_count * 2 && indices_valid; i++)
+        indices_valid = texture_pairs[i] < string_count;
+    for (blt::u64 i = 0; i < string_count && indices_valid; i++)
+        indices_valid = string_offsets[i] <= string_offsets[i + 1];
+    if (!indices_valid)
+    {
+        BLT_WARN("Unable to load snapshot %s, it is corrupt!", std::string(path).c_str());
+        return {};
+    }
+    
+    const auto string_at = [string_offsets, string_data](blt::u32 index) {
+        return std::string(string_data + string_offsets[index], string_offsets[index + 1] - string_offsets[index]);
+    };
+    
+    loader_t loader;
+    loader.stamp = header.stamp;
+    for (blt::u64 i = 0; i < header.texture_count; i++)
+        loader.textures.emplace_back(string_at(texture_pairs[i * 2]), string_at(texture_pairs[i * 2 + 1]));
+    
+    graph.nodes.reserve(n);
+    for (blt::u64 i = 0; i < n; i++)
+    {
+        node_t node{sizes[i], string_at(names[i])};
+        node.texture = string_at(textures[i]);
+        node.description = string_at(descriptions[i]);
+        node.outline_scale = outline_scales[i];
+        node.outline_color = blt::vec4{colors[i * 4], colors[i * 4 + 1], colors[i * 4 + 2], colors[i * 4 + 3]};
+        graph.nodes.push_back(std::move(node));
+    }
+    
+    // the numeric columns are already laid out the way node_state stores them, a single copy each
+    auto& state = graph.node_state;
+    state.x.assign(x, x + n);
+    state.y.assign(y, y + n);
+    state.vx.assign(n, 0);
+    state.vy.assign(n, 0);
+    state.repulsiveness.assign(n, conf::DEFAULT_REPULSIVENESS);
+    state.mass.assign(n, 1);
+    
+    auto batch = graph.batch();
+    batch.reserve(0, e);
+    for (blt::u64 i = 0; i < n; i++)
+    {
+        for (auto j = row_offsets[i]; j < row_offsets[i + 1]; j++)
+        {
+            edge_t edge{i, targets[j]};
+            edge.ideal_spring_length = lengths[j];
+            edge.thickness = thicknesses[j];
+            edge.color = blt::vec4{edge_colors[j * 4], edge_colors[j * 4 + 1], edge_colors[j * 4 + 2], edge_colors[j * 4 + 3]};
+            edge.description = string_at(edge_descriptions[j]);
+            batch.connect(std::move(edge));
+        }
+    }
+    batch.commit();
+    
+    return loader;
+}
@@ -0,0 +1,124 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <texture_atlas.h>
+#include <blt/std/logging.h>
+#include <cmath>
+
+void texture_atlas_t::cleanup()
+{
+    loader.stop();
+    glDeleteTextures(static_cast<GLsizei>(pages.size()), pages.data());
+    pages.clear();
+    dirty.clear();
+    regions.clear();
+    requested.clear();
+    used_cells = 0;
+}
+
+const atlas_region_t* texture_atlas_t::request(const std::string& name)
+{
+    if (const auto region = regions.find(name); region != regions.end())
+        return &region->second;
+    if (requested.insert(name).second)
+    {
+        if (const auto source = sources.find(name); source != sources.end())
+            loader.load(name, prefix + source->second);
+        else
+            BLT_WARN("No texture called %s", name.c_str());
+    }
+    return find(name);
+}
+
+const atlas_region_t* texture_atlas_t::find(const std::string& name) const
+{
+    if (const auto region = regions.find(name); region != regions.end())
+        return &region->second;
+    if (const auto placeholder = regions.find(conf::DEFAULT_IMAGE); placeholder != regions.end())
+        return &placeholder->second;
+    return nullptr;
+}
+
+void texture_atlas_t::update()
+{
+    for (blt::size_t i = 0; i < conf::ATLAS_UPLOADS_PER_FRAME; i++)
+    {
+        auto texture = loader.poll();
+        if (!texture)
+            break;
+        // textures which can't be read keep using the placeholder, they stay requested so they aren't tried again
+        if (texture->pixels.empty())
+            continue;
+        const auto cell = used_cells % CELLS_PER_PAGE;
+        const auto region = allocate();
+        if (!region)
+        {
+            BLT_WARN("Texture atlas is full, %s will use the placeholder", texture->name.c_str());
+            continue;
+        }
+        glBindTexture(GL_TEXTURE_2D, pages[region->page]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(cell % CELLS_PER_ROW * conf::ATLAS_CELL_SIZE),
+                        static_cast<GLint>(cell / CELLS_PER_ROW * conf::ATLAS_CELL_SIZE), conf::ATLAS_CELL_SIZE, conf::ATLAS_CELL_SIZE, GL_RGBA,
+                        GL_UNSIGNED_BYTE, texture->pixels.data());
+        dirty[region->page] = true;
+        regions[std::move(texture->name)] = *region;
+        generation++;
+    }
+    
+    for (blt::size_t page = 0; page < pages.size(); page++)
+    {
+        if (!dirty[page])
+            continue;
+        glBindTexture(GL_TEXTURE_2D, pages[page]);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        dirty[page] = false;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+std::optional<atlas_region_t> texture_atlas_t::allocate()
+{
+    if (used_cells == pages.size() * CELLS_PER_PAGE)
+    {
+        if (pages.size() == conf::ATLAS_MAX_PAGES)
+            return {};
+        GLuint page;
+        glGenTextures(1, &page);
+        glBindTexture(GL_TEXTURE_2D, page);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, conf::ATLAS_PAGE_SIZE, conf::ATLAS_PAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // past the level where a cell is a single pixel neighbouring textures would bleed into each other
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(std::log2(conf::ATLAS_CELL_SIZE)));
+        pages.push_back(page);
+        dirty.push_back(false);
+        BLT_INFO("Created texture atlas page %lu", pages.size());
+    }
+    
+    const auto page = used_cells / CELLS_PER_PAGE;
+    const auto cell = used_cells % CELLS_PER_PAGE;
+    used_cells++;
+    
+    // half a texel in from the edges of the cell so filtering never samples the neighbouring cell
+    constexpr float texel = 1.0f / conf::ATLAS_PAGE_SIZE;
+    constexpr float cell_size = static_cast<float>(conf::ATLAS_CELL_SIZE) / conf::ATLAS_PAGE_SIZE;
+    const auto x = static_cast<float>(cell % CELLS_PER_ROW) * cell_size;
+    const auto y = static_cast<float>(cell / CELLS_PER_ROW) * cell_size;
+    return atlas_region_t{static_cast<blt::u32>(page), blt::vec2{x + texel / 2, y + texel / 2}, blt::vec2{x + cell_size - texel / 2, y + cell_size - texel / 2}};
+}
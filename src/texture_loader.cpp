@@ -0,0 +1,136 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <texture_loader.h>
+#include <blt/std/logging.h>
+#include <blt/gfx/stb/stb_image.h>
+#include <algorithm>
+
+namespace
+{
+    // box filters src down (or repeats pixels up) to a square of conf::ATLAS_CELL_SIZE
+    std::vector<blt::u8> scale_to_cell(const blt::u8* src, blt::size_t width, blt::size_t height)
+    {
+        constexpr auto size = conf::ATLAS_CELL_SIZE;
+        std::vector<blt::u8> out(size * size * 4);
+        for (blt::size_t y = 0; y < size; y++)
+        {
+            const auto y0 = y * height / size;
+            const auto y1 = std::max(y0 + 1, ((y + 1) * height + size - 1) / size);
+            for (blt::size_t x = 0; x < size; x++)
+            {
+                const auto x0 = x * width / size;
+                const auto x1 = std::max(x0 + 1, ((x + 1) * width + size - 1) / size);
+                blt::u32 sum[4]{};
+                for (auto sy = y0; sy < y1; sy++)
+                {
+                    for (auto sx = x0; sx < x1; sx++)
+                    {
+                        const auto* pixel = src + (sy * width + sx) * 4;
+                        for (int c = 0; c < 4; c++)
+                            sum[c] += pixel[c];
+                    }
+                }
+                const auto count = static_cast<blt::u32>((y1 - y0) * (x1 - x0));
+                auto* pixel = out.data() + (y * size + x) * 4;
+                for (int c = 0; c < 4; c++)
+                    pixel[c] = static_cast<blt::u8>(sum[c] / count);
+            }
+        }
+        return out;
+    }
+}
+
+void texture_loader_t::load(std::string name, std::string path)
+{
+#ifdef __EMSCRIPTEN__
+    // no pthreads in the web build, the image is decoded right away instead.
+    auto texture = decode(std::move(name), path);
+    std::scoped_lock lock(mutex);
+    results.push_back(std::move(texture));
+#else
+    {
+        std::scoped_lock lock(mutex);
+        jobs.push_back({std::move(name), std::move(path)});
+        stopping = false;
+    }
+    if (workers.empty())
+    {
+        for (blt::size_t i = 0; i < std::max(thread_count, static_cast<blt::size_t>(1)); i++)
+            workers.emplace_back(&texture_loader_t::run, this);
+    }
+    cond.notify_one();
+#endif
+}
+
+std::optional<decoded_texture_t> texture_loader_t::poll()
+{
+    std::scoped_lock lock(mutex);
+    if (results.empty())
+        return {};
+    auto result = std::move(results.front());
+    results.pop_front();
+    return result;
+}
+
+void texture_loader_t::stop()
+{
+    {
+        std::scoped_lock lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    cond.notify_all();
+    for (auto& thread : workers)
+        thread.join();
+    workers.clear();
+}
+
+decoded_texture_t texture_loader_t::decode(std::string name, const std::string& path)
+{
+    decoded_texture_t texture{std::move(name), {}};
+    int width, height, channels;
+    auto* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (data == nullptr)
+    {
+        BLT_WARN("Unable to load texture %s from %s: %s", texture.name.c_str(), path.c_str(), stbi_failure_reason());
+        return texture;
+    }
+    texture.pixels = scale_to_cell(data, static_cast<blt::size_t>(width), static_cast<blt::size_t>(height));
+    stbi_image_free(data);
+    return texture;
+}
+
+void texture_loader_t::run()
+{
+    while (true)
+    {
+        job_t job;
+        {
+            std::unique_lock lock(mutex);
+            cond.wait(lock, [this]() { return !jobs.empty() || stopping; });
+            if (stopping)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        
+        auto texture = decode(std::move(job.name), job.path);
+        
+        std::scoped_lock lock(mutex);
+        results.push_back(std::move(texture));
+    }
+}
@@ -0,0 +1,155 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <thread_pool.h>
+#include <algorithm>
+
+void thread_pool_t::resize(blt::size_t thread_count)
+{
+#ifdef __EMSCRIPTEN__
+    // no pthreads in the web build, everything runs on the calling thread.
+    thread_count = 1;
+#endif
+    thread_count = std::max(thread_count, static_cast<blt::size_t>(1));
+    if (thread_count == size() && queues)
+        return;
+    stop();
+    stopping = false;
+    queues = std::make_unique<queue_t[]>(thread_count);
+    for (blt::size_t i = 1; i < thread_count; i++)
+        workers.emplace_back(&thread_pool_t::worker, this, i, generation);
+}
+
+void thread_pool_t::parallel_for(blt::size_t count_, blt::size_t chunk_size_, const task_t& task_)
+{
+    if (count_ == 0)
+        return;
+    chunk_size_ = std::max(chunk_size_, static_cast<blt::size_t>(1));
+    const auto chunks = (count_ + chunk_size_ - 1) / chunk_size_;
+    
+    if (workers.empty() || chunks == 1)
+    {
+        for (blt::size_t begin = 0; begin < count_; begin += chunk_size_)
+            task_(begin, std::min(begin + chunk_size_, count_), 0);
+        return;
+    }
+    
+    const auto threads = size();
+    for (blt::size_t i = 0; i < threads; i++)
+        queues[i].range.store(pack(chunks * i / threads, chunks * (i + 1) / threads), std::memory_order_relaxed);
+    
+    {
+        std::scoped_lock lock(mutex);
+        task = &task_;
+        count = count_;
+        chunk_size = chunk_size_;
+        running = workers.size();
+        generation++;
+    }
+    start_cond.notify_all();
+    
+    run(0);
+    
+    std::unique_lock lock(mutex);
+    done_cond.wait(lock, [this]() { return running == 0; });
+    task = nullptr;
+}
+
+void thread_pool_t::worker(blt::size_t thread, blt::u64 seen)
+{
+    while (true)
+    {
+        {
+            std::unique_lock lock(mutex);
+            start_cond.wait(lock, [this, seen]() { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        
+        run(thread);
+        
+        std::scoped_lock lock(mutex);
+        if (--running == 0)
+            done_cond.notify_one();
+    }
+}
+
+void thread_pool_t::run(blt::size_t thread)
+{
+    blt::size_t chunk;
+    while (pop(thread, chunk))
+    {
+        const auto begin = chunk * chunk_size;
+        (*task)(begin, std::min(begin + chunk_size, count), thread);
+    }
+}
+
+bool thread_pool_t::pop(blt::size_t thread, blt::size_t& chunk)
+{
+    auto& range = queues[thread].range;
+    auto current = range.load(std::memory_order_acquire);
+    while (true)
+    {
+        const auto front = current & 0xFFFFFFFF;
+        const auto back = current >> 32;
+        if (front >= back)
+            break;
+        if (range.compare_exchange_weak(current, pack(front + 1, back), std::memory_order_acq_rel))
+        {
+            chunk = front;
+            return true;
+        }
+    }
+    
+    const auto threads = size();
+    for (blt::size_t i = 1; i < threads; i++)
+    {
+        if (steal((thread + i) % threads, chunk))
+            return true;
+    }
+    return false;
+}
+
+bool thread_pool_t::steal(blt::size_t victim, blt::size_t& chunk)
+{
+    auto& range = queues[victim].range;
+    auto current = range.load(std::memory_order_acquire);
+    while (true)
+    {
+        const auto front = current & 0xFFFFFFFF;
+        const auto back = current >> 32;
+        if (front >= back)
+            return false;
+        if (range.compare_exchange_weak(current, pack(front, back - 1), std::memory_order_acq_rel))
+        {
+            chunk = back - 1;
+            return true;
+        }
+    }
+}
+
+void thread_pool_t::stop()
+{
+    {
+        std::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    start_cond.notify_all();
+    for (auto& thread : workers)
+        thread.join();
+    workers.clear();
+}
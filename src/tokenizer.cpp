@@ -16,56 +16,140 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <tokenizer.h>
+#include <blt/std/logging.h>
 #include <cctype>
 
 namespace proc
 {
-    const std::vector<token_t>& tokenizer::tokenize()
+    token_t tokenizer::next()
     {
-        while (has_next())
+        if (!skip_ignored())
+            return make_token(state_t::NONE, data.substr(begin));
+        begin = current_pos;
+        begin_line = line_number;
+        if (!has_next())
+            return make_token(state_t::END, {});
+        
+        const auto next = advance();
+        switch (next)
         {
-            auto next = advance();
-            if (std::isspace(next))
+            case '\n':
+                line_number++;
+                return make_token(state_t::NEWLINE, data.substr(begin, 1));
+            case '[':
+                return make_token(state_t::SQUARE_OPEN, data.substr(begin, 1));
+            case ']':
+                return make_token(state_t::SQUARE_CLOSE, data.substr(begin, 1));
+            case '{':
+                return make_token(state_t::CURLY_OPEN, data.substr(begin, 1));
+            case '}':
+                return make_token(state_t::CURLY_CLOSE, data.substr(begin, 1));
+            case ';':
+                return make_token(state_t::SEMI, data.substr(begin, 1));
+            case ':':
+                return make_token(state_t::COLON, data.substr(begin, 1));
+            case '=':
+                return make_token(state_t::EQUAL, data.substr(begin, 1));
+            case ',':
+                return make_token(state_t::COMMA, data.substr(begin, 1));
+            case '"':
+            case '\'':
             {
-                if (next == '\n')
+                while (has_next() && peek() != next)
                 {
-                    state = state_t::NEWLINE;
-                    line_number++;
+                    if (advance() == '\n')
+                        line_number++;
                 }
-                new_token();
-                continue;
-            }
-            state_t determine = state_t::NONE;
-            if (is_digit(next))
-                determine = state_t::VALUE;
-            else
-            {
-                switch (next)
+                if (!has_next())
                 {
-                    case '[':
-                        determine = state_t::SQUARE_OPEN;
-                        break;
-                    case ']':
-                        determine = state_t::SQUARE_CLOSE;
-                        break;
-                    default:
-                        BLT_ERROR("Failed to parse data, error found at character index %ld on line %ld", current_pos, line_number);
-                        BLT_ERROR("Context:");
-                        BLT_ERROR(std::string_view(&data[std::max(0ul, current_pos - 40)], std::min(data.size() - current_pos, current_pos + 40)));
-                        break;
+                    BLT_ERROR("Unterminated quote starting on line %lu", static_cast<unsigned long>(begin_line));
+                    return make_token(state_t::NONE, data.substr(begin));
                 }
+                advance();
+                return make_token(state_t::TEXT, data.substr(begin + 1, current_pos - begin - 2));
             }
-            if (!can_state(determine))
-            {
-                begin = current_pos;
-                new_token();
-            }
+            default:
+                break;
         }
+        
+        while (has_next() && !is_separator(peek()))
+            advance();
+        const auto word = data.substr(begin, current_pos - begin);
+        
+        // numbers as written in c, 10, -1.5, 2e3 or 0.0f
+        auto digits = word;
+        if (digits.size() > 1 && (digits.back() == 'f' || digits.back() == 'F'))
+            digits.remove_suffix(1);
+        if (!digits.empty() && (digits.front() == '-' || digits.front() == '+'))
+            digits.remove_prefix(1);
+        bool is_number = !digits.empty() && (std::isdigit(static_cast<unsigned char>(digits.front())) || digits.front() == '.');
+        for (blt::size_t i = 0; i < digits.size() && is_number; i++)
+        {
+            const auto c = static_cast<unsigned char>(digits[i]);
+            is_number = std::isdigit(c) || c == '.' || ((c == 'e' || c == 'E') && i > 0) ||
+                        ((c == '-' || c == '+') && i > 0 && (digits[i - 1] == 'e' || digits[i - 1] == 'E'));
+        }
+        return make_token(is_number ? state_t::VALUE : state_t::IDENT, word);
+    }
+    
+    const std::vector<token_t>& tokenizer::tokenize()
+    {
+        for (auto token = next(); token.token != state_t::END; token = next())
+            tokens.push_back(token);
         return tokens;
     }
     
-    bool tokenizer::is_digit(char c) const
+    bool tokenizer::is_separator(char c)
+    {
+        switch (c)
+        {
+            case '[':
+            case ']':
+            case '{':
+            case '}':
+            case ';':
+            case ':':
+            case '=':
+            case ',':
+            case '"':
+                return true;
+            default:
+                return std::isspace(static_cast<unsigned char>(c));
+        }
+    }
+    
+    bool tokenizer::skip_ignored()
     {
-        return std::isdigit(c) || (state == state_t::VALUE && c == '.');
+        while (has_next())
+        {
+            const auto c = peek();
+            if (c != '\n' && std::isspace(static_cast<unsigned char>(c)))
+                advance();
+            else if (c == '#' || (c == '/' && has_next(1) && peek(1) == '/'))
+            {
+                // the newline ending the comment still ends the line
+                while (has_next() && peek() != '\n')
+                    advance();
+            } else if (c == '/' && has_next(1) && peek(1) == '*')
+            {
+                // an unterminated comment is reported as a token starting where the comment does
+                begin = current_pos;
+                begin_line = line_number;
+                current_pos += 2;
+                while (has_next() && !(peek() == '*' && has_next(1) && peek(1) == '/'))
+                {
+                    if (advance() == '\n')
+                        line_number++;
+                }
+                if (!has_next())
+                {
+                    BLT_ERROR("Unterminated block comment starting on line %lu", static_cast<unsigned long>(begin_line));
+                    return false;
+                }
+                current_pos += 2;
+            } else
+                return true;
+        }
+        return true;
     }
 }
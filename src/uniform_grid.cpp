@@ -0,0 +1,50 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <uniform_grid.h>
+#include <algorithm>
+
+void uniform_grid_t::build(const node_state_t& nodes, float size)
+{
+    clear();
+    cell_size = std::max(size, 1.0f);
+    inv_cell_size = 1.0f / cell_size;
+    cutoff_sq = cell_size * cell_size;
+    
+    keys.resize(nodes.size());
+    for (blt::size_t i = 0; i < nodes.size(); i++)
+        keys[i] = {make_key(cell_of(nodes.x[i]), cell_of(nodes.y[i])), static_cast<blt::u32>(i)};
+    // sorting on the index as well keeps the order inside of a cell, and with it the summation order, the same between runs
+    std::sort(keys.begin(), keys.end());
+    
+    x.resize(nodes.size());
+    y.resize(nodes.size());
+    repulsiveness.resize(nodes.size());
+    mass.resize(nodes.size());
+    cells.reserve(nodes.size());
+    for (blt::size_t i = 0; i < keys.size(); i++)
+    {
+        const auto [key, index] = keys[i];
+        x[i] = nodes.x[index];
+        y[i] = nodes.y[index];
+        repulsiveness[i] = nodes.repulsiveness[index];
+        mass[i] = nodes.mass[index];
+        
+        if (i == 0 || keys[i - 1].first != key)
+            cells[key].begin = static_cast<blt::u32>(i);
+        cells[key].end = static_cast<blt::u32>(i + 1);
+    }
+}
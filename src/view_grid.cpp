@@ -0,0 +1,191 @@
+/*
+ *  Copyright (C) 2024  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <view_grid.h>
+#include <config.h>
+#include <limits>
+
+/**
+ * --------------------------------------------------------
+ *                      view_grid_t
+ * --------------------------------------------------------
+ */
+
+void view_grid_t::build(const node_state_t& nodes, const std::vector<edge_t>& edges)
+{
+    columns = rows = 0;
+    drift = 0;
+    long_edges.clear();
+    edge_seen.assign(edges.size(), 0);
+    query = 0;
+    binned_x = nodes.x;
+    binned_y = nodes.y;
+    if (nodes.size() == 0)
+        return;
+    
+    // a node which isn't at a finite position would stretch the grid over everything, it ends up in a border cell instead
+    blt::vec2 min{std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    blt::vec2 max{std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    for (blt::size_t i = 0; i < nodes.size(); i++)
+    {
+        if (!std::isfinite(nodes.x[i]) || !std::isfinite(nodes.y[i]))
+            continue;
+        min = blt::vec2{std::min(min.x(), nodes.x[i]), std::min(min.y(), nodes.y[i])};
+        max = blt::vec2{std::max(max.x(), nodes.x[i]), std::max(max.y(), nodes.y[i])};
+    }
+    if (min.x() > max.x())
+        min = max = blt::vec2{};
+    const auto width = std::max(max.x() - min.x(), 1.0f);
+    const auto height = std::max(max.y() - min.y(), 1.0f);
+    cell_size = std::sqrt(width * height * conf::VIEW_GRID_NODES_PER_CELL / static_cast<float>(nodes.size()));
+    cell_size = std::max(cell_size, std::max(width, height) / conf::VIEW_GRID_MAX_CELLS);
+    origin = min;
+    inv_cell_size = 1.0f / cell_size;
+    columns = static_cast<blt::u32>(width * inv_cell_size) + 1;
+    rows = static_cast<blt::u32>(height * inv_cell_size) + 1;
+    const auto cells = static_cast<blt::size_t>(columns) * rows;
+    
+    // count per cell shifted by one, so the prefix sum turns the counts into offsets
+    node_offsets.assign(cells + 1, 0);
+    for (blt::size_t i = 0; i < nodes.size(); i++)
+    {
+        const auto [x, y] = cell_of(nodes.getPosition(i));
+        node_offsets[y * columns + x + 1]++;
+    }
+    for (blt::size_t i = 1; i < node_offsets.size(); i++)
+        node_offsets[i] += node_offsets[i - 1];
+    node_list.resize(nodes.size());
+    std::vector<blt::u32> cursor{node_offsets.begin(), node_offsets.end() - 1};
+    for (blt::size_t i = 0; i < nodes.size(); i++)
+    {
+        const auto [x, y] = cell_of(nodes.getPosition(i));
+        node_list[cursor[y * columns + x]++] = static_cast<blt::u32>(i);
+    }
+    
+    const auto edge_cells = [this, &nodes](const edge_t& edge) {
+        const auto [x1, y1] = cell_of(nodes.getPosition(edge.getFirst()));
+        const auto [x2, y2] = cell_of(nodes.getPosition(edge.getSecond()));
+        return std::pair{cell_t{std::min(x1, x2), std::min(y1, y2)}, cell_t{std::max(x1, x2), std::max(y1, y2)}};
+    };
+    const auto is_long = [](const cell_t& begin, const cell_t& end) {
+        return static_cast<blt::size_t>(end.x - begin.x + 1) * (end.y - begin.y + 1) > conf::VIEW_GRID_MAX_EDGE_CELLS;
+    };
+    
+    edge_offsets.assign(cells + 1, 0);
+    for (const auto& edge : edges)
+    {
+        const auto [begin, end] = edge_cells(edge);
+        if (is_long(begin, end))
+            continue;
+        for (auto cy = begin.y; cy <= end.y; cy++)
+            for (auto cx = begin.x; cx <= end.x; cx++)
+                edge_offsets[cy * columns + cx + 1]++;
+    }
+    for (blt::size_t i = 1; i < edge_offsets.size(); i++)
+        edge_offsets[i] += edge_offsets[i - 1];
+    edge_list.resize(edge_offsets.back());
+    cursor.assign(edge_offsets.begin(), edge_offsets.end() - 1);
+    for (blt::size_t i = 0; i < edges.size(); i++)
+    {
+        const auto [begin, end] = edge_cells(edges[i]);
+        if (is_long(begin, end))
+        {
+            long_edges.push_back(static_cast<blt::u32>(i));
+            continue;
+        }
+        for (auto cy = begin.y; cy <= end.y; cy++)
+            for (auto cx = begin.x; cx <= end.x; cx++)
+                edge_list[cursor[cy * columns + cx]++] = static_cast<blt::u32>(i);
+    }
+}
+
+bool view_grid_t::refresh(const node_state_t& nodes, const std::vector<edge_t>& edges)
+{
+    if (nodes.size() != binned_x.size() || edges.size() != edge_seen.size())
+    {
+        build(nodes, edges);
+        return true;
+    }
+    // the grid is only ever padded by the drift, so it is worked out squared and compared against a cell first
+    const auto cell_sq = cell_size * cell_size;
+    float drift_sq = 0;
+    for (blt::size_t i = 0; i < nodes.size(); i++)
+    {
+        const auto dx = nodes.x[i] - binned_x[i];
+        const auto dy = nodes.y[i] - binned_y[i];
+        const auto moved_sq = dx * dx + dy * dy;
+        if (moved_sq < cell_sq)
+        {
+            drift_sq = std::max(drift_sq, moved_sq);
+            continue;
+        }
+        // somewhere too far off to work out how far it moved (or not a number), it is fine where it is as long as it is still clamped
+        // into the same border cell, which is all the node and its edges were binned by
+        if (!std::isfinite(moved_sq))
+        {
+            const auto now = cell_of(nodes.getPosition(i));
+            const auto was = cell_of(blt::vec2{binned_x[i], binned_y[i]});
+            if (now.x == was.x && now.y == was.y)
+                continue;
+        }
+        build(nodes, edges);
+        return true;
+    }
+    drift = std::sqrt(drift_sq);
+    return false;
+}
+
+/**
+ * --------------------------------------------------------
+ *                      lod_filter_t
+ * --------------------------------------------------------
+ */
+
+void lod_filter_t::begin(const view_rect_t& view, float cell_pixels)
+{
+    origin = view.min;
+    inv_cell_size = view.pixels_per_unit / cell_pixels;
+    columns = static_cast<blt::u32>(std::clamp((view.max.x() - view.min.x()) * inv_cell_size, 0.0f, 65535.0f)) + 1;
+    rows = static_cast<blt::u32>(std::clamp((view.max.y() - view.min.y()) * inv_cell_size, 0.0f, 65535.0f)) + 1;
+    points.assign(static_cast<blt::size_t>(columns) * rows, false);
+    lines.clear();
+}
+
+bool lod_filter_t::claim(const blt::vec2& pos)
+{
+    const auto x = static_cast<blt::u32>(std::clamp(square_of(pos.x(), origin.x()), 0, static_cast<blt::i32>(columns - 1)));
+    const auto y = static_cast<blt::u32>(std::clamp(square_of(pos.y(), origin.y()), 0, static_cast<blt::i32>(rows - 1)));
+    const auto square = static_cast<blt::size_t>(y) * columns + x;
+    if (points[square])
+        return false;
+    points[square] = true;
+    return true;
+}
+
+bool lod_filter_t::claim(const blt::vec2& p1, const blt::vec2& p2)
+{
+    auto a = key_of(p1);
+    auto b = key_of(p2);
+    // lines inside of a single square are too short to see at all
+    if (a == b)
+        return false;
+    if (a > b)
+        std::swap(a, b);
+    // both squares don't fit in a single key, mixing them can collide but that only ever hides a line
+    auto key = a * 0x9E3779B97F4A7C15ull ^ b;
+    key ^= key >> 31;
+    return lines.insert(key).second;
+}